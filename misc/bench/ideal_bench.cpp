@@ -0,0 +1,147 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* IdealLRUArray microbenchmark: the current array (LineIndex + index-linked LRU list) vs the previous
+ * implementation (g_unordered_map + intrusive list), reproduced below as MapIdealLRUArray. Both replay
+ * the same access stream (lookup, and preinsert+postinsert on misses); hits and victims must match.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "ideal_arrays.h"
+#include "intrusive_list.h"
+#include "log.h"
+#include "mtrand.h"
+
+//Previous IdealLRUArray lookup/insertion path (ideal_arrays.h before the LineIndex change), without its proxy repl policy
+class MapIdealLRUArray : public GlobAlloc {
+    private:
+        struct Entry : InListNode<Entry> {
+            Address lineAddr;
+            const uint32_t lineId;
+            explicit Entry(uint32_t _lineId) : lineAddr(0), lineId(_lineId) {}
+        };
+
+        Entry* array;
+        InList<Entry> lruList;
+        g_unordered_map<Address, uint32_t> lineMap;
+
+    public:
+        explicit MapIdealLRUArray(uint32_t numLines) {
+            array = gm_calloc<Entry>(numLines);
+            for (uint32_t i = 0; i < numLines; i++) {
+                Entry* e = new (&array[i]) Entry(i);
+                lruList.push_front(e);
+            }
+        }
+
+        int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            g_unordered_map<Address, uint32_t>::iterator it = lineMap.find(lineAddr);
+            if (it == lineMap.end()) return -1;
+            uint32_t lineId = it->second;
+            if (updateReplacement) {
+                lruList.remove(&array[lineId]);
+                lruList.push_front(&array[lineId]);
+            }
+            return lineId;
+        }
+
+        uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+            Entry* e = lruList.back();
+            *wbLineAddr = e->lineAddr;
+            return e->lineId;
+        }
+
+        void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) {
+            Entry* e = &array[lineId];
+            lineMap.erase(e->lineAddr);
+            e->lineAddr = lineAddr;
+            lineMap[lineAddr] = lineId;
+            lruList.remove(e);
+            lruList.push_front(e);
+        }
+};
+
+struct Result {
+    double ns;
+    uint64_t hits;
+    uint64_t checksum;  //of hit line ids and victims
+};
+
+template <typename A> static Result run(uint32_t numLines, const std::vector<Address>& stream, uint32_t reps) {
+    Result res = {1e30, 0, 0};
+    for (uint32_t r = 0; r < reps; r++) {
+        A* a = new A(numLines);
+        uint64_t hits = 0, sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (Address lineAddr : stream) {
+            int32_t id = a->lookup(lineAddr, nullptr, true);
+            if (id >= 0) {
+                hits++;
+                sum = sum*31 + id;
+            } else {
+                Address wbLineAddr;
+                uint32_t cand = a->preinsert(lineAddr, nullptr, &wbLineAddr);
+                a->postinsert(lineAddr, nullptr, cand);
+                sum = sum*31 + wbLineAddr;
+            }
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        res.ns = MIN(res.ns, 1e9*secs/stream.size());
+        res.hits = hits;
+        res.checksum = sum;
+        //Arrays are not freed (neither class supports it), so keep reps low for large arrays
+    }
+    return res;
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(4ul << 30);
+    const uint32_t numAccesses = (argc > 1)? atoi(argv[1]) : 20*1000*1000;
+    const uint32_t reps = 3;
+
+    printf("%d accesses, best of %d, ns/access\n", numAccesses, reps);
+    printf("%8s %6s %8s %8s\n", "lines", "hits", "map", "index");
+    for (uint32_t numLines : {4*1024, 64*1024, 256*1024, 1024*1024}) {
+        //70% of accesses go to a hot set of half the array, the rest anywhere in 16x the array
+        MTRand rnd(numLines);
+        std::vector<Address> stream(numAccesses);
+        for (uint32_t i = 0; i < numAccesses; i++) {
+            bool hot = rnd.randExc() < 0.7;
+            stream[i] = 1 + (hot? rnd.randInt(numLines/2 - 1) : rnd.randInt(16*numLines - 1));
+        }
+        Result m = run<MapIdealLRUArray>(numLines, stream, reps);
+        Result x = run<IdealLRUArray>(numLines, stream, reps);
+        if (m.hits != x.hits || m.checksum != x.checksum) panic("Hits or victims differ (%d lines)", numLines);
+        printf("%8d %5.1f%% %8.1f %8.1f\n", numLines, 100.0*x.hits/numAccesses, m.ns, x.ns);
+    }
+    return 0;
+}
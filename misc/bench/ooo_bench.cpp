@@ -0,0 +1,242 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* OOOCore structures microbenchmark: the instruction window, ROB, load/store queues, uop queue and branch
+ * predictor of OOOCoreImpl, specialized on each pre-instantiated core size vs runtime-sized (all-zero
+ * params). Pipeline<P> follows OOOCoreImpl::bbl() on a synthetic uop stream, with fixed-latency loads and
+ * stores instead of the L1d. Both variants must reach the same cycle and mispredict counts.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "ooo_core_structs.h"
+
+//Same as OOOCoreParams in ooo_core.h, which needs Pin
+template <uint32_t IW, uint32_t ROB, uint32_t RW, uint32_t LQ, uint32_t SQ, uint32_t UQ, uint32_t NB, uint32_t HB, uint32_t LB>
+struct Params {
+    static const uint32_t iwSize = IW, robSize = ROB, retireWidth = RW, lqSize = LQ, sqSize = SQ, uopQueueSize = UQ;
+    static const uint32_t bpIndexBits = NB, bpHistBits = HB, bpPhtBits = LB;
+};
+
+struct Sizes {
+    const char* name;
+    uint32_t iw, rob, rw, lq, sq, uq, nb, hb, lb;
+};
+
+//As in ooo_core.cpp
+typedef Params<16, 32, 2, 10, 16, 16, 10, 16, 12> SmallParams;
+typedef Params<36, 128, 4, 32, 32, 28, 11, 18, 14> MediumParams;
+typedef Params<97, 224, 4, 72, 56, 64, 12, 20, 16> LargeParams;
+typedef Params<0, 0, 0, 0, 0, 0, 0, 0, 0> RuntimeParams;
+static const Sizes small = {"small", 16, 32, 2, 10, 16, 16, 10, 16, 12};
+static const Sizes medium = {"medium", 36, 128, 4, 32, 32, 28, 11, 18, 14};
+static const Sizes large = {"large", 97, 224, 4, 72, 56, 64, 12, 20, 16};
+
+enum BenchUopType {GENERAL, LOAD, STORE, STORE_ADDR};
+
+struct BenchUop {
+    uint8_t type;
+    uint8_t rs[2], rd;
+    uint8_t portMask;
+    uint8_t lat;        //execution latency, or memory latency for loads and stores
+    uint8_t decDiff;    //decode cycles since the previous uop
+    uint8_t endsBbl;
+    Address branchPc;   //if endsBbl
+    bool taken;
+};
+
+static const uint32_t ISSUES_PER_CYCLE = 4;
+static const uint32_t DISPATCH_DELAY = 2;   //DISPATCH_STAGE - ISSUE_STAGE
+static const uint32_t MISPRED_PENALTY = 17;
+
+template <typename P>
+class Pipeline {
+    private:
+        WindowStructure<1024, P::iwSize> insWindow;
+        ReorderBuffer<P::robSize, P::retireWidth> rob;
+        ReorderBuffer<P::lqSize, P::retireWidth> loadQueue;
+        ReorderBuffer<P::sqSize, P::retireWidth> storeQueue;
+        CycleQueue<P::uopQueueSize> uopQueue;
+        BranchPredictorPAg<P::bpIndexBits, P::bpHistBits, P::bpPhtBits> branchPred;
+
+        uint64_t regScoreboard[16];
+        uint64_t curCycle, decodeCycle, lastStoreAddrCommitCycle;
+        uint32_t curCycleIssuedUops;
+
+    public:
+        uint64_t mispreds;
+
+        explicit Pipeline(const Sizes& s) : insWindow(s.iw), rob(s.rob, s.rw), loadQueue(s.lq, s.rw), storeQueue(s.sq, s.rw),
+            uopQueue(s.uq), branchPred(s.nb, s.hb, s.lb), curCycle(0), decodeCycle(0), lastStoreAddrCommitCycle(0),
+            curCycleIssuedUops(0), mispreds(0) {
+            for (uint64_t& c : regScoreboard) c = 0;
+        }
+
+        uint64_t run(const std::vector<BenchUop>& uops) {
+            uint64_t lastCommitCycle = 0;
+            for (const BenchUop& uop : uops) {
+                decodeCycle = MAX(decodeCycle + uop.decDiff, uopQueue.minAllocCycle());
+                if (decodeCycle > curCycle) {
+                    uint32_t cdDiff = decodeCycle - curCycle;
+                    curCycleIssuedUops = 0;
+                    for (uint32_t i = 0; i < cdDiff; i++) insWindow.advancePos(curCycle);
+                }
+                uopQueue.markLeave(curCycle);
+
+                if (curCycleIssuedUops >= ISSUES_PER_CYCLE) {
+                    curCycleIssuedUops = 0;
+                    insWindow.advancePos(curCycle);
+                }
+                curCycleIssuedUops++;
+
+                regScoreboard[0] = curCycle;
+                uint64_t cOps = MAX(regScoreboard[uop.rs[0]], regScoreboard[uop.rs[1]]);
+                uint64_t c3 = curCycle;
+                uint64_t dispatchCycle = MAX(cOps, MAX(rob.minAllocCycle(), c3) + DISPATCH_DELAY);
+                insWindow.schedule(curCycle, dispatchCycle, uop.portMask);
+                if (curCycle > c3) curCycleIssuedUops = 0;
+
+                uint64_t commitCycle;
+                switch (uop.type) {
+                    case LOAD:
+                        dispatchCycle = MAX(MAX(loadQueue.minAllocCycle(), dispatchCycle), lastStoreAddrCommitCycle+1);
+                        commitCycle = dispatchCycle + uop.lat;
+                        loadQueue.markRetire(commitCycle);
+                        break;
+                    case STORE:
+                        dispatchCycle = MAX(MAX(storeQueue.minAllocCycle(), dispatchCycle), lastStoreAddrCommitCycle+1);
+                        commitCycle = dispatchCycle + uop.lat;
+                        storeQueue.markRetire(commitCycle);
+                        break;
+                    case STORE_ADDR:
+                        commitCycle = dispatchCycle + uop.lat;
+                        lastStoreAddrCommitCycle = MAX(lastStoreAddrCommitCycle, commitCycle);
+                        break;
+                    default:
+                        commitCycle = dispatchCycle + uop.lat;
+                }
+                rob.markRetire(commitCycle);
+                regScoreboard[uop.rd] = commitCycle;
+                lastCommitCycle = commitCycle;
+
+                if (uop.endsBbl && !branchPred.predict(uop.branchPc, uop.taken)) {
+                    mispreds++;
+                    decodeCycle = MAX(decodeCycle, lastCommitCycle + MISPRED_PENALTY);
+                }
+            }
+            return curCycle;
+        }
+};
+
+//Bbls of 4-12 uops ending in a branch; each static branch has its own bias, and loads sometimes miss
+static std::vector<BenchUop> makeUops(uint32_t numUops) {
+    MTRand rnd(1);
+    const uint32_t numBranches = 4096;
+    std::vector<double> bias(numBranches);
+    for (double& b : bias) b = (rnd.randInt(3) == 0)? rnd.randExc() : ((rnd.randInt(1)? 0.98 : 0.02));
+
+    std::vector<BenchUop> uops(numUops);
+    uint32_t bblLeft = 0;
+    for (BenchUop& u : uops) {
+        u = BenchUop();
+        double r = rnd.randExc();
+        if (r < 0.25) {
+            double m = rnd.randExc();
+            u.type = LOAD;
+            u.portMask = 0x04;
+            u.lat = (m < 0.01)? 200 : ((m < 0.05)? 40 : 4);
+        } else if (r < 0.35) {
+            u.type = STORE_ADDR;
+            u.portMask = 0x08;
+            u.lat = 1;
+        } else if (r < 0.45) {
+            u.type = STORE;
+            u.portMask = 0x10;
+            u.lat = 4;
+        } else {
+            u.type = GENERAL;
+            u.portMask = 0x23;
+            u.lat = 1 + rnd.randInt(2)*rnd.randInt(1);
+        }
+        u.rs[0] = rnd.randInt(15);
+        u.rs[1] = rnd.randInt(1)? rnd.randInt(15) : 0;
+        u.rd = 1 + rnd.randInt(14);
+        u.decDiff = (rnd.randInt(3) == 0);
+        if (!bblLeft) bblLeft = 4 + rnd.randInt(8);
+        if (--bblLeft == 0) {
+            uint32_t b = rnd.randInt(numBranches - 1);
+            u.endsBbl = true;
+            u.branchPc = 0x400000 + 16*b;
+            u.taken = rnd.randExc() < bias[b];
+        }
+    }
+    return uops;
+}
+
+//Best-of-reps ns/uop; returns the final cycle and mispredicts of the last rep
+template <typename P> static double time(const Sizes& s, const std::vector<BenchUop>& uops, uint32_t reps, uint64_t& cycles, uint64_t& mispreds) {
+    double best = 1e30;
+    for (uint32_t r = 0; r < reps; r++) {
+        Pipeline<P>* p = new Pipeline<P>(s);
+        auto start = std::chrono::steady_clock::now();
+        cycles = p->run(uops);
+        best = MIN(best, 1e9*std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()/uops.size());
+        mispreds = p->mispreds;
+        delete p;
+    }
+    return best;
+}
+
+template <typename P> static void bench(const Sizes& s, const std::vector<BenchUop>& uops, uint32_t reps) {
+    uint64_t sCycles, sMispreds, rCycles, rMispreds;
+    double sNs = time<P>(s, uops, reps, sCycles, sMispreds);
+    double rNs = time<RuntimeParams>(s, uops, reps, rCycles, rMispreds);
+    if (sCycles != rCycles || sMispreds != rMispreds) {
+        panic("%s: specialized and runtime-sized differ (%ld/%ld cycles, %ld/%ld mispredicts)", s.name, sCycles, rCycles, sMispreds, rMispreds);
+    }
+    printf("%8s %12.2f %12.2f %10.3f %10.4f\n", s.name, sNs, rNs, ((double)uops.size())/sCycles, ((double)sMispreds)/uops.size());
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(1ul << 30);
+    const uint32_t numUops = (argc > 1)? atoi(argv[1]) : 20*1000*1000;
+    const uint32_t reps = 5;
+    std::vector<BenchUop> uops = makeUops(numUops);
+
+    printf("%d uops, best of %d, ns/uop\n", numUops, reps);
+    printf("%8s %12s %12s %10s %10s\n", "sizes", "specialized", "runtime", "uops/cyc", "mispr/uop");
+    bench<SmallParams>(small, uops, reps);
+    bench<MediumParams>(medium, uops, reps);
+    bench<LargeParams>(large, uops, reps);
+    return 0;
+}
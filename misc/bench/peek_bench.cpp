@@ -0,0 +1,192 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Partitioner microbenchmark: Peekahead vs Lookahead (lookahead.cpp) on the same miss curves, per
+ * repartitioning. Curves are synthetic (convex, cliffs, linear, a mix of those) or recorded by running
+ * UMonMonitor on random streams. Before timing, both algorithms must give identical allocations on random
+ * cases, including forbidden partitions and zero minimum allocations.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "partitioner.h"
+
+//Replays fixed miss curves (buckets+1 points per partition)
+class CurveMonitor : public PartitionMonitor {
+    private:
+        uint32_t numPartitions;
+        std::vector<uint32_t> curves;
+
+    public:
+        CurveMonitor(uint32_t _numPartitions, uint32_t _buckets)
+            : PartitionMonitor(_buckets), numPartitions(_numPartitions), curves(_numPartitions*(_buckets+1)) {}
+
+        uint32_t getNumPartitions() const { return numPartitions; }
+        void access(uint32_t partition, Address lineAddr) { panic("CurveMonitor is read-only"); }
+        uint32_t get(uint32_t partition, uint32_t bucket) const { return curves[partition*(buckets+1) + bucket]; }
+        uint32_t getNumAccesses(uint32_t partition) const { return get(partition, 0); }
+        void reset() {}
+
+        uint32_t* curve(uint32_t partition) { return &curves[partition*(buckets+1)]; }
+};
+
+enum CurveKind {CONVEX, CLIFFS, LINEAR, MIXED, UMON, NUM_KINDS};
+static const char* kindNames[] = {"convex", "cliffs", "linear", "mixed", "umon"};
+
+static void fillCurve(uint32_t* c, uint32_t buckets, CurveKind kind, MTRand& rnd) {
+    uint32_t accs = 100000 + rnd.randInt(900000);
+    switch (kind) {
+        case CONVEX: {
+            double decay = 0.5 + 8*rnd.randExc();
+            double floor = 0.3*rnd.randExc();
+            for (uint32_t b = 0; b <= buckets; b++) c[b] = accs*(floor + (1-floor)*exp(-decay*b/buckets));
+            break;
+        }
+        case CLIFFS: {
+            //Flat stretches separated by a few drops, e.g. working sets that fit all at once
+            c[0] = accs;
+            uint32_t drops = 1 + rnd.randInt(3);
+            for (uint32_t b = 1; b <= buckets; b++) {
+                c[b] = c[b-1];
+                if (rnd.randInt(buckets - 1) < drops) c[b] = c[b-1]*rnd.randExc();
+            }
+            break;
+        }
+        case LINEAR: {
+            uint32_t slope = rnd.randInt(accs/buckets);
+            for (uint32_t b = 0; b <= buckets; b++) c[b] = accs - slope*b;
+            break;
+        }
+        default: panic("Curve kind %d is not synthetic", kind);
+    }
+}
+
+static CurveMonitor* makeCurves(uint32_t numPartitions, uint32_t buckets, CurveKind kind, MTRand& rnd) {
+    CurveMonitor* cm = new CurveMonitor(numPartitions, buckets);
+    if (kind == UMON) {
+        //Each partition streams over a random working set, with some of its accesses to a hot subset
+        uint32_t umonLines = 32*buckets;
+        UMonMonitor* um = new UMonMonitor(umonLines, umonLines, buckets, numPartitions, buckets);
+        for (uint32_t p = 0; p < numPartitions; p++) {
+            uint32_t ws = umonLines/8 + rnd.randInt(4*umonLines);
+            uint32_t hot = 1 + rnd.randInt(ws/2);
+            double hotFrac = rnd.randExc();
+            for (uint32_t i = 0; i < 8*umonLines; i++) {
+                uint32_t line = (rnd.randExc() < hotFrac)? rnd.randInt(hot - 1) : rnd.randInt(ws - 1);
+                um->access(p, ((uint64_t)p << 32) + line + 1);
+            }
+        }
+        for (uint32_t p = 0; p < numPartitions; p++) {
+            for (uint32_t b = 0; b <= buckets; b++) cm->curve(p)[b] = um->get(p, b);
+        }
+        delete um;
+    } else {
+        for (uint32_t p = 0; p < numPartitions; p++) {
+            fillCurve(cm->curve(p), buckets, (kind == MIXED)? (CurveKind)rnd.randInt(LINEAR) : kind, rnd);
+        }
+    }
+    return cm;
+}
+
+static void check(uint32_t numCases) {
+    MTRand rnd(42);
+    for (uint32_t i = 0; i < numCases; i++) {
+        uint32_t numPartitions = 1 + rnd.randInt(31);
+        uint32_t buckets = 8 << rnd.randInt(5);
+        if (buckets < numPartitions) buckets = numPartitions;
+        CurveKind kind = (CurveKind)rnd.randInt(NUM_KINDS - 1);
+        CurveMonitor* cm = makeCurves(numPartitions, buckets, kind, rnd);
+
+        //As LookaheadPartitioner calls them: minAlloc is per partition, the balance may be a portion of the buckets
+        uint32_t minAlloc = rnd.randInt(1)*numPartitions;
+        uint32_t balance = (rnd.randInt(1)? buckets : buckets/2);
+        if (balance < minAlloc) balance = minAlloc;
+        bool forbidden[numPartitions];
+        bool anyForbidden = rnd.randInt(1);
+        bool allowed = false;
+        for (uint32_t p = 0; p < numPartitions; p++) {
+            forbidden[p] = anyForbidden && rnd.randInt(3) == 0;
+            allowed |= !forbidden[p];
+        }
+        if (!allowed) forbidden[0] = false;
+
+        uint32_t la[numPartitions], pa[numPartitions];
+        uint32_t hullBuf[numPartitions*(2*buckets + 1)];
+        lookahead::computeBestPartitioning(numPartitions, balance, minAlloc, anyForbidden? forbidden : nullptr, la, *cm);
+        peekahead::computeBestPartitioning(numPartitions, balance, minAlloc, anyForbidden? forbidden : nullptr, pa, *cm, hullBuf);
+        if (memcmp(la, pa, sizeof(la)) != 0) {
+            panic("Case %d (%s, %d partitions, %d buckets, minAlloc %d, balance %d%s): allocations differ",
+                    i, kindNames[kind], numPartitions, buckets, minAlloc, balance, anyForbidden? ", forbidden" : "");
+        }
+        delete cm;
+    }
+    printf("%d random cases: identical allocations\n", numCases);
+}
+
+//us per repartitioning, best of reps, same arguments as LookaheadPartitioner (minAlloc 1, allocPortion 1)
+template <typename F> static double time(F f, uint32_t reps) {
+    double best = 1e30;
+    for (uint32_t r = 0; r < reps; r++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = MIN(best, 1e6*std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(1ul << 30);
+    check(2000);
+
+    const uint32_t reps = 20;
+    printf("us per repartitioning, best of %d\n", reps);
+    printf("%6s %8s %8s %10s %10s\n", "parts", "buckets", "curves", "lookahead", "peekahead");
+    uint32_t configs[][2] = {{64, 256}, {32, 128}, {8, 256}, {4, 16}};
+    for (auto& cfg : configs) {
+        uint32_t numPartitions = cfg[0], buckets = cfg[1];
+        for (uint32_t k = 0; k < NUM_KINDS; k++) {
+            MTRand rnd(k);
+            CurveMonitor* cm = makeCurves(numPartitions, buckets, (CurveKind)k, rnd);
+            uint32_t la[numPartitions], pa[numPartitions];
+            uint32_t* hullBuf = gm_calloc<uint32_t>(numPartitions*(2*buckets + 1));
+            double lt = time([&]() { lookahead::computeBestPartitioning(numPartitions, buckets, numPartitions, nullptr, la, *cm); }, reps);
+            double pt = time([&]() { peekahead::computeBestPartitioning(numPartitions, buckets, numPartitions, nullptr, pa, *cm, hullBuf); }, reps);
+            if (memcmp(la, pa, sizeof(la)) != 0) panic("%s curves: allocations differ", kindNames[k]);
+            printf("%6d %8d %8s %10.1f %10.1f\n", numPartitions, buckets, kindNames[k], lt, pt);
+            gm_free(hullBuf);
+            delete cm;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* PrioQueue far-element microbenchmark. Drives a queue with event-cycle streams shaped like a weave
+ * domain's (mostly near events, plus far memory responses and sleep wakeups), and reports the time per
+ * enqueue+dequeue pair and a checksum of the dequeue order. A first, untimed run also checks firstCycle(). Build it once per implementation (see
+ * Makefile): PQ_CALENDAR=1 (calendar) and PQ_CALENDAR=0 (g_multimap) must print the same checksums.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "prio_queue.h"
+
+#define BLOCKS 1024  // as PQ_BLOCKS in contention_sim.h
+
+struct Event {
+    uint64_t privCycle;
+    Event* next;
+};
+
+struct Stream {
+    const char* name;
+    double farFraction;   // events beyond BLOCKS*64 cycles
+    uint64_t maxNear;     // near delays are uniform in [0, maxNear)
+    uint64_t maxFar;      // far delays are uniform in [BLOCKS*64, maxFar)
+};
+
+static const Stream streams[] = {
+    {"near-only",   0.00, 1000, 0},
+    {"far-5%",      0.05, 1000, 2000000},  // occasional sleep wakeups
+    {"far-30%",     0.30, 1000, 3000000},  // many long-latency responses and timeouts
+    {"far-30%-10M", 0.30, 1000, 10000000}, // same, most beyond the calendar (2M cycles)
+    {"far-5%-100M", 0.05, 1000, 100000000}, // long sleeps, most beyond both calendars (67M cycles)
+    {"far-30%-1G",  0.30, 1000, 1000000000},
+};
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(1ul << 30);
+    const uint32_t numEvents = (argc > 1)? atoi(argv[1]) : 4000000;
+    const uint32_t reps = 5;
+
+    printf("%s, %d events/stream, best of %d\n", PQ_CALENDAR? "calendar" : "multimap", numEvents, reps);
+    std::vector<Event> events(numEvents);
+    std::vector<uint64_t> delays(numEvents);
+    for (const Stream& s : streams) {
+        MTRand rnd(42);
+        for (uint32_t i = 0; i < numEvents; i++) {
+            bool far = rnd.randExc() < s.farFraction;
+            delays[i] = far? BLOCKS*64 + rnd.randInt(s.maxFar - BLOCKS*64 - 1) : rnd.randInt(s.maxNear - 1);
+        }
+
+        double best = 1e30;
+        uint64_t checksum = 0;
+        for (uint32_t r = 0; r <= reps; r++) {
+            bool verify = (r == 0);
+            PrioQueue<Event, BLOCKS>* pq = new PrioQueue<Event, BLOCKS>();
+            uint64_t curCycle = 0;
+            uint64_t sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            //Keep about half of the events queued, as a domain does while its cores run ahead
+            for (uint32_t i = 0; i < numEvents; i++) {
+                Event* ev = &events[i];
+                ev->privCycle = curCycle + delays[i];
+                ev->next = nullptr;
+                pq->enqueue(ev, ev->privCycle);
+                if (i & 1) {
+                    uint64_t first = verify? pq->firstCycle() : 0;
+                    Event* deq = pq->dequeue(curCycle);
+                    if (verify && first != curCycle) panic("firstCycle() %ld, dequeued %ld", first, curCycle);
+                    sum = sum*31 + (deq - &events[0]);
+                }
+            }
+            while (pq->size()) {
+                Event* deq = pq->dequeue(curCycle);
+                sum = sum*31 + (deq - &events[0]);
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!verify) best = MIN(best, secs);
+            checksum = sum;
+            delete pq;
+        }
+        printf("%-12s %6.1f ns/event  order checksum %016lx\n", s.name, 1e9*best/numEvents, checksum);
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SetAssocArray lookup microbenchmark: scalar tag match vs the host's best SIMD kernel (see tag_match.h),
+ * with and without line-aligned sets, on full arrays and address streams with a given hit ratio. Hits
+ * are spread uniformly over sets and ways. Both kernels must return the same line ids (checked).
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "cache_arrays.h"
+#include "galloc.h"
+#include "hash.h"
+#include "log.h"
+#include "mtrand.h"
+#include "repl_policies.h"
+
+//Exposes the tag array so the benchmark can fill it without a replacement policy or CC
+class BenchArray final : public SetAssocArray {
+    public:
+        BenchArray(uint32_t numLines, uint32_t assoc, HashFamily* hf, bool alignSets, bool simdLookup)
+            : SetAssocArray(numLines, assoc, nullptr, hf, alignSets, simdLookup) {}
+
+        //With IdHashFamily, line k*numSets + set maps to set
+        void fill() {
+            for (uint32_t set = 0; set < numSets; set++) {
+                for (uint32_t w = 0; w < assoc; w++) array[set*setStride + w] = (Address)(w + 1)*numSets + set;
+            }
+        }
+
+        Address lineAt(uint32_t set, uint32_t way) const {return (Address)(way + 1)*numSets + set;}
+        Address missAt(uint32_t set) const {return (Address)(assoc + 1)*numSets + set;}
+        TagMatchImpl impl() const {return matchImpl;}
+};
+
+static const char* implName(TagMatchImpl impl) {
+    switch (impl) {
+        case TM_AVX512: return "avx512";
+        case TM_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+//Returns the best time per lookup in ns over reps runs, and a checksum of the returned ids
+static double run(BenchArray* a, const std::vector<Address>& stream, uint32_t reps, uint64_t& checksum) {
+    double best = 1e30;
+    for (uint32_t r = 0; r < reps; r++) {
+        uint64_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (Address lineAddr : stream) sum += (uint64_t)(int64_t)a->lookup(lineAddr, nullptr, false) + 1;
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = MIN(best, secs);
+        checksum = sum;
+    }
+    return 1e9*best/stream.size();
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(1ul << 30);
+    const uint32_t numSets = 4096;  //a 4MB bank at 16 ways
+    const uint32_t numLookups = (argc > 1)? atoi(argv[1]) : 8*1024*1024;
+    const uint32_t reps = 5;
+    HashFamily* hf = new IdHashFamily();
+
+    printf("%d sets, %d lookups, best of %d, ns/lookup (A: line-aligned sets)\n", numSets, numLookups, reps);
+    printf("%5s %5s %8s %8s %8s %8s  kernel\n", "ways", "hits", "scalar", "simd", "scalarA", "simdA");
+    for (uint32_t ways : {4, 8, 16, 20, 32}) {
+        BenchArray* arrays[4];  //scalar, simd, scalar aligned, simd aligned
+        for (uint32_t i = 0; i < 4; i++) {
+            arrays[i] = new BenchArray(numSets*ways, ways, hf, i >= 2, i & 1);
+            arrays[i]->fill();
+        }
+        for (double hitRatio : {0.0, 0.5, 0.9}) {
+            MTRand rnd(ways);
+            std::vector<Address> stream(numLookups);
+            for (uint32_t i = 0; i < numLookups; i++) {
+                uint32_t set = rnd.randInt(numSets - 1);
+                stream[i] = (rnd.randExc() < hitRatio)? arrays[0]->lineAt(set, rnd.randInt(ways - 1)) : arrays[0]->missAt(set);
+            }
+            double ns[4];
+            uint64_t sums[4];
+            for (uint32_t i = 0; i < 4; i++) ns[i] = run(arrays[i], stream, reps, sums[i]);
+            for (uint32_t i = 1; i < 4; i++) {
+                if (sums[i] != sums[0]) panic("Lookup results differ (%d ways, array %d)", ways, i);
+            }
+            printf("%5d %4.0f%% %8.2f %8.2f %8.2f %8.2f  %s\n", ways, 100*hitRatio, ns[0], ns[1], ns[2], ns[3], implName(arrays[1]->impl()));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* UMon microbenchmark: the current UMon (flat per-set tag arrays + tag-match kernels), with 1 and 4
+ * levels, vs the previous linked-list-per-set implementation, reproduced below as ListUMon. Every access
+ * is sampled (the monitor is as large as the bank), so this measures the stack update itself. Level-0
+ * miss curves must match ListUMon's.
+ */
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "galloc.h"
+#include "hash.h"
+#include "log.h"
+#include "mtrand.h"
+#include "utility_monitor.h"
+
+//Previous UMon stack (utility_monitor.cpp before the flat-array change); same hashes, so same sample and sets
+class ListUMon : public GlobAlloc {
+    private:
+        struct Node {
+            Address addr;
+            struct Node* next;
+        };
+
+        uint32_t buckets;
+        uint32_t sets;
+        uint64_t samplingFactorBits;
+        uint64_t setsBits;
+        uint64_t* curWayHits;
+        uint64_t curMisses;
+        Node** array;
+        Node** heads;
+        HashFamily* hf;
+
+    public:
+        ListUMon(uint32_t bankLines, uint32_t umonLines, uint32_t _buckets) : buckets(_buckets), sets(umonLines/_buckets) {
+            heads = gm_calloc<Node*>(sets);
+            array = gm_calloc<Node*>(sets);
+            for (uint32_t i = 0; i < sets; i++) {
+                array[i] = gm_calloc<Node>(buckets);
+                heads[i] = &array[i][0];
+                for (uint32_t j = 0; j < buckets-1; j++) array[i][j].next = &array[i][j+1];
+            }
+            curWayHits = gm_calloc<uint64_t>(buckets);
+            curMisses = 0;
+            hf = new H3HashFamily(2, 32, 0xF000BAAD);
+            samplingFactorBits = ilog2(bankLines/umonLines);
+            setsBits = ilog2(sets);
+        }
+
+        void access(Address lineAddr) {
+            uint64_t sampleMask = ~(((uint64_t)-1LL) << samplingFactorBits);
+            if ((hf->hash(0, lineAddr) & sampleMask) != 0) return;
+
+            uint64_t setMask = ~(((uint64_t)-1LL) << setsBits);
+            uint64_t set = (hf->hash(1, lineAddr)) & setMask;
+
+            Node* prev = nullptr;
+            Node* cur = heads[set];
+            bool hit = false;
+            for (uint32_t b = 0; b < buckets; b++) {
+                if (cur->addr == lineAddr) {
+                    curWayHits[b]++;
+                    hit = true;
+                    break;
+                } else if (b < buckets-1) {
+                    prev = cur;
+                    cur = cur->next;
+                }
+            }
+            if (!hit) {
+                curMisses++;
+                cur->addr = lineAddr;
+            }
+            if (prev) {
+                prev->next = cur->next;
+                cur->next = heads[set];
+                heads[set] = cur;
+            }
+        }
+
+        void getMisses(uint64_t* misses) {
+            uint64_t total = curMisses;
+            for (uint32_t i = 0; i < buckets; i++) {
+                misses[buckets - i] = total;
+                total += curWayHits[buckets - i - 1];
+            }
+            misses[0] = total;
+        }
+};
+
+template <typename M> static double run(M* m, const std::vector<Address>& stream) {
+    auto start = std::chrono::steady_clock::now();
+    for (Address lineAddr : stream) m->access(lineAddr);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 1e9*secs/stream.size();
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");
+    gm_init(1ul << 30);
+    const uint32_t numAccesses = (argc > 1)? atoi(argv[1]) : 30*1000*1000;
+    const uint32_t reps = 5;
+    const uint32_t sets = 256;
+
+    printf("%d sets, %d accesses, all sampled, best of %d, ns/access\n", sets, numAccesses, reps);
+    printf("%8s %8s %8s %8s\n", "buckets", "list", "flat", "flat-4L");
+    for (uint32_t buckets : {16, 64, 256}) {
+        uint32_t umonLines = sets*buckets;
+        //70% of accesses go to a hot set of half the monitor's lines, the rest anywhere in 16x them
+        MTRand rnd(buckets);
+        std::vector<Address> stream(numAccesses);
+        for (uint32_t i = 0; i < numAccesses; i++) {
+            bool hot = rnd.randExc() < 0.7;
+            stream[i] = 1 + (hot? rnd.randInt(umonLines/2 - 1) : rnd.randInt(16*umonLines - 1));
+        }
+
+        double ns[3] = {1e30, 1e30, 1e30};
+        std::vector<uint64_t> listCurve(buckets + 1), flatCurve(buckets + 1);
+        for (uint32_t r = 0; r < reps; r++) {
+            ListUMon* l = new ListUMon(umonLines, umonLines, buckets);
+            UMon* f = new UMon(umonLines, umonLines, buckets);
+            UMon* f4 = new UMon(umonLines, umonLines, buckets, 4);
+            ns[0] = MIN(ns[0], run(l, stream));
+            ns[1] = MIN(ns[1], run(f, stream));
+            ns[2] = MIN(ns[2], run(f4, stream));
+            l->getMisses(&listCurve[0]);
+            f->getMisses(&flatCurve[0]);
+            if (listCurve != flatCurve) panic("Miss curves differ (%d buckets)", buckets);
+            f4->getMisses(&flatCurve[0]);
+            if (listCurve != flatCurve) panic("Level-0 miss curves differ with 4 levels (%d buckets)", buckets);
+        }
+        printf("%8d %8.1f %8.1f %8.1f\n", buckets, ns[0], ns[1], ns[2]);
+    }
+    return 0;
+}
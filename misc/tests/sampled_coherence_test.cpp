@@ -0,0 +1,271 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Coherence of untracked lines in a set-sampled cache (see SampledCache): two children share lines in
+ * non-sampled sets, and at no point may one of them hold a line in E or M while the other holds it.
+ * Children are minimal BaseCaches that keep their lines' MESI states, like TraceDriver's proxies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include "cache_arrays.h"
+#include "coherence_ctrls.h"
+#include "galloc.h"
+#include "hash.h"
+#include "log.h"
+#include "repl_policies.h"
+#include "sampled_cache.h"
+#include "zsim.h"
+
+GlobSimInfo* zinfo;
+uint32_t lineBits = 6;
+Address procMask = 0;
+
+static uint32_t failures = 0;
+
+#define check(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+//Fixed-latency memory, grants the requested permissions
+class TestMemory : public MemObject {
+    private:
+        g_string name;
+
+    public:
+        explicit TestMemory(const g_string& _name) : name(_name) {}
+
+        uint64_t access(MemReq& req) {
+            switch (req.type) {
+                case PUTS:
+                case PUTX:
+                    *req.state = I;
+                    return req.cycle;
+                case GETS:
+                    *req.state = req.is(MemReq::NOEXCL)? S : E;
+                    break;
+                case GETX:
+                    *req.state = M;
+                    break;
+                default: panic("!?");
+            }
+            return req.cycle + 100;
+        }
+
+        const char* getName() {return name.c_str();}
+};
+
+//Child that holds any number of lines and issues GETs/PUTs directly, so the test sees the exact states its parent grants
+class TestChild : public BaseCache {
+    private:
+        std::unordered_map<Address, MESIState> lines;
+        MemObject* parent;
+        uint32_t childId;
+        lock_t lock;
+        g_string name;
+
+    public:
+        uint64_t invs, invxs, writebacks;
+
+        explicit TestChild(const g_string& _name) : parent(nullptr), childId(0), name(_name), invs(0), invxs(0), writebacks(0) {
+            futex_init(&lock);
+        }
+
+        void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network) {
+            assert(parents.size() == 1);
+            parent = parents[0];
+            childId = _childId;
+        }
+
+        void setChildren(const g_vector<BaseCache*>& children, Network* network) {panic("TestChild has no children");}
+
+        MESIState state(Address lineAddr) {
+            std::unordered_map<Address, MESIState>::iterator it = lines.find(lineAddr);
+            return (it == lines.end())? I : it->second;
+        }
+
+        uint64_t access(MemReq& req) {panic("TestChild has no children");}
+
+        //Load or store, as the core would issue it to a private cache
+        void access(Address lineAddr, bool isStore, uint64_t cycle) {
+            MESIState& st = lines[lineAddr];
+            AccessType type;
+            if (isStore) {
+                if (st == M) return;
+                if (st == E) {st = M; return;}  //silent transition
+                type = GETX;
+            } else {
+                if (st != I) return;
+                type = GETS;
+            }
+            futex_lock(&lock);
+            MemReq req = {lineAddr, type, childId, &st, cycle, &lock, st, childId, 0};
+            parent->access(req);
+            futex_unlock(&lock);
+            if (isStore) assert(st == M);
+        }
+
+        void evict(Address lineAddr, uint64_t cycle) {
+            std::unordered_map<Address, MESIState>::iterator it = lines.find(lineAddr);
+            if (it == lines.end() || it->second == I) return;
+            futex_lock(&lock);
+            MESIState st = it->second;
+            MemReq req = {lineAddr, (st == M)? PUTX : PUTS, childId, &st, cycle, &lock, st, childId, 0};
+            parent->access(req);
+            futex_unlock(&lock);
+            lines.erase(it);
+        }
+
+        uint64_t invalidate(const InvReq& req) {
+            std::unordered_map<Address, MESIState>::iterator it = lines.find(req.lineAddr);
+            if (it == lines.end() || it->second == I) {
+                assert(req.inexact);
+                return req.cycle;
+            }
+            if (it->second == M) {
+                *req.writeback = true;
+                writebacks++;
+            }
+            if (req.type == INV) {
+                lines.erase(it);
+                invs++;
+            } else {
+                assert(req.type == INVX);
+                if (it->second != S) invxs++;
+                it->second = S;
+            }
+            return req.cycle;
+        }
+
+        const char* getName() {return name.c_str();}
+};
+
+static void checkCoherent(TestChild** children, uint32_t numChildren, Address lineAddr, const char* step) {
+    uint32_t holders = 0, exclusive = 0;
+    for (uint32_t c = 0; c < numChildren; c++) {
+        MESIState st = children[c]->state(lineAddr);
+        if (st != I) holders++;
+        if (st == E || st == M) exclusive++;
+    }
+    check(exclusive == 0 || holders == 1, "%s: line 0x%lx has %d holders, %d of them exclusive", step, lineAddr, holders, exclusive);
+}
+
+int main() {
+    InitLog("[test] ");
+    gm_init(32 << 20);
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->lineSize = 64;
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(2);
+
+    //4096-line, 8-way bank that simulates 8 of its 512 sets
+    const uint32_t ways = 8, fullSets = 512, sampledSets = 8;
+    const uint32_t numLines = sampledSets*ways;
+    SampledSetsHashFamily* sampler = new SampledSetsHashFamily(new H3HashFamily(1, 9, 0xF00D), 9, 3);
+    ReplPolicy* rp = new LRUReplPolicy<true>(numLines);
+    CacheArray* array = new SetAssocArray(numLines, ways, rp, sampler);
+    g_string llcName("llc");
+    MESICC* cc = new MESICC(numLines, false /*nonInclusiveHack*/, SharerDirConfig(), llcName);
+    rp->setCC(cc);
+    SampledCache* llc = new SampledCache(numLines, cc, array, rp, 10, 10, sampler, sampledSets, fullSets, llcName);
+
+    TestMemory* mem = new TestMemory("mem");
+    g_vector<MemObject*> memParents;
+    memParents.push_back(mem);
+    llc->setParents(0, memParents, nullptr);
+
+    const uint32_t numChildren = 2;
+    TestChild* children[numChildren];
+    g_vector<BaseCache*> llcChildren;
+    g_vector<MemObject*> childParents;
+    childParents.push_back(llc);
+    for (uint32_t c = 0; c < numChildren; c++) {
+        children[c] = new TestChild(c? "child1" : "child0");
+        children[c]->setParents(c, childParents, nullptr);
+        llcChildren.push_back(children[c]);
+    }
+    llc->setChildren(llcChildren, nullptr);
+
+    AggregateStat* rootStat = new AggregateStat();
+    rootStat->init("root", "Stats");
+    llc->initStats(rootStat);
+
+    //Pick untracked lines
+    Address shared[16];
+    uint32_t numShared = 0;
+    for (Address lineAddr = 1; numShared < 16; lineAddr++) {
+        if (sampler->sampledSet(lineAddr) == -1) shared[numShared++] = lineAddr;
+    }
+
+    //Directed sharing pattern on one line
+    uint64_t cycle = 1000;
+    Address a = shared[0];
+    children[0]->access(a, true, cycle += 100);
+    check(children[0]->state(a) == M, "store by child0 did not get M");
+    checkCoherent(children, numChildren, a, "child0 store");
+
+    children[1]->access(a, false, cycle += 100);
+    check(children[0]->state(a) == S && children[1]->state(a) == S, "load by child1 did not downgrade child0 (%s/%s)",
+            MESIStateName(children[0]->state(a)), MESIStateName(children[1]->state(a)));
+    check(children[0]->writebacks == 1, "downgrade of child0's M copy did not write back");
+    checkCoherent(children, numChildren, a, "child1 load");
+
+    children[1]->access(a, true, cycle += 100);
+    check(children[0]->state(a) == I && children[1]->state(a) == M, "upgrade by child1 did not invalidate child0 (%s/%s)",
+            MESIStateName(children[0]->state(a)), MESIStateName(children[1]->state(a)));
+    checkCoherent(children, numChildren, a, "child1 upgrade");
+
+    children[0]->access(a, true, cycle += 100);
+    check(children[0]->state(a) == M && children[1]->state(a) == I, "store by child0 did not invalidate child1's M copy (%s/%s)",
+            MESIStateName(children[0]->state(a)), MESIStateName(children[1]->state(a)));
+    checkCoherent(children, numChildren, a, "child0 store after child1 store");
+
+    //Random loads, stores and evictions on a few untracked lines
+    srand(42);
+    for (uint32_t i = 0; i < 100000; i++) {
+        uint32_t c = rand() % numChildren;
+        Address lineAddr = shared[rand() % numShared];
+        uint32_t r = rand() % 8;
+        if (r == 0) children[c]->evict(lineAddr, cycle += 10);
+        else children[c]->access(lineAddr, r < 3, cycle += 10);
+        checkCoherent(children, numChildren, lineAddr, "random");
+        if (failures > 10) break;
+    }
+
+    printf("invalidations: child0 %ld INV %ld INVX, child1 %ld INV %ld INVX\n",
+            children[0]->invs, children[0]->invxs, children[1]->invs, children[1]->invxs);
+    if (failures) {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
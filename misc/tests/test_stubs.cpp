@@ -0,0 +1,43 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Components that the tested objects reference but tests never exercise. Their real implementations
+ * pull in Pin (checkpoint.cpp) or the whole weave phase (contention_sim.cpp).
+ */
+
+#include "checkpoint.h"
+#include "contention_sim.h"
+#include "log.h"
+
+void Checkpoint::raw(void* data, size_t len) {panic("Checkpoints are not supported in tests");}
+void Checkpoint::section(const char* name) {panic("Checkpoints are not supported in tests");}
+void Checkpoint::section(const char* prefix, const char* name) {panic("Checkpoints are not supported in tests");}
+void Checkpoint::check(const char* what, uint64_t v) {panic("Checkpoints are not supported in tests");}
+
+void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {panic("Weave phase is not supported in tests");}
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {panic("Weave phase is not supported in tests");}
+void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    panic("Weave phase is not supported in tests");
+}
@@ -24,7 +24,14 @@
  */
 
 #include "access_tracing.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "bithacks.h"
+#include "lz_codec.h"
+#include "mutex.h"
 
 // Concatenate HDF5 header path prefix with the header file names, because
 // Ubuntu 15.04 and later change the HDF5 header path.
@@ -42,63 +49,289 @@
 
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
 
-AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
-    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+// The HDF5 library is not thread-safe, and readers and writers may be used from multiple threads (e.g., parallel trace replay)
+static mutex hdf5Mutex;
+
+/* Native format: a header, blocks, and the block index. Each block has a NativeTraceBlockHeader and its
+ * payload. Each record is encoded as varints of childId<<2|type, the zigzagged deltas of lineAddr and
+ * reqCycle w.r.t. the same child's previous record in the block (children's streams are interleaved,
+ * but each is fairly regular; deltas restart on each block so blocks decode independently), and the
+ * latency. The payload is LZ-compressed unless that does not make it smaller.
+ */
+#define NATIVE_MAGIC 0x314352544d49535aul  // "ZSIMTRC1"
+#define NATIVE_VERSION 1
+#define NATIVE_BLOCK_RECORDS (1024*64u)
+#define NATIVE_MAX_REC_BYTES 28  // 10 + 10 + 5 + 3 bytes of varints
+#define NATIVE_BLOCK_LZ 1
 
-    // Check that the trace finished
-    hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+struct NativeTraceHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t numChildren;
     uint32_t finished;
-    H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
-    H5Aclose(fAttr);
+    uint32_t blockRecords;
+    uint64_t numRecords;
+    uint64_t numBlocks;
+    uint64_t indexOffset;
+};
 
-    if (!finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+struct NativeTraceBlockHeader {
+    uint32_t payloadBytes;
+    uint32_t rawBytes; //after decompression
+    uint32_t records;
+    uint32_t flags;
+};
 
-    // Populate numRecords & numChildren
-    hsize_t nPackets;
-    hid_t table = H5PTopen(fid, "accs");
-    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-    H5PTget_num_packets(table, &nPackets);
-    numRecords = nPackets;
+static const uint8_t hdf5Signature[8] = {0x89, 'H', 'D', 'F', '\r', '\n', 0x1a, '\n'};
 
-    hid_t ncAttr = H5Aopen(fid, "numChildren", H5P_DEFAULT);
-    H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
-    H5Aclose(ncAttr);
+TraceFormat TraceFormatForFile(const char* fname) {
+    size_t len = strlen(fname);
+    auto endsWith = [&](const char* suffix) {
+        size_t sl = strlen(suffix);
+        return len >= sl && strcmp(fname + len - sl, suffix) == 0;
+    };
+    return endsWith(".ztrace")? TF_NATIVE : TF_HDF5;
+}
+
+const char* TraceFormatName(TraceFormat format) {
+    return (format == TF_HDF5)? "HDF5" : "native";
+}
+
+static inline uint8_t* encodeVarint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline uint64_t zigzag(int64_t v) {return (v << 1) ^ (v >> 63);}
+static inline int64_t unzigzag(uint64_t v) {return (v >> 1) ^ -(int64_t)(v & 1);}
+
+static inline uint64_t decodeVarint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (unlikely(p == end)) panic("Corrupt trace block (truncated varint)");
+        uint8_t b = *p++;
+        v |= ((uint64_t)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    panic("Corrupt trace block (varint too long)");
+}
+
+
+/* Reader */
+
+AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()), map(nullptr), mapSize(0),
+    index(nullptr), numBlocks(0), curBlock(0), blockRecords(0), scratch(nullptr), lastAddrs(nullptr), lastCycles(nullptr)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) panic("Could not open trace file %s", fname.c_str());
+    uint64_t magic = 0;
+    ssize_t magicBytes = pread(fd, &magic, sizeof(magic), 0);
+    format = (magicBytes == sizeof(magic) && magic == NATIVE_MAGIC)? TF_NATIVE : TF_HDF5;
 
     curFrameRecord = 0;
     cur = 0;
-    max = MIN(PT_CHUNKSIZE, numRecords);
-    buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
+    max = 0;
+
+    if (format == TF_HDF5) {
+        close(fd);
+        if (magicBytes == sizeof(magic) && memcmp(&magic, hdf5Signature, sizeof(magic)) != 0) {
+            panic("%s is neither a native nor an HDF5 trace", fname.c_str());
+        }
+        {
+            scoped_mutex sm(hdf5Mutex);
+            hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+
+            // Check that the trace finished
+            hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+            uint32_t finished;
+            H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
+            H5Aclose(fAttr);
 
-    if (max) {
-        H5PTread_packets(table, 0, max, buf);
+            if (!finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+
+            // Populate numRecords & numChildren
+            hsize_t nPackets;
+            hid_t table = H5PTopen(fid, "accs");
+            if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+            H5PTget_num_packets(table, &nPackets);
+            numRecords = nPackets;
+            H5PTclose(table);
+
+            hid_t ncAttr = H5Aopen(fid, "numChildren", H5P_DEFAULT);
+            H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
+            H5Aclose(ncAttr);
+            H5Fclose(fid);
+        }
+
+        uint32_t bufRecords = MIN(PT_CHUNKSIZE, numRecords);
+        buf = bufRecords? gm_calloc<PackedAccessRecord>(bufRecords) : nullptr;
+        if (numRecords) readHDF5Chunk(0);
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0) panic("Could not stat trace file %s", fname.c_str());
+        mapSize = st.st_size;
+        void* m = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) panic("Could not mmap trace file %s", fname.c_str());
+        map = (const uint8_t*) m;
+        madvise(m, mapSize, MADV_SEQUENTIAL);
+
+        NativeTraceHeader hdr;
+        if (mapSize < sizeof(hdr)) panic("Trace file %s is truncated", fname.c_str());
+        memcpy(&hdr, map, sizeof(hdr));
+        if (hdr.version != NATIVE_VERSION) panic("Trace file %s has version %d, expected %d", fname.c_str(), hdr.version, NATIVE_VERSION);
+        if (!hdr.finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+        if (hdr.indexOffset + hdr.numBlocks*sizeof(NativeTraceIndexEntry) > mapSize || hdr.indexOffset % sizeof(uint64_t)) {
+            panic("Trace file %s has a corrupt block index", fname.c_str());
+        }
+
+        numChildren = hdr.numChildren;
+        numRecords = hdr.numRecords;
+        numBlocks = hdr.numBlocks;
+        index = (const NativeTraceIndexEntry*) (map + hdr.indexOffset);
+
+        blockRecords = hdr.blockRecords;
+        buf = gm_calloc<PackedAccessRecord>(blockRecords);
+        scratch = gm_calloc<uint8_t>(blockRecords*NATIVE_MAX_REC_BYTES);
+        lastAddrs = gm_calloc<uint64_t>(numChildren);
+        lastCycles = gm_calloc<uint64_t>(numChildren);
+        if (numBlocks) readNativeBlock(0);
     }
+}
 
-    H5PTclose(table);
-    H5Fclose(fid);
+AccessTraceReader::~AccessTraceReader() {
+    if (map) munmap(const_cast<uint8_t*>(map), mapSize);
+    if (buf) gm_free(buf);
+    if (scratch) gm_free(scratch);
+    if (lastAddrs) gm_free(lastAddrs);
+    if (lastCycles) gm_free(lastCycles);
+}
+
+void AccessTraceReader::seek(uint64_t record) {
+    assert_msg(record <= numRecords, "Seeking to record %ld, trace has %ld", record, numRecords);
+    if (record == numRecords) {
+        curFrameRecord = numRecords;
+        cur = max = 0;
+    } else if (format == TF_HDF5) {
+        readHDF5Chunk(record);
+    } else {
+        // Last block with firstRecord <= record
+        uint64_t lo = 0;
+        uint64_t hi = numBlocks;
+        while (hi - lo > 1) {
+            uint64_t mid = (lo + hi)/2;
+            if (index[mid].firstRecord <= record) lo = mid;
+            else hi = mid;
+        }
+        readNativeBlock(lo);
+        cur = record - curFrameRecord;
+        assert(cur < max);
+    }
 }
 
 void AccessTraceReader::nextChunk() {
     assert(cur == max);
-    curFrameRecord += max;
-
-    if (curFrameRecord < numRecords) {
-        cur = 0;
-        max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
-        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
-        hid_t table = H5PTopen(fid, "accs");
-        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-        H5PTread_packets(table, curFrameRecord, max, buf);
-        H5PTclose(table);
-        H5Fclose(fid);
+    if (format == TF_HDF5) {
+        if (curFrameRecord + max < numRecords) {
+            readHDF5Chunk(curFrameRecord + max);
+        } else {
+            assert_msg(curFrameRecord + max == numRecords, "%ld %ld", curFrameRecord + max, numRecords);  // aaand we're done
+        }
     } else {
-        assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);  // aaand we're done
+        if (curBlock + 1 < numBlocks) readNativeBlock(curBlock + 1);
+    }
+}
+
+void AccessTraceReader::readHDF5Chunk(uint64_t firstRecord) {
+    curFrameRecord = firstRecord;
+    cur = 0;
+    max = MIN(PT_CHUNKSIZE, numRecords - firstRecord);
+    scoped_mutex sm(hdf5Mutex);
+    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+    hid_t table = H5PTopen(fid, "accs");
+    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+    H5PTread_packets(table, firstRecord, max, buf);
+    H5PTclose(table);
+    H5Fclose(fid);
+}
+
+void AccessTraceReader::readNativeBlock(uint64_t block) {
+    const NativeTraceIndexEntry& entry = index[block];
+    NativeTraceBlockHeader hdr;
+    if (entry.offset + sizeof(hdr) > mapSize) panic("Trace file %s: block %ld out of bounds", fname.c_str(), block);
+    memcpy(&hdr, map + entry.offset, sizeof(hdr));
+    const uint8_t* payload = map + entry.offset + sizeof(hdr);
+    if (entry.offset + sizeof(hdr) + hdr.payloadBytes > mapSize || hdr.records > blockRecords || hdr.rawBytes > hdr.records*NATIVE_MAX_REC_BYTES) {
+        panic("Trace file %s: block %ld is corrupt", fname.c_str(), block);
+    }
+
+    // Start bringing in the next block while we decode this one
+    if (block + 1 < numBlocks) {
+        uint64_t start = index[block + 1].offset & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+        uint64_t end = (block + 2 < numBlocks)? index[block + 2].offset : mapSize;
+        if (start < end && end <= mapSize) madvise(const_cast<uint8_t*>(map) + start, end - start, MADV_WILLNEED);
+    }
+
+    // Uncompressed blocks are decoded straight from the mapping
+    const uint8_t* raw = payload;
+    if (hdr.flags & NATIVE_BLOCK_LZ) {
+        if (!LZDecompress(payload, hdr.payloadBytes, scratch, hdr.rawBytes)) panic("Trace file %s: block %ld does not decompress", fname.c_str(), block);
+        raw = scratch;
+    } else if (hdr.payloadBytes != hdr.rawBytes) {
+        panic("Trace file %s: block %ld is corrupt", fname.c_str(), block);
+    }
+
+    const uint8_t* p = raw;
+    const uint8_t* end = raw + hdr.rawBytes;
+    for (uint32_t c = 0; c < numChildren; c++) lastAddrs[c] = lastCycles[c] = 0;
+    for (uint32_t i = 0; i < hdr.records; i++) {
+        uint32_t childAndType = decodeVarint(p, end);
+        uint32_t child = childAndType >> 2;
+        if (unlikely(child >= numChildren)) panic("Trace file %s: block %ld has invalid child %d", fname.c_str(), block, child);
+        uint64_t lineAddr = lastAddrs[child] += unzigzag(decodeVarint(p, end));
+        uint64_t reqCycle = lastCycles[child] += unzigzag(decodeVarint(p, end));
+        uint32_t latency = decodeVarint(p, end);
+        buf[i] = {lineAddr, reqCycle, latency, (uint16_t)child, (uint16_t)(childAndType & 3)};
     }
+    if (p != end) panic("Trace file %s: block %ld has trailing bytes", fname.c_str(), block);
+
+    curBlock = block;
+    curFrameRecord = entry.firstRecord;
+    cur = 0;
+    max = hdr.records;
+}
+
+
+/* Writer */
+
+AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t _numChildren) : fname(_fname), format(TraceFormatForFile(_fname.c_str())),
+    numRecords(0), numChildren(_numChildren), encBuf(nullptr), compBuf(nullptr), lastAddrs(nullptr), lastCycles(nullptr)
+{
+    if (format == TF_HDF5) initHDF5();
+    else initNative();
+    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
 }
 
+void AccessTraceWriter::dump(bool cont) {
+    if (format == TF_HDF5) dumpHDF5(cont);
+    else dumpNative(cont);
 
-AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
+    if (!cont) {
+        gm_free(buf);
+        buf = nullptr;
+        max = 0;
+    }
+    cur = 0;
+}
+
+void AccessTraceWriter::initHDF5() {
+    scoped_mutex sm(hdf5Mutex);
     // Create record structure
     hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
     uint16_t val;
@@ -160,10 +393,10 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
     cur = 0;
     max = PT_CHUNKSIZE;
-    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
 }
 
-void AccessTraceWriter::dump(bool cont) {
+void AccessTraceWriter::dumpHDF5(bool cont) {
+    scoped_mutex sm(hdf5Mutex);
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
     hid_t table = H5PTopen(fid, "accs");
@@ -176,13 +409,83 @@ void AccessTraceWriter::dump(bool cont) {
         uint32_t finished = 1;
         H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
         H5Aclose(fAttr);
-
-        gm_free(buf);
-        buf = nullptr;
-        max = 0;
     }
 
-    cur = 0;
     H5PTclose(table);
     H5Fclose(fid);
 }
+
+void AccessTraceWriter::initNative() {
+    if (numChildren > (1 << 16)) panic("Trace file %s: too many children (%d)", fname.c_str(), numChildren);
+    NativeTraceHeader hdr = {NATIVE_MAGIC, NATIVE_VERSION, numChildren, 0 /*unfinished*/, NATIVE_BLOCK_RECORDS, 0, 0, 0};
+    FILE* f = fopen(fname.c_str(), "w");
+    if (!f) panic("Could not create trace file %s", fname.c_str());
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+    fclose(f);
+
+    buf = gm_calloc<PackedAccessRecord>(NATIVE_BLOCK_RECORDS);
+    encBuf = gm_calloc<uint8_t>(NATIVE_BLOCK_RECORDS*NATIVE_MAX_REC_BYTES);
+    compBuf = gm_calloc<uint8_t>(LZCompressBound(NATIVE_BLOCK_RECORDS*NATIVE_MAX_REC_BYTES));
+    lastAddrs = gm_calloc<uint64_t>(numChildren);
+    lastCycles = gm_calloc<uint64_t>(numChildren);
+    cur = 0;
+    max = NATIVE_BLOCK_RECORDS;
+}
+
+// Like the HDF5 path, reopens the file on every dump, since the writer may be flushed from any process
+void AccessTraceWriter::dumpNative(bool cont) {
+    FILE* f = fopen(fname.c_str(), "r+");
+    if (!f) panic("Could not open trace file %s", fname.c_str());
+    fseek(f, 0, SEEK_END);
+
+    if (cur) {
+        uint8_t* p = encBuf;
+        for (uint32_t c = 0; c < numChildren; c++) lastAddrs[c] = lastCycles[c] = 0;
+        for (uint32_t i = 0; i < cur; i++) {
+            const PackedAccessRecord& pr = buf[i];
+            assert(pr.childId < numChildren);
+            p = encodeVarint(p, ((uint32_t)pr.childId << 2) | (pr.type & 3));
+            p = encodeVarint(p, zigzag(pr.lineAddr - lastAddrs[pr.childId]));
+            p = encodeVarint(p, zigzag(pr.reqCycle - lastCycles[pr.childId]));
+            p = encodeVarint(p, pr.latency);
+            lastAddrs[pr.childId] = pr.lineAddr;
+            lastCycles[pr.childId] = pr.reqCycle;
+        }
+        uint32_t rawBytes = p - encBuf;
+        uint32_t compBytes = LZCompress(encBuf, rawBytes, compBuf);
+        bool useLZ = compBytes < rawBytes;
+
+        NativeTraceBlockHeader bhdr = {useLZ? compBytes : rawBytes, rawBytes, cur, useLZ? NATIVE_BLOCK_LZ : 0u};
+        NativeTraceIndexEntry entry = {(uint64_t)ftell(f), numRecords, buf[0].reqCycle};
+        index.push_back(entry);
+        if (fwrite(&bhdr, sizeof(bhdr), 1, f) != 1 || fwrite(useLZ? compBuf : encBuf, bhdr.payloadBytes, 1, f) != 1) {
+            panic("Could not write trace file %s", fname.c_str());
+        }
+        numRecords += cur;
+    }
+
+    if (!cont) {
+        // Index goes after the last block, 8-byte aligned so the reader can use it in place
+        uint64_t indexOffset = ftell(f);
+        uint64_t pad = (sizeof(uint64_t) - indexOffset % sizeof(uint64_t)) % sizeof(uint64_t);
+        uint64_t zero = 0;
+        if (pad && fwrite(&zero, pad, 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+        indexOffset += pad;
+        if (index.size() && fwrite(&index[0], sizeof(NativeTraceIndexEntry), index.size(), f) != index.size()) {
+            panic("Could not write trace file %s", fname.c_str());
+        }
+
+        NativeTraceHeader hdr = {NATIVE_MAGIC, NATIVE_VERSION, numChildren, 1 /*finished*/, NATIVE_BLOCK_RECORDS, numRecords, index.size(), indexOffset};
+        fseek(f, 0, SEEK_SET);
+        if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) panic("Could not write trace file %s", fname.c_str());
+
+        gm_free(encBuf);
+        gm_free(compBuf);
+        gm_free(lastAddrs);
+        gm_free(lastCycles);
+        encBuf = compBuf = nullptr;
+        lastAddrs = lastCycles = nullptr;
+    }
+
+    fclose(f);
+}
@@ -27,9 +27,22 @@
 #define ACCESS_TRACING_H_
 
 #include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 
-/* HDF5-based classes read and write address traces in a consistent format */
+/* Classes to read and write address traces in a consistent format. There are two on-disk formats:
+ * - HDF5: a chunked, deflated packet table of PackedAccessRecords. Easy to open from other tools.
+ * - Native: blocks of delta- and varint-encoded records, each LZ-compressed, followed by a block index.
+ *   Much smaller and faster to replay; the reader mmaps the file and decodes blocks straight from the
+ *   mapping, prefetching the next block asynchronously (madvise).
+ * Readers detect the format; writers use the native format for .ztrace files and HDF5 otherwise, so
+ * existing trace names keep producing HDF5. Use convtrace to convert between them.
+ */
+
+enum TraceFormat {TF_HDF5, TF_NATIVE};
+
+TraceFormat TraceFormatForFile(const char* fname);  // format used to write fname
+const char* TraceFormatName(TraceFormat format);
 
 struct AccessRecord {
     Address lineAddr;
@@ -47,6 +60,12 @@ struct PackedAccessRecord {
     uint16_t type;  // could be uint8_t, but causes corruption in HDF5? (wtf...)
 } /*__attribute__((packed))*/;  // 24 bytes --> no packing needed
 
+//Native format block index entry
+struct NativeTraceIndexEntry {
+    uint64_t offset; //of the block in the file
+    uint64_t firstRecord;
+    uint64_t firstCycle; //reqCycle of firstRecord (blocks are cycle-ordered only in sorted traces)
+};
 
 class AccessTraceReader {
     private:
@@ -54,17 +73,31 @@ class AccessTraceReader {
         uint32_t cur;
         uint32_t max;
         g_string fname;
+        TraceFormat format;
 
         uint64_t curFrameRecord;
         uint64_t numRecords;
         uint32_t numChildren; //i.e., how many parallel streams does this file contain?
 
+        //Native format only
+        const uint8_t* map;
+        size_t mapSize;
+        const NativeTraceIndexEntry* index;
+        uint64_t numBlocks;
+        uint64_t curBlock;
+        uint32_t blockRecords;
+        uint8_t* scratch; //decompressed block
+        uint64_t* lastAddrs; //per-child delta decoding state
+        uint64_t* lastCycles;
+
     public:
-        AccessTraceReader(std::string fname);
+        explicit AccessTraceReader(std::string fname);
+        ~AccessTraceReader();
 
         inline bool empty() const {return (cur == max);}
         uint32_t getNumChildren() const {return numChildren;}
         uint64_t getNumRecords() const {return numRecords;}
+        TraceFormat getFormat() const {return format;}
 
         inline AccessRecord read() {
             assert(cur < max);
@@ -74,8 +107,13 @@ class AccessTraceReader {
             return rec;
         }
 
+        //Positions the reader so that the next read() returns the given record (numRecords positions at the end)
+        void seek(uint64_t record);
+
     private:
         void nextChunk();
+        void readHDF5Chunk(uint64_t firstRecord);
+        void readNativeBlock(uint64_t block);
 };
 
 class AccessTraceWriter : public GlobAlloc {
@@ -84,6 +122,16 @@ class AccessTraceWriter : public GlobAlloc {
         uint32_t cur;
         uint32_t max;
         g_string fname;
+        TraceFormat format;
+
+        //Native format only
+        uint64_t numRecords;
+        uint32_t numChildren;
+        g_vector<NativeTraceIndexEntry> index;
+        uint8_t* encBuf; //encoded block
+        uint8_t* compBuf; //compressed block
+        uint64_t* lastAddrs; //per-child delta encoding state
+        uint64_t* lastCycles;
 
     public:
         AccessTraceWriter(g_string fname, uint32_t numChildren);
@@ -97,6 +145,12 @@ class AccessTraceWriter : public GlobAlloc {
         }
 
         void dump(bool cont);
+
+    private:
+        void initHDF5();
+        void dumpHDF5(bool cont);
+        void initNative();
+        void dumpNative(bool cont);
 };
 
-#endif  // _ACCESS_TRACING_H
+#endif  // ACCESS_TRACING_H_
@@ -24,14 +24,18 @@
  */
 
 #include "cache.h"
+#include "checkpoint.h"
 #include "hash.h"
+#include "mrc_profiler.h"
+#include "sampled_cache.h"
+#include "shadow_cache.h"
 
 #include "event_recorder.h"
 #include "timing_event.h"
 #include "zsim.h"
 
 Cache::Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name)
-    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name) {}
+    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name), shadows(nullptr), mrc(nullptr) {}
 
 const char* Cache::getName() {
     return name.c_str();
@@ -56,12 +60,30 @@ void Cache::initCacheStats(AggregateStat* cacheStat) {
     cc->initStats(cacheStat);
     array->initStats(cacheStat);
     rp->initStats(cacheStat);
+    if (shadows) shadows->initStats(cacheStat);
+    if (mrc) mrc->initStats(cacheStat);
+}
+
+void Cache::serialize(Checkpoint& ck) {
+    ck.section("cache", name.c_str());
+    array->serialize(ck);
+    rp->serialize(ck);
+    cc->serialize(ck);
+    if (shadows) shadows->serialize(ck);
+    if (mrc) mrc->serialize(ck);
 }
 
 uint64_t Cache::access(MemReq& req) {
+    return accessImpl(array, cc, req);
+}
+
+template <typename A, typename C>
+inline uint64_t Cache::accessImpl(A* array, C* cc, MemReq& req) {
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
     if (likely(!skipAccess)) {
+        if (unlikely(shadows != nullptr)) shadows->access(req);
+        if (unlikely(mrc != nullptr)) mrc->access(req);
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
         respCycle += accLat;
@@ -80,7 +102,8 @@ uint64_t Cache::access(MemReq& req) {
         }
         // Enforce single-record invariant: Writeback access may have a timing
         // record. If so, read it.
-        EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+        //Warmup accesses may come from a thread not running on srcId, and must not touch its recorder
+        EventRecorder* evRec = req.is(MemReq::WARMUP)? nullptr : zinfo->eventRecorders[req.srcId];
         TimingRecord wbAcc;
         wbAcc.clear();
         if (unlikely(evRec && evRec->hasRecord())) {
@@ -125,12 +148,22 @@ uint64_t Cache::access(MemReq& req) {
     return respCycle;
 }
 
-void Cache::startInvalidate() {
-    cc->startInv(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
+void Cache::startInvalidate(const InvReq& req) {
+    cc->startInv(req); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
 }
 
 uint64_t Cache::finishInvalidate(const InvReq& req) {
+    return finishInvalidateImpl(array, cc, req);
+}
+
+template <typename A, typename C>
+inline uint64_t Cache::finishInvalidateImpl(A* array, C* cc, const InvReq& req) {
     int32_t lineId = array->lookup(req.lineAddr, nullptr, false);
+    if (req.inexact && (lineId == -1 || !cc->isValid(lineId))) {
+        //Our parent's directory is inexact and we do not hold the line, just ack
+        cc->skipInv(req);
+        return req.cycle + invLat;
+    }
     assert_msg(lineId != -1, "[%s] Invalidate on non-existing address 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
     uint64_t respCycle = req.cycle + invLat;
     trace(Cache, "[%s] Invalidate start 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
@@ -139,3 +172,31 @@ uint64_t Cache::finishInvalidate(const InvReq& req) {
 
     return respCycle;
 }
+
+/* TypedCache implementation */
+
+template <typename A, typename C>
+TypedCache<A, C>::TypedCache(uint32_t _numLines, C* _cc, A* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name)
+    : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), tarray(_array), tcc(_cc) {}
+
+template <typename A, typename C>
+uint64_t TypedCache<A, C>::access(MemReq& req) {
+    return accessImpl(tarray, tcc, req);
+}
+
+template <typename A, typename C>
+uint64_t TypedCache<A, C>::invalidate(const InvReq& req) {
+    tcc->startInv(req);
+    return finishInvalidateImpl(tarray, tcc, req);
+}
+
+// Specializations built by BuildCacheBank (ZArray's replacement walk is instantiated in cache_arrays.cpp)
+template class TypedCache<TypedSetAssocArray<FinalLRUReplPolicy>, MESICC>;
+template class TypedCache<TypedSetAssocArray<FinalLRUNoShReplPolicy>, MESICC>;
+template class TypedCache<TypedSetAssocArray<FinalNRUReplPolicy>, MESICC>;
+template class TypedCache<TypedZArray<FinalLRUReplPolicy>, MESICC>;
+template class TypedCache<TypedZArray<FinalLRUNoShReplPolicy>, MESICC>;
+template class TypedCache<TypedZArray<FinalNRUReplPolicy>, MESICC>;
+
+// Set-sampled caches run the access path on an adapter that is both their array and CC (see sampled_cache.h)
+template uint64_t Cache::accessImpl(SampledCache::SampledAccess* a, SampledCache::SampledAccess* c, MemReq& req);
@@ -35,6 +35,8 @@
 #include "stats.h"
 
 class Network;
+class MRCProfiler;
+class ShadowCaches;
 
 /* General coherent modular cache. The replacement policy and cache array are
  * pretty much mix and match. The coherence controller interfaces are general
@@ -55,6 +57,9 @@ class Cache : public BaseCache {
 
         g_string name;
 
+        ShadowCaches* shadows; //alternative configurations fed our accesses (nullptr if none)
+        MRCProfiler* mrc; //miss ratio curve profiler of our accesses (nullptr if none)
+
     public:
         Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name);
 
@@ -62,20 +67,53 @@ class Cache : public BaseCache {
         void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network);
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         void initStats(AggregateStat* parentStat);
+        void serialize(Checkpoint& ck);
 
         virtual uint64_t access(MemReq& req);
 
+        void setShadows(ShadowCaches* _shadows) {shadows = _shadows;}
+        void setMRCProfiler(MRCProfiler* _mrc) {mrc = _mrc;}
+
         //NOTE: reqWriteback is pulled up to true, but not pulled down to false.
         virtual uint64_t invalidate(const InvReq& req) {
-            startInvalidate();
+            startInvalidate(req);
             return finishInvalidate(req);
         }
 
     protected:
         void initCacheStats(AggregateStat* cacheStat);
 
-        void startInvalidate(); // grabs cc's downLock
+        void startInvalidate(const InvReq& req); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
+
+        /* Access and invalidation paths, templated on the array and CC types. Cache uses the virtual
+         * interfaces; TypedCache passes final types, so the whole path is devirtualized and inlined.
+         */
+        template <typename A, typename C> uint64_t accessImpl(A* a, C* c, MemReq& req);
+        template <typename A, typename C> uint64_t finishInvalidateImpl(A* a, C* c, const InvReq& req);
+};
+
+/* Cache specialized on its array and coherence controller types. Both must be final (e.g., a TypedSetAssocArray
+ * on a FinalReplPolicy, and MESICC). BuildCacheBank uses it for the common non-terminal configurations; other
+ * configurations use Cache, which has the same behavior but calls its components through virtual functions.
+ * Specializations are instantiated in cache.cpp.
+ */
+template <typename A, typename C>
+class TypedCache final : public Cache {
+    private:
+        A* tarray;
+        C* tcc;
+
+    public:
+        TypedCache(uint32_t _numLines, C* _cc, A* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name);
+
+        uint64_t access(MemReq& req);
+        uint64_t invalidate(const InvReq& req);
 };
 
+// Replacement policies of the TypedCache specializations
+typedef FinalReplPolicy< LRUReplPolicy<true, MESICC> > FinalLRUReplPolicy;
+typedef FinalReplPolicy< LRUReplPolicy<false, MESICC> > FinalLRUNoShReplPolicy;
+typedef FinalReplPolicy<NRUReplPolicy> FinalNRUReplPolicy;
+
 #endif  // CACHE_H_
@@ -24,50 +24,51 @@
  */
 
 #include "cache_arrays.h"
+#include "checkpoint.h"
 #include "hash.h"
 #include "repl_policies.h"
 
 /* Set-associative array implementation */
 
-SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
-    array = gm_calloc<Address>(numLines);
+SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, bool alignSets, bool simdLookup)
+    : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)
+{
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+
+    const uint32_t tagsPerLine = CACHE_LINE_BYTES/sizeof(Address);
+    setStride = alignSets? (assoc + tagsPerLine - 1)/tagsPerLine*tagsPerLine : assoc;
+    array = gm_memalign<Address>(CACHE_LINE_BYTES, numSets*setStride);
+    for (uint32_t i = 0; i < numSets*setStride; i++) array[i] = 0;
+
+    matchImpl = simdLookup? bestTagMatchImpl(assoc) : TM_SCALAR;
 }
 
 int32_t SetAssocArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
-    uint32_t set = hf->hash(0, lineAddr) & setMask;
-    uint32_t first = set*assoc;
-    for (uint32_t id = first; id < first + assoc; id++) {
-        if (array[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
-            return id;
-        }
-    }
-    return -1;
+    return lookupImpl(rp, lineAddr, req, updateReplacement);
 }
 
-uint32_t SetAssocArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) { //TODO: Give out valid bit of wb cand?
-    uint32_t set = hf->hash(0, lineAddr) & setMask;
-    uint32_t first = set*assoc;
-
-    uint32_t candidate = rp->rankCands(req, SetAssocCands(first, first+assoc));
-
-    *wbLineAddr = array[candidate];
-    return candidate;
+uint32_t SetAssocArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+    return preinsertImpl(rp, lineAddr, req, wbLineAddr);
 }
 
 void SetAssocArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
-    rp->replaced(candidate);
-    array[candidate] = lineAddr;
-    rp->update(candidate, req);
+    postinsertImpl(rp, lineAddr, req, candidate);
+}
+
+void SetAssocArray::serialize(Checkpoint& ck) {
+    ck.section("SetAssocArray");
+    ck.check("lines", numLines);
+    ck.check("ways", assoc);
+    //Skip set padding, so checkpoints work across alignSets settings
+    for (uint32_t set = 0; set < numSets; set++) ck.io(&array[set*setStride], assoc);
 }
 
 
 /* ZCache implementation */
 
-ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf) //(int _size, int _lineSize, int _assoc, int _zassoc, ReplacementPolicy<T>* _rp, int _hashType)
+ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf, bool memoHashes) //(int _size, int _lineSize, int _assoc, int _zassoc, ReplacementPolicy<T>* _rp, int _hashType)
     : rp(_rp), hf(_hf), numLines(_numLines), ways(_ways), cands(_candidates)
 {
     assert_msg(ways > 1, "zcaches need >=2 ways to work");
@@ -85,6 +86,32 @@ ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPol
         lookupArray[i] = i;  // start with a linear mapping; with swaps, it'll get progressively scrambled
     }
     swapArray = gm_calloc<uint32_t>(cands/ways + 2);  // conservative upper bound (tight within 2 ways)
+
+    if (memoHashes) {
+        linePositions = gm_calloc<uint32_t>(numLines*ways);
+        insertPositions = gm_calloc<uint32_t>(ways);
+    } else {
+        linePositions = nullptr;
+        insertPositions = nullptr;
+    }
+}
+
+void ZArray::serialize(Checkpoint& ck) {
+    ck.section("ZArray");
+    ck.check("lines", numLines);
+    ck.check("ways", ways);
+    ck.io(array, numLines);
+    ck.io(lookupArray, numLines);
+
+    //Memoized positions are derived state, recompute them
+    if (linePositions && ck.restoring()) {
+        uint64_t hashes[ways];
+        for (uint32_t lineId = 0; lineId < numLines; lineId++) {
+            if (!array[lineId]) continue;
+            hf->hashes(array[lineId], ways, hashes);
+            for (uint32_t w = 0; w < ways; w++) linePositions[lineId*ways + w] = w*numSets + (hashes[w] & setMask);
+        }
+    }
 }
 
 void ZArray::initStats(AggregateStat* parentStat) {
@@ -92,30 +119,15 @@ void ZArray::initStats(AggregateStat* parentStat) {
     objStats->init("array", "ZArray stats");
     statSwaps.init("swaps", "Block swaps in replacement process");
     objStats->append(&statSwaps);
-    parentStat->append(objStats);
-}
-
-int32_t ZArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
-    /* Be defensive: If the line is 0, panic instead of asserting. Now this can
-     * only happen on a segfault in the main program, but when we move to full
-     * system, phy page 0 might be used, and this will hit us in a very subtle
-     * way if we don't check.
-     */
-    if (unlikely(!lineAddr)) panic("ZArray::lookup called with lineAddr==0 -- your app just segfaulted");
-
-    for (uint32_t w = 0; w < ways; w++) {
-        uint32_t lineId = lookupArray[w*numSets + (hf->hash(w, lineAddr) & setMask)];
-        if (array[lineId] == lineAddr) {
-            if (updateReplacement) {
-                rp->update(lineId, req);
-            }
-            return lineId;
-        }
+    if (linePositions) {
+        statHashesAvoided.init("hashesAvoided", "Per-way hashes avoided by memoized line positions");
+        objStats->append(&statHashesAvoided);
     }
-    return -1;
+    parentStat->append(objStats);
 }
 
-uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+template <typename R>
+uint32_t ZArray::preinsertImpl(R* r, const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
     ZWalkInfo candidates[cands + ways]; //extra ways entries to avoid checking on every expansion
 
     bool all_valid = true;
@@ -125,10 +137,13 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
     //info("Replacement for incoming 0x%lx", lineAddr);
 
     //Seeds
+    uint64_t hashes[ways];
+    hf->hashes(lineAddr, ways, hashes);
     for (uint32_t w = 0; w < ways; w++) {
-        uint32_t pos = w*numSets + (hf->hash(w, lineAddr) & setMask);
+        uint32_t pos = w*numSets + (hashes[w] & setMask);
         uint32_t lineId = lookupArray[pos];
         candidates[w].set(pos, lineId, -1);
+        if (linePositions) insertPositions[w] = pos;
         all_valid &= (array[lineId] != 0);
         //info("Seed Candidate %d addr 0x%lx pos %d lineId %d", w, array[lineId], pos, lineId);
     }
@@ -138,9 +153,10 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
         uint32_t fringeId = candidates[fringeStart].lineId;
         Address fringeAddr = array[fringeId];
         assert(fringeAddr);
+        const uint32_t* fringePositions = linePositions? &linePositions[fringeId*ways] : nullptr;
+        if (!fringePositions) hf->hashes(fringeAddr, ways, hashes);
         for (uint32_t w = 0; w < ways; w++) {
-            uint32_t hval = hf->hash(w, fringeAddr) & setMask;
-            uint32_t pos = w*numSets + hval;
+            uint32_t pos = fringePositions? fringePositions[w] : w*numSets + (hashes[w] & setMask);
             uint32_t lineId = lookupArray[pos];
 
             // Logically, you want to do this...
@@ -159,6 +175,7 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
         }
         fringeStart++;
     }
+    if (linePositions) statHashesAvoided.inc(fringeStart*ways);
 
     //Get best candidate (NOTE: This could be folded in the code above, but it's messy since we can expand more than zassoc elements)
     assert(!all_valid || numCandidates >= cands);
@@ -166,7 +183,7 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
 
     //info("Using %d candidates, all_valid=%d", numCandidates, all_valid);
 
-    uint32_t bestCandidate = rp->rankCands(req, ZCands(&candidates[0], &candidates[numCandidates]));
+    uint32_t bestCandidate = r->rankCands(req, ZCands(&candidates[0], &candidates[numCandidates]));
     assert(bestCandidate < numLines);
 
     //Fill in swap array
@@ -199,20 +216,19 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
     return bestCandidate;
 }
 
-void ZArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
-    //We do the swaps in lookupArray, the array stays the same
-    assert(lookupArray[swapArray[0]] == candidate);
-    for (uint32_t i = 0; i < swapArrayLen-1; i++) {
-        //info("Moving position %d (lineId %d) <- %d (lineId %d)", swapArray[i], lookupArray[swapArray[i]], swapArray[i+1], lookupArray[swapArray[i+1]]);
-        lookupArray[swapArray[i]] = lookupArray[swapArray[i+1]];
-    }
-    lookupArray[swapArray[swapArrayLen-1]] = candidate; //note that in preinsert() we walk the array backwards when populating swapArray, so the last elem is where the new line goes
-    //info("Inserting lineId %d in position %d", candidate, swapArray[swapArrayLen-1]);
+int32_t ZArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+    return lookupImpl(rp, lineAddr, req, updateReplacement);
+}
 
-    rp->replaced(candidate);
-    array[candidate] = lineAddr;
-    rp->update(candidate, req);
+uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+    return preinsertImpl(rp, lineAddr, req, wbLineAddr);
+}
 
-    statSwaps.inc(swapArrayLen-1);
+void ZArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
+    postinsertImpl(rp, lineAddr, req, candidate);
 }
 
+// Policies used by TypedZArray (see TypedCache)
+template uint32_t ZArray::preinsertImpl(FinalReplPolicy< LRUReplPolicy<true, MESICC> >*, const Address, const MemReq*, Address*);
+template uint32_t ZArray::preinsertImpl(FinalReplPolicy< LRUReplPolicy<false, MESICC> >*, const Address, const MemReq*, Address*);
+template uint32_t ZArray::preinsertImpl(FinalReplPolicy<NRUReplPolicy>*, const Address, const MemReq*, Address*);
@@ -26,8 +26,12 @@
 #ifndef CACHE_ARRAYS_H_
 #define CACHE_ARRAYS_H_
 
+#include "hash.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
+#include "tag_match.h"
+
+class Checkpoint;
 
 /* General interface of a cache array. The array is a fixed-size associative container that
  * translates addresses to line IDs. A line ID represents the position of the tag. The other
@@ -49,33 +53,92 @@ class CacheArray : public GlobAlloc {
         virtual void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) = 0;
 
         virtual void initStats(AggregateStat* parent) {}
+
+        //Saves or restores tags (see checkpoint.h)
+        virtual void serialize(Checkpoint& ck) {panic("This cache array does not support checkpoints");}
 };
 
 class ReplPolicy;
-class HashFamily;
 
-/* Set-associative cache array */
+/* Set-associative cache array.
+ * Tags of each set are contiguous and matched with a vector kernel if the host supports it. With
+ * alignSets, sets are padded to a multiple of the host line size, so each set's tags start in a
+ * new line (e.g., a 20-way set takes 3 lines instead of straddling 4). Line IDs are not padded.
+ */
 class SetAssocArray : public CacheArray {
     protected:
-        Address* array;
+        Address* array; //tags, set i starts at i*setStride
         ReplPolicy* rp;
         HashFamily* hf;
         uint32_t numLines;
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        uint32_t setStride; //== assoc unless sets are padded
+        TagMatchImpl matchImpl;
+
+        inline uint32_t tagPos(uint32_t lineId) const {
+            return (setStride == assoc)? lineId : (lineId/assoc)*setStride + lineId%assoc;
+        }
+
+        /* Access path, templated on the replacement policy type. The virtual methods use the ReplPolicy
+         * interface; TypedSetAssocArray passes its final policy type, so policy calls are direct and inlined.
+         */
+        template <typename R> inline int32_t lookupImpl(R* r, const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            uint32_t set = hf->hash(0, lineAddr) & setMask;
+            int32_t way = tagMatch(matchImpl, &array[set*setStride], assoc, lineAddr);
+            if (way >= 0) {
+                uint32_t id = set*assoc + way;
+                if (updateReplacement) r->update(id, req);
+                return id;
+            }
+            return -1;
+        }
+
+        template <typename R> inline uint32_t preinsertImpl(R* r, const Address lineAddr, const MemReq* req, Address* wbLineAddr); //needs SetAssocCands, defined below
+
+        template <typename R> inline void postinsertImpl(R* r, const Address lineAddr, const MemReq* req, uint32_t candidate) {
+            r->replaced(candidate);
+            array[tagPos(candidate)] = lineAddr;
+            r->update(candidate, req);
+        }
 
     public:
-        SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
+        SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf, bool alignSets = false, bool simdLookup = true);
 
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
         uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
         void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate);
+
+        void serialize(Checkpoint& ck);
+};
+
+/* Set-associative array specialized on its (final) replacement policy type; see TypedCache */
+template <typename R>
+class TypedSetAssocArray final : public SetAssocArray {
+    private:
+        R* trp;
+
+    public:
+        TypedSetAssocArray(uint32_t _numLines, uint32_t _assoc, R* _rp, HashFamily* _hf, bool alignSets, bool simdLookup)
+            : SetAssocArray(_numLines, _assoc, _rp, _hf, alignSets, simdLookup), trp(_rp) {}
+
+        int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            return lookupImpl(trp, lineAddr, req, updateReplacement);
+        }
+
+        uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+            return preinsertImpl(trp, lineAddr, req, wbLineAddr);
+        }
+
+        void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
+            postinsertImpl(trp, lineAddr, req, candidate);
+        }
 };
 
 /* The cache array that started this simulator :) */
 class ZArray : public CacheArray {
-    private:
+    protected:
         Address* array; //maps line id to address
         uint32_t* lookupArray; //maps physical position to lineId
         ReplPolicy* rp;
@@ -92,10 +155,64 @@ class ZArray : public CacheArray {
 
         uint32_t lastCandIdx;
 
+        //With memoized hashes, each resident line's position on each way (lineId*ways + w), computed once on
+        //insertion, so walks do not rehash the lines they expand. nullptr if not memoizing.
+        uint32_t* linePositions;
+        uint32_t* insertPositions; //positions of the line being inserted, set in preinsert()
+
         Counter statSwaps;
+        Counter statHashesAvoided;
+
+        /* Access path, templated on the replacement policy type (see SetAssocArray). The replacement walk is
+         * not inlined; it is instantiated in cache_arrays.cpp for each policy type TypedZArray is used with.
+         */
+        template <typename R> inline int32_t lookupImpl(R* r, const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            /* Be defensive: If the line is 0, panic instead of asserting. Now this can
+             * only happen on a segfault in the main program, but when we move to full
+             * system, phy page 0 might be used, and this will hit us in a very subtle
+             * way if we don't check.
+             */
+            if (unlikely(!lineAddr)) panic("ZArray::lookup called with lineAddr==0 -- your app just segfaulted");
+
+            uint64_t hashes[ways];
+            hf->hashes(lineAddr, ways, hashes);
+            for (uint32_t w = 0; w < ways; w++) {
+                uint32_t lineId = lookupArray[w*numSets + (hashes[w] & setMask)];
+                if (array[lineId] == lineAddr) {
+                    if (updateReplacement) {
+                        r->update(lineId, req);
+                    }
+                    return lineId;
+                }
+            }
+            return -1;
+        }
+
+        template <typename R> uint32_t preinsertImpl(R* r, const Address lineAddr, const MemReq* req, Address* wbLineAddr);
+
+        template <typename R> inline void postinsertImpl(R* r, const Address lineAddr, const MemReq* req, uint32_t candidate) {
+            //We do the swaps in lookupArray, the array stays the same
+            assert(lookupArray[swapArray[0]] == candidate);
+            for (uint32_t i = 0; i < swapArrayLen-1; i++) {
+                //info("Moving position %d (lineId %d) <- %d (lineId %d)", swapArray[i], lookupArray[swapArray[i]], swapArray[i+1], lookupArray[swapArray[i+1]]);
+                lookupArray[swapArray[i]] = lookupArray[swapArray[i+1]];
+            }
+            lookupArray[swapArray[swapArrayLen-1]] = candidate; //note that in preinsert() we walk the array backwards when populating swapArray, so the last elem is where the new line goes
+            //info("Inserting lineId %d in position %d", candidate, swapArray[swapArrayLen-1]);
+
+            r->replaced(candidate);
+            array[candidate] = lineAddr;
+            r->update(candidate, req);
+
+            if (linePositions) {
+                for (uint32_t w = 0; w < ways; w++) linePositions[candidate*ways + w] = insertPositions[w];
+            }
+
+            statSwaps.inc(swapArrayLen-1);
+        }
 
     public:
-        ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf);
+        ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf, bool memoHashes = false);
 
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
         uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
@@ -106,6 +223,30 @@ class ZArray : public CacheArray {
         uint32_t getLastCandIdx() const {return lastCandIdx;}
 
         void initStats(AggregateStat* parentStat);
+        void serialize(Checkpoint& ck);
+};
+
+/* ZArray specialized on its (final) replacement policy type; see TypedCache */
+template <typename R>
+class TypedZArray final : public ZArray {
+    private:
+        R* trp;
+
+    public:
+        TypedZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, R* _rp, HashFamily* _hf, bool memoHashes)
+            : ZArray(_numLines, _ways, _candidates, _rp, _hf, memoHashes), trp(_rp) {}
+
+        int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            return lookupImpl(trp, lineAddr, req, updateReplacement);
+        }
+
+        uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+            return preinsertImpl(trp, lineAddr, req, wbLineAddr);
+        }
+
+        void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
+            postinsertImpl(trp, lineAddr, req, candidate);
+        }
 };
 
 // Simple wrapper classes and iterators for candidates in each case; simplifies replacement policy interface without sacrificing performance
@@ -154,4 +295,15 @@ struct ZCands {
     inline uint32_t numCands() const { return e-b; }
 };
 
+template <typename R>
+inline uint32_t SetAssocArray::preinsertImpl(R* r, const Address lineAddr, const MemReq* req, Address* wbLineAddr) { //TODO: Give out valid bit of wb cand?
+    uint32_t set = hf->hash(0, lineAddr) & setMask;
+    uint32_t first = set*assoc;
+
+    uint32_t candidate = r->rankCands(req, SetAssocCands(first, first+assoc));
+
+    *wbLineAddr = array[tagPos(candidate)];
+    return candidate;
+}
+
 #endif  // CACHE_ARRAYS_H_
@@ -0,0 +1,164 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "checkpoint.h"
+#include <string.h>
+#include <string>
+#include "core.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+#include "trace_driver.h"
+#include "zsim.h"
+
+#define CKPT_MAGIC 0x54504b434d49535aul  // "ZSIMCKPT"
+#define CKPT_VERSION 2
+
+Checkpoint::Checkpoint(const char* _file, Mode _mode) : file(_file), mode(_mode), bytes(0) {
+    f = fopen(file, saving()? "w" : "r");
+    if (!f) panic("Could not open checkpoint file %s for %s", file, saving()? "writing" : "reading");
+    setvbuf(f, nullptr, _IOFBF, 1 << 20);
+}
+
+Checkpoint::~Checkpoint() {
+    if (fclose(f) != 0) panic("Error closing checkpoint file %s", file);
+}
+
+void Checkpoint::raw(void* data, size_t len) {
+    size_t done = saving()? fwrite(data, 1, len, f) : fread(data, 1, len, f);
+    if (done != len) panic("Checkpoint %s: %s failed at offset %ld", file, saving()? "write" : "read", bytes + done);
+    bytes += len;
+}
+
+void Checkpoint::section(const char* name) {
+    uint32_t len = strlen(name);
+    if (saving()) {
+        io(len);
+        raw(const_cast<char*>(name), len);
+    } else {
+        uint32_t ckLen;
+        io(ckLen);
+        if (ckLen > 4096) panic("Checkpoint %s does not match this system: expected %s, found garbage (offset %ld)", file, name, bytes);
+        std::string ckName(ckLen, '\0');
+        raw(&ckName[0], ckLen);
+        if (ckName != name) {
+            panic("Checkpoint %s does not match this system: expected %s, found %s (offset %ld)", file, name, ckName.c_str(), bytes);
+        }
+    }
+}
+
+void Checkpoint::section(const char* prefix, const char* name) {
+    std::string s = prefix;
+    s += "-";
+    s += name;
+    section(s.c_str());
+}
+
+void Checkpoint::check(const char* what, uint64_t v) {
+    uint64_t ckV = v;
+    io(ckV);
+    if (ckV != v) panic("Checkpoint %s does not match this system: %s is %ld, checkpoint has %ld", file, what, v, ckV);
+}
+
+//(Sharded) counters, vector counters and histograms are the only stats that hold their own state; the rest are views of component state
+static void CheckpointStats(Checkpoint& ck, AggregateStat* s, bool restoreStats) {
+    ck.section(s->name());
+    ck.check("stats size", s->size());
+    for (uint32_t i = 0; i < s->size(); i++) {
+        Stat* child = s->get(i);
+        if (AggregateStat* as = dynamic_cast<AggregateStat*>(child)) {
+            CheckpointStats(ck, as, restoreStats);
+        } else if (Counter* cs = dynamic_cast<Counter*>(child)) {
+            uint64_t v = cs->get();
+            ck.io(v);
+            if (restoreStats) cs->set(v);
+        } else if (VectorCounter* vs = dynamic_cast<VectorCounter*>(child)) {
+            ck.check("vector stat size", vs->size());
+            for (uint32_t j = 0; j < vs->size(); j++) {
+                uint64_t v = vs->count(j);
+                ck.io(v);
+                if (restoreStats) vs->set(j, v);
+            }
+        } else if (ShardedCounter* cs = dynamic_cast<ShardedCounter*>(child)) {
+            uint64_t v = cs->get();
+            ck.io(v);
+            if (restoreStats) cs->set(v);
+        } else if (ShardedVectorCounter* vs = dynamic_cast<ShardedVectorCounter*>(child)) {
+            ck.check("vector stat size", vs->size());
+            for (uint32_t j = 0; j < vs->size(); j++) {
+                uint64_t v = vs->count(j);
+                ck.io(v);
+                if (restoreStats) vs->set(j, v);
+            }
+        } else if (Histogram* hs = dynamic_cast<Histogram*>(child)) {
+            ck.check("histogram size", hs->size());
+            uint64_t samples = hs->samples();
+            uint64_t sum = hs->sum();
+            ck.io(samples);
+            ck.io(sum);
+            if (restoreStats) hs->setTotals(samples, sum);
+            for (uint32_t j = 0; j < hs->size(); j++) {
+                uint64_t v = hs->count(j);
+                ck.io(v);
+                if (restoreStats) hs->set(j, v);
+            }
+        }
+    }
+}
+
+static void CheckpointSystem(Checkpoint& ck, bool restoreStats) {
+    ck.check("magic", CKPT_MAGIC);
+    ck.check("version", CKPT_VERSION);
+    ck.check("line size", zinfo->lineSize);
+    ck.check("cores", zinfo->traceDriven? 0 : zinfo->numCores);
+    ck.check("caches", zinfo->caches->size());
+    ck.check("memory controllers", zinfo->memControllers->size());
+
+    if (!zinfo->traceDriven) {
+        for (uint32_t i = 0; i < zinfo->numCores; i++) zinfo->cores[i]->serialize(ck);
+    } else {
+        //The directory lists the driver's children as sharers, so their line sets must come along
+        zinfo->traceDriver->serialize(ck);
+    }
+    for (BaseCache* c : *zinfo->caches) c->serialize(ck);
+    for (MemObject* m : *zinfo->memControllers) m->serialize(ck);
+
+    //Stats go last, so ignoring them on restore does not need to skip anything else
+    CheckpointStats(ck, zinfo->rootStat, restoreStats);
+}
+
+void SaveCheckpoint(const char* file) {
+    info("Writing checkpoint to %s", file);
+    Checkpoint ck(file, Checkpoint::SAVE);
+    CheckpointSystem(ck, false);
+    info("Checkpoint written (%ld bytes)", ck.size());
+}
+
+void RestoreCheckpoint(const char* file, bool restoreStats) {
+    info("Restoring checkpoint from %s%s", file, restoreStats? " (including stats)" : "");
+    Checkpoint ck(file, Checkpoint::RESTORE);
+    CheckpointSystem(ck, restoreStats);
+    info("Checkpoint restored (%ld bytes)", ck.size());
+}
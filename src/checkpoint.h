@@ -0,0 +1,89 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "g_std/g_vector.h"
+#include "log.h"
+
+/* Checkpoints of warm simulator state.
+ *
+ * A checkpoint holds the time-independent microarchitectural state of the simulated system: cache
+ * tags, replacement and coherence state, core predictors, memory controller load estimates, and all
+ * counter stats. It does not hold application state (that lives in the Pin-controlled processes) or
+ * the simulated timeline (weave-phase events in flight, absolute cycles). A restoring run starts at
+ * phase 0 with a warm system, and should fast-forward to the point where the checkpoint was taken
+ * (e.g., the same ROI magic op or ffwd instruction count) instead of re-simulating the warmup.
+ *
+ * Components implement a single serialize(Checkpoint&) method used in both directions: io() writes
+ * the value when saving and overwrites it when restoring. Components start with a section() tag
+ * naming themselves, so restoring into a different system panics instead of loading garbage.
+ */
+class Checkpoint {
+    public:
+        enum Mode {SAVE, RESTORE};
+
+    private:
+        FILE* f;
+        const char* file;
+        Mode mode;
+        uint64_t bytes;
+
+    public:
+        Checkpoint(const char* _file, Mode _mode);
+        ~Checkpoint();
+
+        bool saving() const {return mode == SAVE;}
+        bool restoring() const {return mode == RESTORE;}
+        uint64_t size() const {return bytes;}
+
+        //Raw data, in or out depending on mode. Use only on POD types without pointers.
+        void raw(void* data, size_t len);
+
+        template <typename T> inline void io(T& v) {raw(&v, sizeof(T));}
+        template <typename T> inline void io(T* v, size_t n) {raw(v, sizeof(T)*n);}
+
+        template <typename T> void io(g_vector<T>& v) {
+            uint64_t n = v.size();
+            io(n);
+            if (restoring()) v.resize(n);
+            if (n) io(&v[0], n);
+        }
+
+        //Saves name, or checks that the restored section has this name
+        void section(const char* name);
+        void section(const char* prefix, const char* name);
+
+        //Saves v, or checks that the restored value matches it (for sizes that must agree with the config)
+        void check(const char* what, uint64_t v);
+};
+
+void SaveCheckpoint(const char* file);
+void RestoreCheckpoint(const char* file, bool restoreStats);
+
+#endif  // CHECKPOINT_H_
@@ -25,6 +25,7 @@
 
 #include "coherence_ctrls.h"
 #include "cache.h"
+#include "checkpoint.h"
 #include "network.h"
 
 /* Do a simple XOR block hash on address to determine its bank. Hacky for now,
@@ -52,8 +53,13 @@ void MESIBottomCC::init(const g_vector<MemObject*>& _parents, Network* network,
     }
 }
 
+void MESIBottomCC::serialize(Checkpoint& ck) {
+    ck.check("bcc lines", numLines);
+    ck.io(array, numLines);
+}
+
 
-uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId) {
+uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     MESIState* state = &array[lineId];
     if (lowerLevelWriteback) {
         //If this happens, when tcc issued the invalidations, it got a writeback. This means we have to do a PUTX, i.e. we have to transition to M if we are in E
@@ -67,13 +73,13 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
         case S:
         case E:
             {
-                MemReq req = {wbLineAddr, PUTS, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
+                MemReq req = {wbLineAddr, PUTS, selfId, state, cycle, ccLocks->get(wbLineAddr), *state, srcId, flags};
                 respCycle = parents[getParentId(wbLineAddr)]->access(req);
             }
             break;
         case M:
             {
-                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
+                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, ccLocks->get(wbLineAddr), *state, srcId, flags};
                 respCycle = parents[getParentId(wbLineAddr)]->access(req);
             }
             break;
@@ -86,12 +92,13 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
 
 uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags) {
     uint64_t respCycle = cycle;
+    bool prof = !(flags & MemReq::WARMUP); //warmup accesses change state, but are not profiled
     MESIState* state = &array[lineId];
     switch (type) {
         // A PUTS/PUTX does nothing w.r.t. higher coherence levels --- it dies here
         case PUTS: //Clean writeback, nothing to do (except profiling)
             assert(*state != I);
-            profPUTS.inc();
+            if (prof) profPUTS.inc();
             break;
         case PUTX: //Dirty writeback
             assert(*state == M || *state == E);
@@ -99,34 +106,40 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 //Silent transition, record that block was written to
                 *state = M;
             }
-            profPUTX.inc();
+            if (prof) profPUTX.inc();
             break;
         case GETS:
             if (*state == I) {
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETS, selfId, state, cycle, ccLocks->get(lineAddr), *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                if (prof) {
+                    profGETNextLevelLat.inc(nextLevelLat);
+                    profGETNetLat.inc(netLat);
+                }
                 respCycle += nextLevelLat + netLat;
-                profGETSMiss.inc();
+                if (prof) profGETSMiss.inc();
                 assert(*state == S || *state == E);
             } else {
-                profGETSHit.inc();
+                if (prof) profGETSHit.inc();
             }
             break;
         case GETX:
             if (*state == I || *state == S) {
                 //Profile before access, state changes
-                if (*state == I) profGETXMissIM.inc();
-                else profGETXMissSM.inc();
+                if (prof) {
+                    if (*state == I) profGETXMissIM.inc();
+                    else profGETXMissSM.inc();
+                }
                 uint32_t parentId = getParentId(lineAddr);
-                MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags};
+                MemReq req = {lineAddr, GETX, selfId, state, cycle, ccLocks->get(lineAddr), *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                if (prof) {
+                    profGETNextLevelLat.inc(nextLevelLat);
+                    profGETNetLat.inc(netLat);
+                }
                 respCycle += nextLevelLat + netLat;
             } else {
                 if (*state == E) {
@@ -139,7 +152,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                      */
                     *state = M;
                 }
-                profGETXHit.inc();
+                if (prof) profGETXHit.inc();
             }
             assert_msg(*state == M, "Wrong final state on GETX, lineId %d numLines %d, finalState %s", lineId, numLines, MESIStateName(*state));
             break;
@@ -150,6 +163,56 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
     return respCycle;
 }
 
+uint64_t MESIBottomCC::processUntrackedAccess(Address lineAddr, AccessType type, bool hit, uint64_t cycle, uint32_t srcId, uint32_t flags) {
+    uint64_t respCycle = cycle;
+    bool prof = !(flags & MemReq::WARMUP); //warmup accesses change state, but are not profiled
+    switch (type) {
+        case PUTS:
+            if (prof) profPUTS.inc();
+            break;
+        case PUTX:
+            if (prof) profPUTX.inc();
+            break;
+        case GETS:
+        case GETX:
+            if (hit) {
+                if (prof) {
+                    if (type == GETS) profGETSHit.inc();
+                    else profGETXHit.inc();
+                }
+            } else {
+                if (prof) {
+                    if (type == GETS) profGETSMiss.inc();
+                    else profGETXMissIM.inc();
+                }
+                MESIState state = I;
+                uint32_t parentId = getParentId(lineAddr);
+                MemReq req = {lineAddr, type, selfId, &state, cycle, ccLocks->get(lineAddr), state, srcId, flags};
+                uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
+                uint32_t netLat = parentRTTs[parentId];
+                if (prof) {
+                    profGETNextLevelLat.inc(nextLevelLat);
+                    profGETNetLat.inc(netLat);
+                }
+                respCycle += nextLevelLat + netLat;
+            }
+            break;
+
+        default: panic("!?");
+    }
+    return respCycle;
+}
+
+uint64_t MESIBottomCC::processUntrackedEviction(Address wbLineAddr, MESIState victimState, uint64_t cycle, uint32_t srcId, uint32_t flags) {
+    if (victimState == I) return cycle;
+    MESIState state = victimState;
+    AccessType type = (state == M)? PUTX : PUTS;
+    MemReq req = {wbLineAddr, type, selfId, &state, cycle, ccLocks->get(wbLineAddr), state, srcId, flags};
+    uint64_t respCycle = parents[getParentId(wbLineAddr)]->access(req);
+    assert_msg(state == I, "Wrong final state %s on untracked eviction", MESIStateName(state));
+    return respCycle;
+}
+
 void MESIBottomCC::processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type) {
     MESIState* state = &array[lineId];
     assert(*state == M || *state == E);
@@ -190,7 +253,7 @@ uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType
     if (!nonInclusiveHack) panic("Non-inclusive %s on line 0x%lx, this cache should be inclusive", AccessTypeName(type), lineAddr);
 
     //info("Non-inclusive wback, forwarding");
-    MemReq req = {lineAddr, type, selfId, state, cycle, &ccLock, *state, srcId, flags | MemReq::NONINCLWB};
+    MemReq req = {lineAddr, type, selfId, state, cycle, ccLocks->get(lineAddr), *state, srcId, flags | MemReq::NONINCLWB};
     uint64_t respCycle = parents[getParentId(lineAddr)]->access(req);
     return respCycle;
 }
@@ -198,7 +261,7 @@ uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType
 
 /* MESITopCC implementation */
 
-void MESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
+void MESITopCC::init(const g_vector<BaseCache*>& _children, const SharerDirConfig& dirConfig, Network* network, const char* name) {
     if (_children.size() > MAX_CACHE_CHILDREN) {
         panic("[%s] Children size (%d) > MAX_CACHE_CHILDREN (%d)", name, (uint32_t)_children.size(), MAX_CACHE_CHILDREN);
     }
@@ -208,9 +271,22 @@ void MESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, co
         children[c] = _children[c];
         childrenRTTs[c] = (network)? network->getRTT(name, children[c]->getName()) : 0;
     }
+
+    dir = dirConfig.build(numLines, children.size());
+    dirExact = dir->isExact();
+    //With an inexact directory, GETX must rely on the child's state to tell upgrades, which non-inclusive caches break
+    if (!dirExact && nonInclusiveHack) panic("[%s] Inexact directories cannot be used with nonInclusiveHack", name);
+    sharerBuf = gm_calloc<uint32_t>(children.size()*lockStripes);
 }
 
-uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+void MESITopCC::serialize(Checkpoint& ck) {
+    ck.check("tcc lines", numLines);
+    ck.check("tcc children", children.size());
+    ck.io(array, numLines);
+    dir->serialize(ck);
+}
+
+uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t skipChild) {
     //Send down downgrades/invalidates
     Entry* e = &array[lineId];
 
@@ -221,20 +297,26 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
 
     uint64_t maxCycle = cycle; //keep maximum cycle only, we assume all invals are sent in parallel
     if (!e->isEmpty()) {
-        uint32_t numChildren = children.size();
+        uint32_t* sharers = &sharerBuf[ccLocks->getStripe(lineAddr)*children.size()];
+        uint32_t numCands = dir->getSharers(lineId, sharers);
         uint32_t sentInvs = 0;
-        for (uint32_t c = 0; c < numChildren; c++) {
-            if (e->sharers[c]) {
-                InvReq req = {lineAddr, type, reqWriteback, cycle, srcId};
-                uint64_t respCycle = children[c]->invalidate(req);
-                respCycle += childrenRTTs[c];
-                maxCycle = MAX(respCycle, maxCycle);
-                if (type == INV) e->sharers[c] = false;
-                sentInvs++;
-            }
+        for (uint32_t i = 0; i < numCands; i++) {
+            uint32_t c = sharers[i];
+            if (c == skipChild) continue;
+            sentInvs++;
+            InvReq req = {lineAddr, type, reqWriteback, cycle, srcId, !dirExact};
+            uint64_t respCycle = children[c]->invalidate(req);
+            respCycle += childrenRTTs[c];
+            maxCycle = MAX(respCycle, maxCycle);
+        }
+        if (dirExact) {
+            assert(sentInvs == e->numSharers);
+        } else {
+            assert(sentInvs >= e->numSharers);
+            profExtraInvs.inc(sentInvs - e->numSharers);
         }
-        assert(sentInvs == e->numSharers);
         if (type == INV) {
+            dir->clear(lineId);
             e->numSharers = 0;
         } else {
             //TODO: This is kludgy -- once the sharers format is more sophisticated, handle downgrades with a different codepath
@@ -247,10 +329,23 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
 }
 
 
+uint64_t MESITopCC::sendUntrackedInvalidates(Address lineAddr, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t skipChild) {
+    uint64_t maxCycle = cycle; //sent in parallel, as in sendInvalidates
+    for (uint32_t c = 0; c < children.size(); c++) {
+        if (c == skipChild) continue;
+        InvReq req = {lineAddr, type, reqWriteback, cycle, srcId, true /*inexact*/};
+        uint64_t respCycle = children[c]->invalidate(req);
+        respCycle += childrenRTTs[c];
+        maxCycle = MAX(respCycle, maxCycle);
+    }
+    return maxCycle;
+}
+
 uint64_t MESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
     if (nonInclusiveHack) {
         // Don't invalidate anything, just clear our entry
         array[lineId].clear();
+        dir->clear(lineId);
         return cycle;
     } else {
         //Send down invalidates
@@ -266,28 +361,29 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
         case PUTX:
             assert(e->isExclusive());
             if (flags & MemReq::PUTX_KEEPEXCL) {
-                assert(e->sharers[childId]);
+                assert(dir->mayShare(lineId, childId));
                 assert(*childState == M);
                 *childState = E; //they don't hold dirty data anymore
                 break; //don't remove from sharer set. It'll keep exclusive perms.
             }
             //note NO break in general
         case PUTS:
-            assert(e->sharers[childId]);
-            e->sharers[childId] = false;
+            assert(dir->mayShare(lineId, childId));
+            dir->remove(lineId, childId);
             e->numSharers--;
+            if (!dirExact && e->isEmpty()) dir->clear(lineId);
             *childState = I;
             break;
         case GETS:
             if (e->isEmpty() && haveExclusive && !(flags & MemReq::NOEXCL)) {
                 //Give in E state
                 e->exclusive = true;
-                e->sharers[childId] = true;
+                dir->add(lineId, childId);
                 e->numSharers = 1;
                 *childState = E;
             } else {
                 //Give in S state
-                assert(e->sharers[childId] == false);
+                assert(!dirExact || !dir->mayShare(lineId, childId));
 
                 if (e->isExclusive()) {
                     //Downgrade the exclusive sharer
@@ -296,7 +392,7 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
 
                 assert_msg(!e->isExclusive(), "Can't have exclusivity here. isExcl=%d excl=%d numSharers=%d", e->isExclusive(), e->exclusive, e->numSharers);
 
-                e->sharers[childId] = true;
+                dir->add(lineId, childId);
                 e->numSharers++;
                 e->exclusive = false; //dsm: Must set, we're explicitly non-exclusive
                 *childState = S;
@@ -306,17 +402,18 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
             assert(haveExclusive); //the current cache better have exclusive access to this line
 
             // If child is in sharers list (this is an upgrade miss), take it out
-            if (e->sharers[childId]) {
+            // Inexact directories can't tell, but the child can: races are resolved, so it's still in S iff it's a sharer
+            if (dirExact? dir->mayShare(lineId, childId) : (*childState == S)) {
                 assert_msg(!e->isExclusive(), "Spurious GETX, childId=%d numSharers=%d isExcl=%d excl=%d", childId, e->numSharers, e->isExclusive(), e->exclusive);
-                e->sharers[childId] = false;
+                dir->remove(lineId, childId);
                 e->numSharers--;
             }
 
-            // Invalidate all other copies
-            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId);
+            // Invalidate all other copies (an inexact directory may still list the child)
+            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId, childId);
 
             // Set current sharer, mark exclusive
-            e->sharers[childId] = true;
+            dir->add(lineId, childId);
             e->numSharers++;
             e->exclusive = true;
 
@@ -340,4 +437,3 @@ uint64_t MESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type
         return sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId);
     }
 }
-
@@ -26,13 +26,15 @@
 #ifndef COHERENCE_CTRLS_H_
 #define COHERENCE_CTRLS_H_
 
-#include <bitset>
 #include "constants.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
+#include "hash.h"
 #include "locks.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
+#include "rdtsc.h"
+#include "sharer_dirs.h"
 #include "stats.h"
 
 //TODO: Now that we have a pure CC interface, the MESI controllers should go on different files.
@@ -45,6 +47,11 @@ class CC : public GlobAlloc {
         virtual void setChildren(const g_vector<BaseCache*>& children, Network* network) = 0;
         virtual void initStats(AggregateStat* cacheStat) = 0;
 
+        //Caches with several children or lock stripes are accessed by many threads at once, so they shard their per-access stats
+        virtual uint32_t getNumChildren() const = 0;
+        virtual uint32_t getLockStripes() const {return 1;}
+        uint32_t statShards() const {return (getNumChildren() > 1 || getLockStripes() > 1)? DefaultStatShards() : 1;}
+
         //Access methods; see Cache for call sequence
         virtual bool startAccess(MemReq& req) = 0; //initial locking, address races; returns true if access should be skipped; may change req!
         virtual bool shouldAllocate(const MemReq& req) = 0; //called when we don't find req's lineAddr in the array
@@ -53,12 +60,16 @@ class CC : public GlobAlloc {
         virtual void endAccess(const MemReq& req) = 0;
 
         //Inv methods
-        virtual void startInv() = 0;
+        virtual void startInv(const InvReq& req) = 0;
         virtual uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) = 0;
+        virtual void skipInv(const InvReq& req) = 0; //instead of processInv, for inexact invalidates of lines we do not hold
 
         //Repl policy interface
         virtual uint32_t numSharers(uint32_t lineId) = 0;
         virtual bool isValid(uint32_t lineId) = 0;
+
+        //Saves or restores coherence state (see checkpoint.h)
+        virtual void serialize(Checkpoint& ck) = 0;
 };
 
 
@@ -76,6 +87,95 @@ class CC : public GlobAlloc {
 class Cache;
 class Network;
 
+/* Lock striping for MESI controllers. By default, each controller has a single lock, which serializes all
+ * accesses to a bank. With stripes, a line's lock is chosen by its set (the low bits of hash 0 of the array's
+ * hash family), so accesses to lines in different stripes proceed in parallel. This is only correct if every
+ * access touches state of a single set, so BuildCacheBank restricts it to set-associative arrays with
+ * stripe-safe replacement policies and sharer directories. Locks are handed over as before (MemReq::childLock
+ * is the lock of the requester's stripe), so races are still handled in startAccess() and endAccess().
+ */
+struct CCLockConfig {
+    uint32_t stripes; //power of two
+    HashFamily* hf; //array's hash family, needed if stripes > 1
+    bool profile; //count acquisitions, contended acquisitions, and hold times
+
+    CCLockConfig() : stripes(1), hf(nullptr), profile(false) {}
+};
+
+class CCLocks : public GlobAlloc {
+    private:
+        struct Stripe {
+            lock_t lock;
+            uint32_t pad0;
+            uint64_t acquireCycle; //host cycle of the last acquisition, for hold times
+            uint8_t pad1[CACHE_LINE_BYTES - 16];
+        };
+
+        Stripe* stripes;
+        uint32_t stripeMask;
+        HashFamily* hf;
+        bool profile;
+        bool profileHold; //only meaningful if the lock is not handed over to parents
+
+        ShardedCounter profAcquires, profContended, profHeldCycles;
+
+    public:
+        CCLocks(const CCLockConfig& cfg, bool _profileHold) : stripeMask(cfg.stripes - 1), hf(cfg.hf), profile(cfg.profile),
+            profileHold(cfg.profile && _profileHold)
+        {
+            assert(cfg.stripes && (cfg.stripes & (cfg.stripes - 1)) == 0);
+            assert(cfg.stripes == 1 || hf);
+            stripes = gm_memalign<Stripe>(CACHE_LINE_BYTES, cfg.stripes);
+            for (uint32_t i = 0; i < cfg.stripes; i++) {
+                futex_init(&stripes[i].lock);
+                stripes[i].acquireCycle = 0;
+            }
+        }
+
+        void initStats(AggregateStat* parentStat, const char* name, uint32_t shards) {
+            if (!profile) return;
+            AggregateStat* lockStat = new AggregateStat();
+            lockStat->init(name, "Lock stats");
+            profAcquires.init("acquires", "Acquisitions", shards);
+            profContended.init("contended", "Acquisitions that found the lock held", shards);
+            lockStat->append(&profAcquires);
+            lockStat->append(&profContended);
+            if (profileHold) {
+                profHeldCycles.init("heldCycles", "Host cycles the lock was held", shards);
+                lockStat->append(&profHeldCycles);
+            }
+            parentStat->append(lockStat);
+        }
+
+        inline uint32_t getStripe(Address lineAddr) const {
+            return stripeMask? (hf->hash(0, lineAddr) & stripeMask) : 0;
+        }
+
+        inline lock_t* get(Address lineAddr) {
+            return &stripes[getStripe(lineAddr)].lock;
+        }
+
+        inline void lock(uint32_t stripe) {
+            lock_t* l = &stripes[stripe].lock;
+            if (likely(!profile)) {
+                futex_lock(l);
+                return;
+            }
+
+            profAcquires.inc();
+            if (!(*l == 0 && __sync_bool_compare_and_swap(l, 0, 1))) {
+                profContended.inc();
+                futex_lock(l);
+            }
+            if (profileHold) stripes[stripe].acquireCycle = rdtsc();
+        }
+
+        inline void unlock(uint32_t stripe) {
+            if (unlikely(profileHold)) profHeldCycles.inc(rdtsc() - stripes[stripe].acquireCycle);
+            futex_unlock(&stripes[stripe].lock);
+        }
+};
+
 /* NOTE: To avoid virtual function overheads, there is no BottomCC interface, since we only have a MESI controller for now */
 
 class MESIBottomCC : public GlobAlloc {
@@ -87,48 +187,50 @@ class MESIBottomCC : public GlobAlloc {
         uint32_t selfId;
 
         //Profiling counters
-        Counter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
-        Counter profPUTS, profPUTX /*received from downstream*/;
-        Counter profINV, profINVX, profFWD /*received from upstream*/;
+        ShardedCounter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
+        ShardedCounter profPUTS, profPUTX /*received from downstream*/;
+        ShardedCounter profINV, profINVX, profFWD /*received from upstream*/;
         //Counter profWBIncl, profWBCoh /* writebacks due to inclusion or coherence, received from downstream, does not include PUTS */;
         // TODO: Measuring writebacks is messy, do if needed
-        Counter profGETNextLevelLat, profGETNetLat;
+        ShardedCounter profGETNextLevelLat, profGETNetLat;
 
         bool nonInclusiveHack;
 
-        PAD();
-        lock_t ccLock;
-        PAD();
+        //Handed over to parents (see MemReq::childLock), so only the requester's stripe is held on upward accesses
+        CCLocks* ccLocks;
 
     public:
-        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack) {
+        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack, const CCLockConfig& lockConfig = CCLockConfig())
+            : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack)
+        {
             array = gm_calloc<MESIState>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i] = I;
             }
-            futex_init(&ccLock);
+            ccLocks = new CCLocks(lockConfig, false /*lock is handed over, hold times would include parent accesses*/);
         }
 
         void init(const g_vector<MemObject*>& _parents, Network* network, const char* name);
+        void serialize(Checkpoint& ck);
 
         inline bool isExclusive(uint32_t lineId) {
             MESIState state = array[lineId];
             return (state == E) || (state == M);
         }
 
-        void initStats(AggregateStat* parentStat) {
-            profGETSHit.init("hGETS", "GETS hits");
-            profGETXHit.init("hGETX", "GETX hits");
-            profGETSMiss.init("mGETS", "GETS misses");
-            profGETXMissIM.init("mGETXIM", "GETX I->M misses");
-            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)");
-            profPUTS.init("PUTS", "Clean evictions (from lower level)");
-            profPUTX.init("PUTX", "Dirty evictions (from lower level)");
-            profINV.init("INV", "Invalidates (from upper level)");
-            profINVX.init("INVX", "Downgrades (from upper level)");
-            profFWD.init("FWD", "Forwards (from upper level)");
-            profGETNextLevelLat.init("latGETnl", "GET request latency on next level");
-            profGETNetLat.init("latGETnet", "GET request latency on network to next level");
+        void initStats(AggregateStat* parentStat, uint32_t shards) {
+            profGETSHit.init("hGETS", "GETS hits", shards);
+            profGETXHit.init("hGETX", "GETX hits", shards);
+            profGETSMiss.init("mGETS", "GETS misses", shards);
+            profGETXMissIM.init("mGETXIM", "GETX I->M misses", shards);
+            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)", shards);
+            profPUTS.init("PUTS", "Clean evictions (from lower level)", shards);
+            profPUTX.init("PUTX", "Dirty evictions (from lower level)", shards);
+            profINV.init("INV", "Invalidates (from upper level)", shards);
+            profINVX.init("INVX", "Downgrades (from upper level)", shards);
+            profFWD.init("FWD", "Forwards (from upper level)", shards);
+            profGETNextLevelLat.init("latGETnl", "GET request latency on next level", shards);
+            profGETNetLat.init("latGETnet", "GET request latency on network to next level", shards);
 
             parentStat->append(&profGETSHit);
             parentStat->append(&profGETXHit);
@@ -142,9 +244,11 @@ class MESIBottomCC : public GlobAlloc {
             parentStat->append(&profFWD);
             parentStat->append(&profGETNextLevelLat);
             parentStat->append(&profGETNetLat);
+            ccLocks->initStats(parentStat, "bccLock", shards);
         }
 
-        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId);
+        //flags go on the writeback; of the triggering access's flags, only WARMUP carries over to its evictions
+        uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags);
 
@@ -154,12 +258,21 @@ class MESIBottomCC : public GlobAlloc {
 
         uint64_t processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags);
 
-        inline void lock() {
-            futex_lock(&ccLock);
+        //Set sampling (see SampledCache): accesses and evictions of lines without tags or state, with the outcome
+        //(hit or miss, victim state) decided by the caller
+        uint64_t processUntrackedAccess(Address lineAddr, AccessType type, bool hit, uint64_t cycle, uint32_t srcId, uint32_t flags);
+        uint64_t processUntrackedEviction(Address wbLineAddr, MESIState victimState, uint64_t cycle, uint32_t srcId, uint32_t flags);
+
+        inline uint32_t getLockStripe(Address lineAddr) const {
+            return ccLocks->getStripe(lineAddr);
+        }
+
+        inline void lock(uint32_t stripe) {
+            ccLocks->lock(stripe);
         }
 
-        inline void unlock() {
-            futex_unlock(&ccLock);
+        inline void unlock(uint32_t stripe) {
+            ccLocks->unlock(stripe);
         }
 
         /* Replacement policy query interface */
@@ -167,6 +280,10 @@ class MESIBottomCC : public GlobAlloc {
             return array[lineId] != I;
         }
 
+        inline MESIState getState(uint32_t lineId) {
+            return array[lineId];
+        }
+
         //Could extend with isExclusive, isDirty, etc, but not needed for now.
 
     private:
@@ -177,15 +294,14 @@ class MESIBottomCC : public GlobAlloc {
 //Implements the "top" part: Keeps directory information, handles downgrades and invalidates
 class MESITopCC : public GlobAlloc {
     private:
+        //Sharer sets are kept in dir, which may be inexact; numSharers is always exact
         struct Entry {
             uint32_t numSharers;
-            std::bitset<MAX_CACHE_CHILDREN> sharers;
             bool exclusive;
 
             void clear() {
                 exclusive = false;
                 numSharers = 0;
-                sharers.reset();
             }
 
             bool isEmpty() {
@@ -198,27 +314,45 @@ class MESITopCC : public GlobAlloc {
         };
 
         Entry* array;
+        SharerDirectory* dir;
+        bool dirExact;
+        uint32_t* sharerBuf; //scratch space for dir->getSharers(), one per lock stripe
         g_vector<BaseCache*> children;
         g_vector<uint32_t> childrenRTTs;
         uint32_t numLines;
 
         bool nonInclusiveHack;
 
-        PAD();
-        lock_t ccLock;
-        PAD();
+        ShardedCounter profExtraInvs;
+
+        uint32_t lockStripes;
+        CCLocks* ccLocks;
 
     public:
-        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack) : numLines(_numLines), nonInclusiveHack(_nonInclusiveHack) {
+        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack, const CCLockConfig& lockConfig = CCLockConfig()) : dir(nullptr), dirExact(true),
+            sharerBuf(nullptr), numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), lockStripes(lockConfig.stripes)
+        {
             array = gm_calloc<Entry>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i].clear();
             }
 
-            futex_init(&ccLock);
+            ccLocks = new CCLocks(lockConfig, true /*held for whole accesses*/);
         }
 
-        void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
+        void init(const g_vector<BaseCache*>& _children, const SharerDirConfig& dirConfig, Network* network, const char* name);
+        void serialize(Checkpoint& ck);
+
+        uint32_t getNumChildren() const {return children.size();}
+
+        void initStats(AggregateStat* parentStat, uint32_t shards) {
+            dir->initStats(parentStat);
+            if (!dirExact) {
+                profExtraInvs.init("dirXInv", "Invalidates sent to non-sharers due to inexact directory", shards);
+                parentStat->append(&profExtraInvs);
+            }
+            ccLocks->initStats(parentStat, "tccLock", shards);
+        }
 
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
@@ -227,12 +361,15 @@ class MESITopCC : public GlobAlloc {
 
         uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
-        inline void lock() {
-            futex_lock(&ccLock);
+        //Set sampling (see SampledCache): untracked lines have no sharer set, so invalidates go to every child, as inexact ones
+        uint64_t sendUntrackedInvalidates(Address lineAddr, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t skipChild = -1);
+
+        inline void lock(uint32_t stripe) {
+            ccLocks->lock(stripe);
         }
 
-        inline void unlock() {
-            futex_unlock(&ccLock);
+        inline void unlock(uint32_t stripe) {
+            ccLocks->unlock(stripe);
         }
 
         /* Replacement policy query interface */
@@ -241,7 +378,7 @@ class MESITopCC : public GlobAlloc {
         }
 
     private:
-        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, uint32_t skipChild = -1);
 };
 
 static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIState initialState) {
@@ -273,33 +410,38 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
     return skipAccess;
 }
 
-// Non-terminal CC; accepts GETS/X and PUTS/X accesses
-class MESICC : public CC {
+// Non-terminal CC; accepts GETS/X and PUTS/X accesses. MESI CCs are final, so typed caches and repl policies call them directly
+class MESICC final : public CC {
     private:
         MESITopCC* tcc;
         MESIBottomCC* bcc;
         uint32_t numLines;
         bool nonInclusiveHack;
+        SharerDirConfig dirConfig;
+        CCLockConfig lockConfig;
         g_string name;
 
     public:
         //Initialization
-        MESICC(uint32_t _numLines, bool _nonInclusiveHack, g_string& _name) : tcc(nullptr), bcc(nullptr),
-            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name) {}
+        MESICC(uint32_t _numLines, bool _nonInclusiveHack, const SharerDirConfig& _dirConfig, g_string& _name, const CCLockConfig& _lockConfig = CCLockConfig())
+            : tcc(nullptr), bcc(nullptr), numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), dirConfig(_dirConfig), lockConfig(_lockConfig), name(_name) {}
 
         void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
-            bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack);
+            bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack, lockConfig);
             bcc->init(parents, network, name.c_str());
         }
 
         void setChildren(const g_vector<BaseCache*>& children, Network* network) {
-            tcc = new MESITopCC(numLines, nonInclusiveHack);
-            tcc->init(children, network, name.c_str());
+            tcc = new MESITopCC(numLines, nonInclusiveHack, lockConfig);
+            tcc->init(children, dirConfig, network, name.c_str());
         }
 
+        uint32_t getNumChildren() const {return tcc->getNumChildren();}
+        uint32_t getLockStripes() const {return lockConfig.stripes;}
+
         void initStats(AggregateStat* cacheStat) {
-            //no tcc stats
-            bcc->initStats(cacheStat);
+            bcc->initStats(cacheStat, statShards());
+            tcc->initStats(cacheStat, statShards());
         }
 
         //Access methods
@@ -314,8 +456,9 @@ class MESICC : public CC {
                 futex_unlock(req.childLock);
             }
 
-            tcc->lock(); //must lock tcc FIRST
-            bcc->lock();
+            uint32_t stripe = bcc->getLockStripe(req.lineAddr); //tcc and bcc are striped the same way
+            tcc->lock(stripe); //must lock tcc FIRST
+            bcc->lock(stripe);
 
             /* The situation is now stable, true race-wise. No one can touch the child state, because we hold
              * both parent's locks. So, we first handle races, which may cause us to skip the access.
@@ -340,7 +483,7 @@ class MESICC : public CC {
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
             bool lowerLevelWriteback = false;
             uint64_t evCycle = tcc->processEviction(wbLineAddr, lineId, &lowerLevelWriteback, startCycle, triggerReq.srcId); //1. if needed, send invalidates/downgrades to lower level
-            evCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, evCycle, triggerReq.srcId); //2. if needed, write back line to upper level
+            evCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, evCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP); //2. if needed, write back line to upper level
             return evCycle;
         }
 
@@ -385,30 +528,89 @@ class MESICC : public CC {
                 futex_lock(req.childLock);
             }
 
-            bcc->unlock();
-            tcc->unlock();
+            uint32_t stripe = bcc->getLockStripe(req.lineAddr);
+            bcc->unlock(stripe);
+            tcc->unlock(stripe);
         }
 
         //Inv methods
-        void startInv() {
-            bcc->lock(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
+        void startInv(const InvReq& req) {
+            bcc->lock(bcc->getLockStripe(req.lineAddr)); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (req.inexact && req.type == INVX && bcc->getState(lineId) == S) { //inexact downgrade of a line we already share
+                skipInv(req);
+                return startCycle;
+            }
             uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
 
-            bcc->unlock();
+            bcc->unlock(bcc->getLockStripe(req.lineAddr));
             return respCycle;
         }
 
+        void skipInv(const InvReq& req) {
+            bcc->unlock(bcc->getLockStripe(req.lineAddr));
+        }
+
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return tcc->numSharers(lineId);}
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        //Set sampling interface (see SampledCache)
+        MESIState getState(uint32_t lineId) {return bcc->getState(lineId);}
+
+        /* Access to a line in a non-simulated set, which has no tag, directory or bcc state. The caller decides
+         * whether it hits. Without sharer lists, other children are sent inexact invalidates (see InvReq), as
+         * with an inexact directory: GETX invalidates their copies, and GETS downgrades any exclusive copy and
+         * gets the line in S, so stores to untracked lines always pay an upgrade. PUTs simply drop the copy.
+         */
+        uint64_t processUntrackedAccess(const MemReq& req, bool hit, uint64_t startCycle) {
+            bool isPrefetch = req.flags & MemReq::PREFETCH;
+            uint32_t flags = req.flags & ~MemReq::PREFETCH;
+            uint64_t respCycle = bcc->processUntrackedAccess(req.lineAddr, req.type, hit, startCycle, req.srcId, flags);
+            if (isPrefetch) return respCycle;  //prefetches only touch bcc, as in processAccess
+            bool lowerLevelWriteback = false; //untracked lines have no state to dirty
+            switch (req.type) {
+                case PUTS:
+                    *req.state = I;
+                    break;
+                case PUTX:
+                    *req.state = (req.flags & MemReq::PUTX_KEEPEXCL)? E : I;
+                    break;
+                case GETS:
+                    respCycle = tcc->sendUntrackedInvalidates(req.lineAddr, INVX, &lowerLevelWriteback, respCycle, req.srcId, req.childId);
+                    *req.state = S;
+                    break;
+                case GETX:
+                    respCycle = tcc->sendUntrackedInvalidates(req.lineAddr, INV, &lowerLevelWriteback, respCycle, req.srcId, req.childId);
+                    *req.state = M;
+                    break;
+                default: panic("!?");
+            }
+            return respCycle;
+        }
+
+        //Eviction of a victim in a non-simulated set; the caller picks its address and state
+        uint64_t processUntrackedEviction(const MemReq& triggerReq, Address wbLineAddr, MESIState victimState, uint64_t startCycle) {
+            uint64_t evCycle = startCycle;
+            if (victimState != I) { //keep inclusion: children may hold the victim
+                bool lowerLevelWriteback = false;
+                evCycle = tcc->sendUntrackedInvalidates(wbLineAddr, INV, &lowerLevelWriteback, startCycle, triggerReq.srcId);
+                if (lowerLevelWriteback) victimState = M;
+            }
+            return bcc->processUntrackedEviction(wbLineAddr, victimState, evCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP);
+        }
+
+        void serialize(Checkpoint& ck) {
+            bcc->serialize(ck);
+            tcc->serialize(ck);
+        }
 };
 
 // Terminal CC, i.e., without children --- accepts GETS/X, but not PUTS/X
-class MESITerminalCC : public CC {
+class MESITerminalCC final : public CC {
     private:
         MESIBottomCC* bcc;
         uint32_t numLines;
@@ -427,8 +629,10 @@ class MESITerminalCC : public CC {
             panic("[%s] MESITerminalCC::setChildren cannot be called -- terminal caches cannot have children!", name.c_str());
         }
 
+        uint32_t getNumChildren() const {return 0;}
+
         void initStats(AggregateStat* cacheStat) {
-            bcc->initStats(cacheStat);
+            bcc->initStats(cacheStat, 1);
         }
 
         //Access methods
@@ -443,7 +647,7 @@ class MESITerminalCC : public CC {
                 futex_unlock(req.childLock);
             }
 
-            bcc->lock();
+            bcc->lock(0); //terminal caches have a single lock stripe
 
             /* The situation is now stable, true race-wise. No one can touch the child state, because we hold
              * both parent's locks. So, we first handle races, which may cause us to skip the access.
@@ -458,7 +662,7 @@ class MESITerminalCC : public CC {
 
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
             bool lowerLevelWriteback = false;
-            uint64_t endCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, startCycle, triggerReq.srcId); //2. if needed, write back line to upper level
+            uint64_t endCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, startCycle, triggerReq.srcId, triggerReq.flags & MemReq::WARMUP); //2. if needed, write back line to upper level
             return endCycle;  // critical path unaffected, but TimingCache needs it
         }
 
@@ -476,23 +680,35 @@ class MESITerminalCC : public CC {
             if (req.childLock) {
                 futex_lock(req.childLock);
             }
-            bcc->unlock();
+            bcc->unlock(0);
         }
 
         //Inv methods
-        void startInv() {
-            bcc->lock();
+        void startInv(const InvReq& req) {
+            bcc->lock(0);
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (req.inexact && req.type == INVX && bcc->getState(lineId) == S) { //inexact downgrade of a line we already share
+                skipInv(req);
+                return startCycle;
+            }
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
-            bcc->unlock();
+            bcc->unlock(0);
             return startCycle; //no extra delay in terminal caches
         }
 
+        void skipInv(const InvReq& req) {
+            bcc->unlock(0);
+        }
+
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return 0;} //no sharers
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        void serialize(Checkpoint& ck) {
+            bcc->serialize(ck);
+        }
 };
 
 #endif  // COHERENCE_CTRLS_H_
@@ -41,6 +41,9 @@
 #define POST_MORTEM 0
 //#define POST_MORTEM 1
 
+//With work stealing, max events a thread simulates on a domain before releasing it and picking the lowest-cycle domain again
+#define STEAL_SLICE_EVENTS 64
+
 bool ContentionSim::CompareEvents::operator()(TimingEvent* lhs, TimingEvent* rhs) const {
     return lhs->cycle > rhs->cycle;
 }
@@ -58,10 +61,12 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    workStealing = _workStealing;
     threadsDone = 0;
+    domainsDone = 0;
     limit = 0;
     lastLimit = 0;
     inCSim = false;
@@ -82,6 +87,10 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
         simThreads[i].firstDomain = i*numDomains/numSimThreads;
         simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        for (uint32_t d = simThreads[i].firstDomain; d < simThreads[i].supDomain; d++) {
+            futex_init(&domains[d].runLock);
+            domains[d].homeThread = i;
+        }
     }
 
     futex_init(&waitLock);
@@ -138,6 +147,11 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+        if (workStealing) {
+            new (&domains[i].profSteals) Counter();
+            domains[i].profSteals.init("steals", "Event slices simulated by a non-home thread");
+            domStat->append(&domains[i].profSteals);
+        }
         objStat->append(domStat);
     }
     parentStat->append(objStat);
@@ -157,6 +171,15 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    if (workStealing) {
+        for (uint32_t i = 0; i < numDomains; i++) {
+            DomainData& domain = domains[i];
+            domain.phaseDone = false;
+            domain.queuePrio = domain.pq.size()? domain.pq.firstCycle() : limit;
+        }
+        domainsDone = 0;
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -276,7 +299,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (workStealing) simulatePhaseThreadStealing(thid);
+        else simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
@@ -410,6 +434,71 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Work-stealing weave phase. Any thread can simulate any domain, as long as only one does it at a
+ * time (runLock). Domains only interact through crossings, which poll the source domain's curCycle,
+ * so it does not matter which thread runs a domain. Each thread prefers its home domains and picks
+ * the one with the lowest cycle, runs a bounded slice of events on it, and releases it; when none of
+ * its home domains are runnable, it steals from other threads. Stalled domains (waiting on a
+ * crossing, prio != 0) are only picked when there is nothing else to do, as in the static version.
+ */
+ContentionSim::DomainData* ContentionSim::claimDomain(uint32_t thid) {
+    DomainData* best = nullptr;
+    // Two passes: runnable domains first (home domains win ties), then stalled ones
+    for (uint32_t pass = 0; pass < 2 && !best; pass++) {
+        for (uint32_t i = 0; i < numDomains; i++) {
+            DomainData* d = &domains[i];
+            if (d->phaseDone || d->runLock || ((d->prio == 0) != (pass == 0))) continue;
+            if (!best || d->queuePrio < best->queuePrio || (d->queuePrio == best->queuePrio && d->homeThread == thid)) best = d;
+        }
+        if (best && spin_trylock(&best->runLock)) best = nullptr; //someone beat us to it, retry later
+    }
+    if (best && best->phaseDone) { //finished between our check and the lock
+        spin_unlock(&best->runLock);
+        best = nullptr;
+    }
+    return best;
+}
+
+void ContentionSim::simulatePhaseThreadStealing(uint32_t thid) {
+    while (domainsDone < numDomains) {
+        DomainData* domain = claimDomain(thid);
+        if (!domain) {
+            _mm_pause();
+            continue;
+        }
+
+        if (domain->homeThread != thid) domain->profSteals.inc();
+        domain->profTime.start();
+        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+        for (uint32_t ev = 0; ev < STEAL_SLICE_EVENTS; ev++) {
+            if (!pq.size() || pq.firstCycle() > limit) {
+                domain->curCycle = limit;
+                domain->phaseDone = true;
+                __sync_fetch_and_add(&domainsDone, 1);
+                break;
+            }
+
+            bool stalled = domain->prio != 0;
+            uint64_t cycle;
+            TimingEvent* te = pq.dequeue(cycle);
+            if (cycle != domain->curCycle) domain->curCycle = cycle;
+            if (stalled) {
+                te->state = EV_RUNNING;
+                te->simulate(cycle);
+            } else {
+                te->run(cycle);
+            }
+            domain->curCycle = pq.size()? pq.firstCycle() : limit;
+            domain->queuePrio = domain->curCycle;
+            if (domain->prio != 0) break; //waiting on a crossing, let the source domain make progress
+        }
+        domain->profTime.end();
+        spin_unlock(&domain->runLock);
+    }
+
+    __sync_synchronize();
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -74,9 +74,15 @@ class ContentionSim : public GlobAlloc {
             uint32_t prio;
             uint64_t queuePrio;
 
+            //Work-stealing mode only
+            lock_t runLock; //held by the sim thread currently running this domain
+            volatile bool phaseDone; //no more events before limit in this phase
+            uint32_t homeThread;
+
             PAD();
 
             ClockStat profTime;
+            Counter profSteals;
 
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
@@ -106,6 +112,7 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool workStealing; //if set, idle sim threads pick up runnable domains from other threads
 
         PAD();
 
@@ -117,6 +124,7 @@ class ContentionSim : public GlobAlloc {
 
         volatile uint32_t threadsDone;
         volatile uint32_t threadTicket; //used only at init
+        volatile uint32_t domainsDone; //used only with work stealing
 
         volatile bool inCSim; //true when inside contention simulation
 
@@ -126,7 +134,7 @@ class ContentionSim : public GlobAlloc {
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing = false);
 
         void initStats(AggregateStat* parentStat);
 
@@ -162,6 +170,8 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void simulatePhaseThreadStealing(uint32_t thid);
+        DomainData* claimDomain(uint32_t thid);
 
         static void SimThreadTrampoline(void* arg);
 };
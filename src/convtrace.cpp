@@ -0,0 +1,61 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Converts an access trace between formats. The input format is detected, and the output
+ * format follows the output file name (native for .ztrace, HDF5 otherwise).
+ */
+
+#include <stdio.h>
+
+#include "access_tracing.h"
+#include "galloc.h"
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc != 3) {
+        info("Converts an access trace between the HDF5 and native formats");
+        info("Usage: %s <input_trace> <output_trace>", argv[0]);
+        exit(1);
+    }
+
+    gm_init(32<<20 /*32 MB --- should be enough*/);
+
+    AccessTraceReader* tr = new AccessTraceReader(argv[1]);
+    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], tr->getNumChildren());
+    info("Converting %ld records, %s -> %s", tr->getNumRecords(), TraceFormatName(tr->getFormat()), TraceFormatName(TraceFormatForFile(argv[2])));
+
+    uint64_t records = 0;
+    while (!tr->empty()) {
+        AccessRecord acc = tr->read();
+        tw->write(acc);
+        records++;
+    }
+    assert(records == tr->getNumRecords());
+
+    delete tr;
+    tw->dump(false); //flushes it
+    delete tw;
+    return 0;
+}
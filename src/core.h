@@ -31,6 +31,8 @@
 #include "g_std/g_string.h"
 #include "stats.h"
 
+class Checkpoint;
+
 struct BblInfo {
     uint32_t instrs;
     uint32_t bytes;
@@ -84,6 +86,13 @@ class Core : public GlobAlloc {
         virtual void leave() {}
         virtual void join() {}
 
+        //Saves or restores warm state, e.g., predictors (see checkpoint.h)
+        virtual void serialize(Checkpoint& ck) {}
+
+        //Untimed data access through this core's caches, to warm them up while a thread fast-forwards.
+        //Called by threads not running on this core, so it must not touch timing state. Cores without caches ignore it.
+        virtual void warmAccess(ADDRINT addr, bool isLoad) {}
+
         virtual InstrFuncPtrs GetFuncPtrs() = 0;
 };
 
@@ -234,7 +234,7 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
-    latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); memStats->append(&latencyHist);
+    latencyHist.init("mlh", "latency histogram for memory requests", LH_LINEAR, LH_OCTAVES); memStats->append(&latencyHist);
     parentStat->append(memStats);
 }
 
@@ -261,7 +261,7 @@ uint64_t DDRMemory::access(MemReq& req) {
     } else {
         bool isWrite = (req.type == PUTX);
         uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency);
-        if (zinfo->eventRecorders[req.srcId]) {
+        if (zinfo->eventRecorders[req.srcId] && !req.is(MemReq::WARMUP)) {
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
                     isWrite, req.lineAddr, domain, preDelay, isWrite? postDelayWr : postDelayRd);
             memEv->setMinStartCycle(req.cycle);
@@ -613,8 +613,7 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         profReads.inc();
         profTotalRdLat.inc(scDelay);
         if (rowHit) profReadHits.inc();
-        uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
-        latencyHist.inc(bucket, 1);
+        latencyHist.inc(scDelay);
     } else {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
         profWrites.inc();
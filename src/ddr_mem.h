@@ -237,8 +237,8 @@ class DDRMemory : public MemObject {
         Counter profReads, profWrites;
         Counter profTotalRdLat, profTotalWrLat;
         Counter profReadHits, profWriteHits;  // row buffer hits
-        VectorCounter latencyHist;
-        static const uint32_t BINSIZE = 10, NUMBINS = 100;
+        Histogram latencyHist;
+        static const uint32_t LH_LINEAR = 16, LH_OCTAVES = 12;  // exact up to 16 cycles, <=12.5% bins up to 64K cycles
         PAD();
 
         //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
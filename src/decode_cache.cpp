@@ -0,0 +1,182 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decode_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+
+#define DECODE_CACHE_MAGIC 0x434345444d49535aul  // "ZSIMDECC"
+#define DECODE_CACHE_VERSION 1
+
+struct DecodeCacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t uopBytes;
+    uint32_t pinRegs;
+    uint32_t entries;
+};
+
+DecodeCache::DecodeCache(uint32_t _numBuckets) : numBuckets(_numBuckets), entries(0) {
+    assert_msg(numBuckets && (numBuckets & (numBuckets - 1)) == 0, "DecodeCache buckets must be a power of 2, %d", numBuckets);
+    buckets = gm_calloc<Entry*>(numBuckets);
+    futex_init(&lock);
+}
+
+void DecodeCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* dcStat = new AggregateStat();
+    dcStat->init("decodeCache", "Decoded BBL cache stats");
+    profHits.init("hits", "BBLs instrumented with cached uops");
+    profMisses.init("misses", "BBLs decoded and added to the cache");
+    profLoaded.init("loaded", "Entries loaded from the cache file");
+    dcStat->append(&profHits);
+    dcStat->append(&profMisses);
+    dcStat->append(&profLoaded);
+    parentStat->append(dcStat);
+}
+
+uint64_t DecodeCache::hashCode(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset) {
+    //FNV-1a; the alignment is hashed as an extra byte
+    uint64_t h = 0xcbf29ce484222325ul;
+    for (uint32_t i = 0; i < codeBytes; i++) h = (h ^ code[i]) * 0x100000001b3ul;
+    return (h ^ alignOffset) * 0x100000001b3ul;
+}
+
+DecodeCache::Entry* DecodeCache::findLocked(uint64_t hash, const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset) const {
+    for (Entry* e = buckets[hash & (numBuckets - 1)]; e; e = e->next) {
+        if (e->hash == hash && e->codeBytes == codeBytes && e->alignOffset == alignOffset && memcmp(e->code(), code, codeBytes) == 0) {
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+void DecodeCache::insertLocked(Entry* e) {
+    uint32_t b = e->hash & (numBuckets - 1);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entries++;
+}
+
+const DecodeCache::Entry* DecodeCache::find(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset) {
+    uint64_t hash = hashCode(code, codeBytes, alignOffset);
+    futex_lock(&lock);
+    //Entries are immutable once inserted, so they can be read after unlocking
+    Entry* e = findLocked(hash, code, codeBytes, alignOffset);
+    if (e) profHits.inc();
+    futex_unlock(&lock);
+    return e;
+}
+
+void DecodeCache::insert(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset, const DynBbl& bbl) {
+    uint64_t hash = hashCode(code, codeBytes, alignOffset);
+    futex_lock(&lock);
+    if (!findLocked(hash, code, codeBytes, alignOffset)) {
+        profMisses.inc();
+        Entry* e = static_cast<Entry*>(gm_malloc(Entry::bytes(bbl.uops, codeBytes)));
+        e->hash = hash;
+        e->codeBytes = codeBytes;
+        e->alignOffset = alignOffset;
+        e->uops = bbl.uops;
+        e->approxInstrs = bbl.approxInstrs;
+        memcpy(e->uop, bbl.uop, bbl.uops*sizeof(DynUop));
+        memcpy(const_cast<uint8_t*>(e->code()), code, codeBytes);
+        insertLocked(e);
+    }
+    futex_unlock(&lock);
+}
+
+void DecodeCache::load(const char* file) {
+    FILE* f = fopen(file, "r");
+    if (!f) {
+        info("Decode cache file %s not found, starting with an empty cache", file);
+        return;
+    }
+
+    DecodeCacheHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != DECODE_CACHE_MAGIC) {
+        warn("%s is not a decode cache file, ignoring it", file);
+    } else if (hdr.version != DECODE_CACHE_VERSION || hdr.uopBytes != sizeof(DynUop) || hdr.pinRegs != (uint32_t)REG_LAST) {
+        warn("Decode cache file %s was written by a different decoder or Pin version, ignoring it", file);
+    } else {
+        futex_lock(&lock);
+        uint32_t read = 0;
+        uint32_t loaded = 0;
+        for (; read < hdr.entries; read++) {
+            Entry e;
+            if (fread(&e, sizeof(Entry), 1, f) != 1) break;
+            Entry* ne = static_cast<Entry*>(gm_malloc(Entry::bytes(e.uops, e.codeBytes)));
+            *ne = e;
+            size_t payload = Entry::bytes(e.uops, e.codeBytes) - sizeof(Entry);
+            if (fread(ne->uop, 1, payload, f) != payload) {
+                gm_free(ne);
+                break;
+            }
+            if (ne->hash != hashCode(ne->code(), ne->codeBytes, ne->alignOffset)) { //corrupt, stop here
+                gm_free(ne);
+                break;
+            }
+            if (findLocked(ne->hash, ne->code(), ne->codeBytes, ne->alignOffset)) { //duplicate, skip it
+                gm_free(ne);
+                continue;
+            }
+            insertLocked(ne);
+            loaded++;
+        }
+        profLoaded.inc(loaded);
+        futex_unlock(&lock);
+        if (read == hdr.entries) {
+            info("Loaded %d decoded BBLs from %s (%d duplicates skipped)", loaded, file, read - loaded);
+        } else {
+            warn("Decode cache file %s is truncated or corrupt, loaded %d of %d entries", file, loaded, hdr.entries);
+        }
+    }
+    fclose(f);
+}
+
+void DecodeCache::save(const char* file) {
+    FILE* f = fopen(file, "w");
+    if (!f) {
+        warn("Could not open decode cache file %s for writing, not saving it", file);
+        return;
+    }
+
+    futex_lock(&lock);
+    DecodeCacheHeader hdr = {DECODE_CACHE_MAGIC, DECODE_CACHE_VERSION, (uint32_t)sizeof(DynUop), (uint32_t)REG_LAST, entries};
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (uint32_t b = 0; b < numBuckets && ok; b++) {
+        for (Entry* e = buckets[b]; e && ok; e = e->next) {
+            ok = fwrite(e, Entry::bytes(e->uops, e->codeBytes), 1, f) == 1;
+        }
+    }
+    futex_unlock(&lock);
+
+    if (fclose(f) != 0) ok = false;
+    if (ok) {
+        info("Saved %d decoded BBLs to %s", hdr.entries, file);
+    } else {
+        warn("Error writing decode cache file %s", file);
+    }
+}
@@ -0,0 +1,88 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODE_CACHE_H_
+#define DECODE_CACHE_H_
+
+#include <stdint.h>
+#include "decoder.h"
+#include "galloc.h"
+#include "locks.h"
+#include "stats.h"
+
+/* Content-addressed cache of OOO-decoded BBLs, shared by all simulated processes.
+ *
+ * Decoder::decodeBbl's uops depend only on the BBL's instruction bytes and on its offset within a
+ * 16-byte block (predecoding is modeled on aligned 16-byte windows), so the libc, libstdc++ and loader
+ * BBLs that every process runs are decoded once per run. The cache lives in the global heap and never
+ * evicts. It can be loaded from and saved to a file, so later runs skip most decoding. Files record a
+ * format version, sizeof(DynUop) and the number of Pin registers (uops name Pin REGs), and are ignored
+ * if any of them differs; bump DECODE_CACHE_VERSION whenever the decoder's output changes.
+ */
+class DecodeCache : public GlobAlloc {
+    public:
+        struct Entry {
+            Entry* next;
+            uint64_t hash;
+            uint32_t codeBytes;
+            uint32_t alignOffset;
+            uint32_t uops;
+            uint32_t approxInstrs;
+            DynUop uop[0]; //followed by the BBL's instruction bytes
+
+            const uint8_t* code() const {return reinterpret_cast<const uint8_t*>(&uop[uops]);}
+            static uint32_t bytes(uint32_t uops, uint32_t codeBytes) {return sizeof(Entry) + uops*sizeof(DynUop) + codeBytes;}
+        };
+
+    private:
+        Entry** buckets;
+        uint32_t numBuckets; //power of 2
+        uint32_t entries;
+        lock_t lock;
+
+        Counter profHits, profMisses, profLoaded;
+
+    public:
+        explicit DecodeCache(uint32_t _numBuckets);
+
+        void initStats(AggregateStat* parentStat);
+
+        //Returns the entry of a BBL with these instruction bytes and alignment, or nullptr if not cached
+        const Entry* find(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset);
+
+        //Adds a decoded BBL; if another process added it since our find(), keeps that entry
+        void insert(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset, const DynBbl& bbl);
+
+        //A missing or stale file leaves the cache empty
+        void load(const char* file);
+        void save(const char* file);
+
+    private:
+        static uint64_t hashCode(const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset);
+        Entry* findLocked(uint64_t hash, const uint8_t* code, uint32_t codeBytes, uint32_t alignOffset) const;
+        void insertLocked(Entry* e);
+};
+
+#endif  // DECODE_CACHE_H_
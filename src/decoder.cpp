@@ -32,8 +32,10 @@
 #include <string>
 #include <vector>
 #include "core.h"
+#include "decode_cache.h"
 #include "locks.h"
 #include "log.h"
+#include "zsim.h"
 
 extern "C" {
 #include "xed-interface.h"
@@ -1263,7 +1265,33 @@ BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     uint32_t bytes = BBL_Size(bbl);
     BblInfo* bblInfo;
 
-    if (oooDecoding) {
+    //Look up the shared decode cache, keyed by the BBL's instruction bytes (see decode_cache.h)
+    DecodeCache* decodeCache = oooDecoding? zinfo->decodeCache : nullptr;
+#ifdef BBL_PROFILING
+    decodeCache = nullptr; //every decoded BBL needs its own bblIdx
+#endif
+    std::vector<uint8_t> code;
+    uint32_t alignOffset = BBL_Address(bbl) & 0xf;
+    const DecodeCache::Entry* cached = nullptr;
+    if (decodeCache) {
+        code.resize(bytes);
+        if (PIN_SafeCopy(&code[0], (VOID*)BBL_Address(bbl), bytes) == bytes) {
+            cached = decodeCache->find(&code[0], bytes, alignOffset);
+        } else {
+            decodeCache = nullptr; //unreadable code, do not cache
+        }
+    }
+
+    if (cached) {
+        uint32_t objBytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(cached->uops);
+        bblInfo = static_cast<BblInfo*>(gm_malloc(objBytes));  // can't use type-safe interface
+
+        DynBbl& dynBbl = bblInfo->oooBbl[0];
+        dynBbl.addr = BBL_Address(bbl);
+        dynBbl.uops = cached->uops;
+        dynBbl.approxInstrs = cached->approxInstrs;
+        for (uint32_t i = 0; i < dynBbl.uops; i++) dynBbl.uop[i] = cached->uop[i];
+    } else if (oooDecoding) {
         //Decode BBL
         uint32_t approxInstrs = 0;
         uint32_t curIns = 0;
@@ -1428,6 +1456,8 @@ BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
         dynBbl.approxInstrs = approxInstrs;
         for (uint32_t i = 0; i < dynBbl.uops; i++) dynBbl.uop[i] = uopVec[i];
 
+        if (decodeCache) decodeCache->insert(&code[0], bytes, alignOffset, dynBbl);
+
 #ifdef BBL_PROFILING
         futex_lock(&bblIdxLock);
         dynBbl.bblIdx = bblIdx++;
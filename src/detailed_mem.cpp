@@ -1122,7 +1122,7 @@ uint64_t MemControllerBase::access(MemReq& req) {
     uint64_t respCycle = req.cycle + minLatency[accessType];
     assert(respCycle >= req.cycle);
 
-    if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+    if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId] && !req.is(MemReq::WARMUP)) {
         Address addr = req.lineAddr;
         MemAccessEventBase* memEv =
             new (zinfo->eventRecorders[req.srcId])
@@ -1196,9 +1196,7 @@ void MemControllerBase::initStats(AggregateStat* parentStat) {
     profTotalWrLat.init("wrlat", "Total latency experienced by write requests");
     memStats->append(&profTotalWrLat);
 
-    lhBinSize = 10;
-    lhNumBins = 200;
-    latencyHist.init("mlh","latency histogram for memory requests", lhNumBins);
+    latencyHist.init("mlh","latency histogram for memory requests", 16, 12);
     memStats->append(&latencyHist);
 
     parentStat->append(memStats);
@@ -1288,8 +1286,7 @@ uint64_t MemControllerBase::LatencySimulate(Address lineAddr, uint64_t sysCycle,
     assert_msg(sysLatency  >= (memMinLatency[type]),
                "Memory Model returned lower latency than memMinLatency! latency = %ld, memMinLatency = %d",
                sysLatency, memMinLatency[type]);
-    uint32_t bin = std::min(sysLatency/lhBinSize, (uint64_t)(lhNumBins-1));
-    latencyHist.inc(bin);
+    latencyHist.inc(sysLatency);
 
     if (addrTraceLog != nullptr)
         gzwrite(addrTraceLog, (char*)&lineAddr, sizeof(uint64_t));
@@ -282,9 +282,7 @@ class MemControllerBase : public MemObject {
         Counter profWrites;
         Counter profTotalRdLat;
         Counter profTotalWrLat;
-        VectorCounter latencyHist;
-        uint32_t lhBinSize;
-        uint32_t lhNumBins;
+        Histogram latencyHist;
 
         Counter profActivate;
         Counter profPrecharge;
@@ -35,7 +35,7 @@
 int main(int argc, const char* argv[]) {
     InitLog(""); //no log header
     if (argc != 2) {
-        info("Prints an access trace");
+        info("Prints an access trace (HDF5 or native format)");
         info("Usage: %s <trace>", argv[0]);
         exit(1);
     }
@@ -99,6 +99,12 @@ class FilterCache : public Cache {
             parentStat->append(cacheStat);
         }
 
+        void serialize(Checkpoint& ck) {
+            Cache::serialize(ck);
+            //Filter entries hold virtual addresses and cycles, so just drop them; they refill on the next accesses
+            if (ck.restoring()) contextSwitch();
+        }
+
         inline uint64_t load(Address vAddr, uint64_t curCycle) {
             Address vLineAddr = vAddr >> lineBits;
             uint32_t idx = vLineAddr & setMask;
@@ -148,8 +154,23 @@ class FilterCache : public Cache {
             return respCycle;
         }
 
+        //Untimed access to warm up the hierarchy while fast-forwarding (see MemReq::WARMUP). The caller
+        //may not be the thread running on this core, so it only clears the set's filter entry, as invalidate() does
+        void warm(Address vAddr, bool isLoad, uint64_t curCycle) {
+            Address vLineAddr = vAddr >> lineBits;
+            uint32_t idx = vLineAddr & setMask;
+            Address pLineAddr = procMask | vLineAddr;
+            MESIState dummyState = MESIState::I;
+            futex_lock(&filterLock);
+            MemReq req = {pLineAddr, isLoad? GETS : GETX, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, reqFlags | MemReq::WARMUP};
+            access(req);
+            filterArray[idx].wrAddr = -1L;
+            filterArray[idx].rdAddr = -1L;
+            futex_unlock(&filterLock);
+        }
+
         uint64_t invalidate(const InvReq& req) {
-            Cache::startInvalidate();  // grabs cache's downLock
+            Cache::startInvalidate(req);  // grabs cache's downLock
             futex_lock(&filterLock);
             uint32_t idx = req.lineAddr & setMask; //works because of how virtual<->physical is done...
             if ((filterArray[idx].rdAddr | procMask) == req.lineAddr) { //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
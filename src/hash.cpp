@@ -26,6 +26,7 @@
 #include "hash.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include "bithacks.h"
 #include "log.h"
 #include "mtrand.h"
 
@@ -59,10 +60,26 @@ H3HashFamily::H3HashFamily(uint32_t numFunctions, uint32_t outputBits, uint64_t
             hMatrix[ii*words + jj] = val;
         }
     }
+
+    //Byte tables for hashes(). Since the hash is linear, hash(id, val) = XOR_b hash(id, byte b of val)
+    uint32_t funcsPerEntry = 1 << resShift;
+    uint32_t numEntries = (numFuncs + funcsPerEntry - 1)/funcsPerEntry;
+    uint64_t outMask = (words == 64)? ((uint64_t)-1L) : ((1ul << words) - 1);
+    byteTables = gm_calloc<uint64_t>(numEntries*8*256);
+    for (uint32_t ii = 0; ii < numFuncs; ii++) {
+        uint64_t* tables = &byteTables[(ii/funcsPerEntry)*8*256];
+        uint32_t shift = (ii % funcsPerEntry)*words;
+        for (uint32_t b = 0; b < 8; b++) {
+            for (uint64_t v = 0; v < 256; v++) {
+                tables[b*256 + v] |= (hash(ii, v << (8*b)) & outMask) << shift;
+            }
+        }
+    }
 }
 
 H3HashFamily::~H3HashFamily() {
     gm_free(hMatrix);
+    gm_free(byteTables);
 }
 
 /* NOTE: This is fairly well hand-optimized. Go to the commit logs to see the speedup of this function. Main things:
@@ -123,6 +140,25 @@ uint64_t H3HashFamily::hash(uint32_t id, uint64_t val) {
     return res;
 }
 
+void H3HashFamily::hashes(uint64_t val, uint32_t n, uint64_t* res) {
+    assert(n <= numFuncs);
+    uint32_t outBits = 64 >> resShift;
+    uint32_t funcsPerEntry = 1 << resShift;
+    uint64_t outMask = (outBits == 64)? ((uint64_t)-1L) : ((1ul << outBits) - 1);
+    for (uint32_t first = 0; first < n; first += funcsPerEntry) {
+        const uint64_t* tables = &byteTables[(first/funcsPerEntry)*8*256];
+        uint64_t entry = tables[val & 0xff] ^ tables[256 + ((val >> 8) & 0xff)] ^
+            tables[2*256 + ((val >> 16) & 0xff)] ^ tables[3*256 + ((val >> 24) & 0xff)] ^
+            tables[4*256 + ((val >> 32) & 0xff)] ^ tables[5*256 + ((val >> 40) & 0xff)] ^
+            tables[6*256 + ((val >> 48) & 0xff)] ^ tables[7*256 + (val >> 56)];
+        uint32_t last = MIN(n, first + funcsPerEntry);
+        for (uint32_t id = first; id < last; id++) {
+            res[id] = entry & outMask;
+            entry = (outBits == 64)? 0 : (entry >> outBits);
+        }
+    }
+}
+
 #if _WITH_POLARSSL_
 
 #include "polarssl/sha1.h"
@@ -163,6 +199,12 @@ uint64_t SHA1HashFamily::hash(uint32_t id, uint64_t val) {
     }
 }
 
+void SHA1HashFamily::hashes(uint64_t val, uint32_t n, uint64_t* res) {
+    assert(n <= (uint32_t)numFuncs);
+    hash(0, val);  // memoizes all the hashes of val
+    for (uint32_t id = 0; id < n; id++) res[id] = memoizedHashes[id];
+}
+
 #else  // _WITH_POLARSSL_
 
 SHA1HashFamily::SHA1HashFamily(int numFunctions) {
@@ -174,4 +216,8 @@ uint64_t SHA1HashFamily::hash(uint32_t id, uint64_t val) {
     return 0;
 }
 
+void SHA1HashFamily::hashes(uint64_t val, uint32_t n, uint64_t* res) {
+    panic("???");
+}
+
 #endif  // _WITH_POLARSSL_
@@ -35,6 +35,14 @@ class HashFamily : public GlobAlloc {
         virtual ~HashFamily() {}
 
         virtual uint64_t hash(uint32_t id, uint64_t val) = 0;
+
+        /* Computes hash functions [0, n) of val in one call (e.g., the hashes of all the ways of a zcache).
+         * Results match hash()'s in the output bits the family was built with; higher bits may differ,
+         * so callers must mask them, as with hash().
+         */
+        virtual void hashes(uint64_t val, uint32_t n, uint64_t* res) {
+            for (uint32_t id = 0; id < n; id++) res[id] = hash(id, val);
+        }
 };
 
 class H3HashFamily : public HashFamily {
@@ -42,10 +50,16 @@ class H3HashFamily : public HashFamily {
         const uint32_t numFuncs;
         uint32_t resShift;
         uint64_t* hMatrix;
+
+        //For hashes(): H3 is linear, so we tabulate the hash of each value of each input byte. Each table entry
+        //packs the outputs of 1<<resShift functions, so all the hashes of an address take 8 lookups per entry
+        uint64_t* byteTables;
+
     public:
         H3HashFamily(uint32_t numFunctions, uint32_t outputBits, uint64_t randSeed = 123132127);
         virtual ~H3HashFamily();
         uint64_t hash(uint32_t id, uint64_t val);
+        void hashes(uint64_t val, uint32_t n, uint64_t* res);
 };
 
 class SHA1HashFamily : public HashFamily {
@@ -59,12 +73,16 @@ class SHA1HashFamily : public HashFamily {
     public:
         explicit SHA1HashFamily(int numFunctions);
         uint64_t hash(uint32_t id, uint64_t val);
+        void hashes(uint64_t val, uint32_t n, uint64_t* res);
 };
 
 /* Used when we don't want hashing, just return the value */
 class IdHashFamily : public HashFamily {
     public:
         inline uint64_t hash(uint32_t id, uint64_t val) {return val;}
+        inline void hashes(uint64_t val, uint32_t n, uint64_t* res) {
+            for (uint32_t id = 0; id < n; id++) res[id] = val;
+        }
 };
 
 #endif  // HASH_H_
@@ -95,6 +95,13 @@ class HDF5BackendImpl : public GlobAlloc {
                 }
             } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
                 *(curPtr++) = ss->get();
+            } else if (Histogram* hs = dynamic_cast<Histogram*>(s)) {
+                // Must match getBaseH5Type's layout
+                *(curPtr++) = hs->samples();
+                *(curPtr++) = hs->sum();
+                for (uint32_t i = 0; i < hs->size(); i++) {
+                    *(curPtr++) = hs->count(i);
+                }
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
                 for (uint32_t i = 0; i < vs->size(); i++) {
                     *(curPtr++) = vs->count(i);
@@ -185,6 +192,17 @@ class HDF5BackendImpl : public GlobAlloc {
         hid_t getBaseH5Type(Stat* s) {
             assert(dynamic_cast<AggregateStat*>(s) == nullptr); //this can't be an aggregate
             hid_t res;
+            if (Histogram* hs = dynamic_cast<Histogram*>(s)) {
+                // Histograms are a {samples, sum, buckets[]} compound
+                hsize_t dims[] = {hs->size()};
+                hid_t bucketsType = deduplicateH5Type(H5Tarray_create2(H5T_NATIVE_ULONG, 1 /*rank*/, dims));
+                size_t ulSize = H5Tget_size(H5T_NATIVE_ULONG);
+                res = H5Tcreate(H5T_COMPOUND, 2*ulSize + H5Tget_size(bucketsType));
+                H5Tinsert(res, "samples", 0, H5T_NATIVE_ULONG);
+                H5Tinsert(res, "sum", ulSize, H5T_NATIVE_ULONG);
+                H5Tinsert(res, "buckets", 2*ulSize, bucketsType);
+                return deduplicateH5Type(res);
+            }
             uint32_t size = 1; //scalar by default
             if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
                 size = vs->size();
@@ -27,16 +27,77 @@
 #define IDEAL_ARRAYS_H_
 
 #include "cache_arrays.h"
-#include "g_std/g_unordered_map.h"
-#include "intrusive_list.h"
+#include "line_index.h"
 #include "part_repl_policies.h"
 #include "repl_policies.h"
 
 /* Fully associative cache arrays with LRU replacement (non-part; part coming up) */
 
-//We use a combination of a hash table and an intrusive list to perform fully-associative lookups and insertions in O(1) time
+//We use a combination of a preallocated hash index (see LineIndex) and index-linked LRU lists to perform
+//fully-associative lookups and insertions in O(1) time, without allocating memory after construction
 //TODO: Post-deadline, make it a single array with a rank(req) interface
 
+/* LRU lists of line ids, doubly linked by index in a flat array. Several lists can share the nodes
+ * (e.g., one list per partition); each line is in exactly one list. List l's sentinel is node numLines + l.
+ */
+class IdxLRULists : public GlobAlloc {
+    private:
+        struct Node {
+            uint32_t prev;
+            uint32_t next;
+        };
+
+        Node* nodes;
+        uint32_t* sizes;
+        uint32_t numLines;
+        uint32_t numLists;
+
+    public:
+        IdxLRULists(uint32_t _numLines, uint32_t _numLists) : numLines(_numLines), numLists(_numLists) {
+            nodes = gm_calloc<Node>(numLines + numLists);
+            sizes = gm_calloc<uint32_t>(numLists);
+            for (uint32_t l = 0; l < numLists; l++) {
+                uint32_t s = numLines + l;
+                nodes[s].prev = s;
+                nodes[s].next = s;
+            }
+        }
+
+        inline void pushFront(uint32_t list, uint32_t id) {
+            assert(list < numLists && id < numLines);
+            uint32_t s = numLines + list;
+            uint32_t first = nodes[s].next;
+            nodes[id].prev = s;
+            nodes[id].next = first;
+            nodes[first].prev = id;
+            nodes[s].next = id;
+            sizes[list]++;
+        }
+
+        inline void remove(uint32_t list, uint32_t id) {
+            assert(list < numLists && id < numLines && sizes[list]);
+            Node& n = nodes[id];
+            nodes[n.prev].next = n.next;
+            nodes[n.next].prev = n.prev;
+            sizes[list]--;
+        }
+
+        inline void moveToFront(uint32_t list, uint32_t id) {
+            uint32_t s = numLines + list;
+            if (nodes[s].next == id) return;
+            remove(list, id);
+            pushFront(list, id);
+        }
+
+        //Least recently used line of the list; the list must not be empty
+        inline uint32_t back(uint32_t list) const {
+            assert(sizes[list]);
+            return nodes[numLines + list].prev;
+        }
+
+        inline uint32_t size(uint32_t list) const {return sizes[list];}
+};
+
 class IdealLRUArray : public CacheArray {
     private:
         //We need a fake replpolicy and just want the CC...
@@ -54,60 +115,48 @@ class IdealLRUArray : public CacheArray {
                 DECL_RANK_BINDINGS
         };
 
-        struct Entry : InListNode<Entry> {
-            Address lineAddr;
-            const uint32_t lineId;
-            explicit Entry(uint32_t _lineId) : lineAddr(0), lineId(_lineId) {}
-        };
-
-        Entry* array;
-        InList<Entry> lruList;
-        g_unordered_map<Address, uint32_t> lineMap; //address->lineId; if too slow, try an AATree, which does not alloc dynamically
+        Address* lineAddrs; //lineId -> address, for replacements
+        IdxLRULists lruList;
+        LineIndex lineMap; //address->lineId
 
         uint32_t numLines;
         ProxyReplPolicy* rp;
         CC* cc;
 
     public:
-        explicit IdealLRUArray(uint32_t _numLines) : numLines(_numLines), cc(nullptr) {
-            array = gm_calloc<Entry>(numLines);
+        explicit IdealLRUArray(uint32_t _numLines) : lruList(_numLines, 1), lineMap(_numLines), numLines(_numLines), cc(nullptr) {
+            lineAddrs = gm_calloc<Address>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
-                Entry* e = new (&array[i]) Entry(i);
-                lruList.push_front(e);
+                lruList.pushFront(0, i);
             }
             rp = new ProxyReplPolicy(this);
         }
 
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
-            g_unordered_map<Address, uint32_t>::iterator it = lineMap.find(lineAddr);
-            if (it == lineMap.end()) return -1;
+            int32_t lineId = lineMap.find(lineAddr);
+            if (lineId == -1) return -1;
 
-            uint32_t lineId = it->second;
             if (updateReplacement) {
-                lruList.remove(&array[lineId]);
-                lruList.push_front(&array[lineId]);
+                lruList.moveToFront(0, lineId);
             }
             return lineId;
         }
 
         uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
-            Entry* e = lruList.back();
-            *wbLineAddr = e->lineAddr;
-            return e->lineId;
+            uint32_t lineId = lruList.back(0);
+            *wbLineAddr = lineAddrs[lineId];
+            return lineId;
         }
 
         void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) {
-            Entry* e = &array[lineId];
-
             //Update addr mapping for lineId
-            lineMap.erase(e->lineAddr);
-            assert((lineMap.find(lineAddr) == lineMap.end()));
-            e->lineAddr = lineAddr;
-            lineMap[lineAddr] = lineId;
+            lineMap.erase(lineAddrs[lineId], lineId);
+            assert(lineMap.find(lineAddr) == -1);
+            lineAddrs[lineId] = lineAddr;
+            lineMap.insert(lineAddr, lineId);
 
             //Update repl
-            lruList.remove(e);
-            lruList.push_front(e);
+            lruList.moveToFront(0, lineId);
         }
 
         ReplPolicy* getRP() const {return rp;}
@@ -117,19 +166,14 @@ class IdealLRUArray : public CacheArray {
 //Goes with IdealLRUPartArray
 class IdealLRUPartReplPolicy : public PartReplPolicy {
     protected:
-        struct Entry : InListNode<Entry> {
-            const uint32_t lineId;
+        struct Entry {
             uint32_t p;
             bool used; //careful, true except when just evicted, even if invalid
-            Entry(uint32_t _id, uint32_t _p) : lineId(_id), p(_p), used(true) {}
-        };
-
-        struct IdPartInfo : public PartInfo {
-            InList<Entry> lruList;
         };
 
         Entry* array;
-        IdPartInfo* partInfo;
+        PartInfo* partInfo;
+        IdxLRULists* lruLists; //one per partition
         uint32_t partitions;
         uint32_t numLines;
         uint32_t numBuckets;
@@ -137,18 +181,20 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
     public:
         IdealLRUPartReplPolicy(PartitionMonitor* _monitor, PartMapper* _mapper, uint32_t _numLines, uint32_t _numBuckets) : PartReplPolicy(_monitor, _mapper), numLines(_numLines), numBuckets(_numBuckets) {
             partitions = mapper->getNumPartitions();
-            partInfo = gm_calloc<IdPartInfo>(partitions);
+            partInfo = gm_calloc<PartInfo>(partitions);
 
-            for (uint32_t p = 0; p <= partitions; p++) {
-                new (&partInfo[p]) IdPartInfo();
+            for (uint32_t p = 0; p < partitions; p++) {
+                new (&partInfo[p]) PartInfo();
                 partInfo[p].targetSize = numLines/partitions;
                 partInfo[p].size = 0;
             }
 
+            lruLists = new IdxLRULists(numLines, partitions);
             array = gm_calloc<Entry>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
-                Entry* e = new (&array[i]) Entry(i, 0);
-                partInfo[0].lruList.push_front(e);
+                array[i].p = 0;
+                array[i].used = true;
+                lruLists->pushFront(0, i);
                 partInfo[0].size++;
             }
         }
@@ -170,6 +216,7 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
                 partInfo[p].profExtEvictions.init("extEvs", "Evictions caused by others (in transients)"); partStat->append(&partInfo[p].profExtEvictions);
                 rpStat->append(partStat);
             }
+            monitor->initStats(rpStat);
             parentStat->append(rpStat);
         }
 
@@ -183,8 +230,7 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
             Entry* e = &array[id];
             if (e->used) {
                 partInfo[e->p].profHits.inc();
-                partInfo[e->p].lruList.remove(e);
-                partInfo[e->p].lruList.push_front(e);
+                lruLists->moveToFront(e->p, id);
             } else {
                 uint32_t oldPart = e->p;
                 uint32_t newPart = mapper->getPartition(*req);
@@ -197,8 +243,8 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
                 }
                 partInfo[newPart].profMisses.inc();
                 e->p = newPart;
-                partInfo[oldPart].lruList.remove(e);
-                partInfo[newPart].lruList.push_front(e);
+                lruLists->remove(oldPart, id);
+                lruLists->pushFront(newPart, id);
                 e->used = true;
             }
 
@@ -231,8 +277,8 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
 
             //info("rp: %d / %d %d / %d %d", victimPart, partInfo[0].size, partInfo[0].targetSize, partInfo[1].size, partInfo[1].targetSize);
             assert(partInfo[victimPart].size > 0);
-            assert(partInfo[victimPart].size == partInfo[victimPart].lruList.size());
-            return partInfo[victimPart].lruList.back()->lineId;
+            assert(partInfo[victimPart].size == lruLists->size(victimPart));
+            return lruLists->back(victimPart);
         }
 
         template <typename C> uint32_t rank(const MemReq* req, C cands) {panic("!!");}
@@ -241,21 +287,20 @@ class IdealLRUPartReplPolicy : public PartReplPolicy {
 
 class IdealLRUPartArray : public CacheArray {
     private:
-        g_unordered_map<Address, uint32_t> lineMap; //address->lineId; if too slow, try an AATree, which does not alloc dynamically
+        LineIndex lineMap; //address->lineId
         Address* lineAddrs; //lineId -> address, for replacements
         IdealLRUPartReplPolicy* rp;
         uint32_t numLines;
 
     public:
-        IdealLRUPartArray(uint32_t _numLines, IdealLRUPartReplPolicy* _rp) : rp(_rp), numLines(_numLines) {
+        IdealLRUPartArray(uint32_t _numLines, IdealLRUPartReplPolicy* _rp) : lineMap(_numLines), rp(_rp), numLines(_numLines) {
             lineAddrs = gm_calloc<Address>(numLines);
         }
 
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
-            g_unordered_map<Address, uint32_t>::iterator it = lineMap.find(lineAddr);
-            if (it == lineMap.end()) return -1;
+            int32_t lineId = lineMap.find(lineAddr);
+            if (lineId == -1) return -1;
 
-            uint32_t lineId = it->second;
             if (updateReplacement) {
                 rp->update(lineId, req);
             }
@@ -270,10 +315,10 @@ class IdealLRUPartArray : public CacheArray {
 
         void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) {
             //Update addr mapping for lineId
-            lineMap.erase(lineAddrs[lineId]);
-            assert((lineMap.find(lineAddr) == lineMap.end()));
+            lineMap.erase(lineAddrs[lineId], lineId);
+            assert(lineMap.find(lineAddr) == -1);
             lineAddrs[lineId] = lineAddr;
-            lineMap[lineAddr] = lineId;
+            lineMap.insert(lineAddr, lineId);
 
             //Update repl
             rp->replaced(lineId);
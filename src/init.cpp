@@ -33,6 +33,7 @@
 #include <vector>
 #include "cache.h"
 #include "cache_arrays.h"
+#include "checkpoint.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
@@ -41,6 +42,7 @@
 #include "detailed_mem_params.h"
 #include "ddr_mem.h"
 #include "debug_zsim.h"
+#include "decode_cache.h"
 #include "dramsim_mem_ctrl.h"
 #include "event_queue.h"
 #include "filter_cache.h"
@@ -50,6 +52,7 @@
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "mrc_profiler.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
@@ -61,7 +64,9 @@
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "repl_policies.h"
+#include "sampled_cache.h"
 #include "scheduler.h"
+#include "shadow_cache.h"
 #include "simple_core.h"
 #include "stats.h"
 #include "stats_filter.h"
@@ -82,88 +87,227 @@ extern void EndOfPhaseActions(); //in zsim.cpp
  * follow the layout of zinfo, top-down.
  */
 
-BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
-    string type = config.get<const char*>(prefix + "type", "Simple");
-    // Shortcut for TraceDriven type
-    if (type == "TraceDriven") {
-        assert(zinfo->traceDriven);
-        assert(isTerminal);
-        return new TraceDriverProxyCache(name);
+/* Builds a devirtualized cache (see TypedCache) whose array uses replacement policy type R */
+template <typename R>
+static Cache* BuildTypedCache(const string& arrayType, R* rp, MESICC* cc, HashFamily* hf, uint32_t numLines, uint32_t ways, uint32_t candidates,
+        bool alignSets, bool simdLookup, bool memoHashes, uint32_t accLat, uint32_t invLat, const g_string& name) {
+    assert(rp);
+    if (arrayType == "SetAssoc") {
+        TypedSetAssocArray<R>* array = new TypedSetAssocArray<R>(numLines, ways, rp, hf, alignSets, simdLookup);
+        return new TypedCache<TypedSetAssocArray<R>, MESICC>(numLines, cc, array, rp, accLat, invLat, name);
+    } else {
+        assert(arrayType == "Z");
+        TypedZArray<R>* array = new TypedZArray<R>(numLines, ways, candidates, rp, hf, memoHashes);
+        return new TypedCache<TypedZArray<R>, MESICC>(numLines, cc, array, rp, accLat, invLat, name);
     }
+}
 
-    uint32_t lineSize = zinfo->lineSize;
-    assert(lineSize > 0); //avoid config deps
-    if (bankSize % lineSize != 0) panic("%s: Bank size must be a multiple of line size", name.c_str());
-
-    uint32_t numLines = bankSize/lineSize;
+/* Array, hash and replacement options shared by cache banks and their shadow caches */
+struct ArrayConfig {
+    string arrayType;
+    uint32_t ways;
+    uint32_t candidates;
+    uint32_t numHashes;
+    uint32_t numSets;
+    uint32_t setBits;
+    string hashType;
+    HashFamily* hf;
+    string replType;
+    bool alignSets; //SetAssoc only
+    bool simdLookup; //SetAssoc only
+    bool memoHashes; //Z only
+};
+
+static ArrayConfig ParseArrayConfig(Config& config, const string& prefix, const g_string& name, uint32_t numLines) {
+    ArrayConfig ac;
 
     //Array
-    uint32_t numHashes = 1;
-    uint32_t ways = config.get<uint32_t>(prefix + "array.ways", 4);
-    string arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
-    uint32_t candidates = (arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ways;
+    ac.numHashes = 1;
+    ac.ways = config.get<uint32_t>(prefix + "array.ways", 4);
+    ac.arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
+    ac.candidates = (ac.arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ac.ways;
 
     //Need to know number of hash functions before instantiating array
-    if (arrayType == "SetAssoc") {
-        numHashes = 1;
-    } else if (arrayType == "Z") {
-        numHashes = ways;
-        assert(ways > 1);
-    } else if (arrayType == "IdealLRU" || arrayType == "IdealLRUPart") {
-        ways = numLines;
-        numHashes = 0;
+    if (ac.arrayType == "SetAssoc") {
+        ac.numHashes = 1;
+    } else if (ac.arrayType == "Z") {
+        ac.numHashes = ac.ways;
+        assert(ac.ways > 1);
+    } else if (ac.arrayType == "IdealLRU" || ac.arrayType == "IdealLRUPart") {
+        ac.ways = numLines;
+        ac.numHashes = 0;
     } else {
-        panic("%s: Invalid array type %s", name.c_str(), arrayType.c_str());
+        panic("%s: Invalid array type %s", name.c_str(), ac.arrayType.c_str());
     }
 
     // Power of two sets check; also compute setBits, will be useful later
-    uint32_t numSets = numLines/ways;
-    uint32_t setBits = 31 - __builtin_clz(numSets);
-    if ((1u << setBits) != numSets) panic("%s: Number of sets must be a power of two (you specified %d sets)", name.c_str(), numSets);
+    ac.numSets = numLines/ac.ways;
+    ac.setBits = 31 - __builtin_clz(ac.numSets);
+    if ((1u << ac.setBits) != ac.numSets) panic("%s: Number of sets must be a power of two (you specified %d sets)", name.c_str(), ac.numSets);
 
     //Hash function
-    HashFamily* hf = nullptr;
-    string hashType = config.get<const char*>(prefix + "array.hash", (arrayType == "Z")? "H3" : "None"); //zcaches must be hashed by default
-    if (numHashes) {
-        if (hashType == "None") {
-            if (arrayType == "Z") panic("ZCaches must be hashed!"); //double check for stupid user
-            assert(numHashes == 1);
-            hf = new IdHashFamily;
-        } else if (hashType == "H3") {
+    ac.hf = nullptr;
+    ac.hashType = config.get<const char*>(prefix + "array.hash", (ac.arrayType == "Z")? "H3" : "None"); //zcaches must be hashed by default
+    if (ac.numHashes) {
+        if (ac.hashType == "None") {
+            if (ac.arrayType == "Z") panic("ZCaches must be hashed!"); //double check for stupid user
+            assert(ac.numHashes == 1);
+            ac.hf = new IdHashFamily;
+        } else if (ac.hashType == "H3") {
             //STL hash function
             size_t seed = _Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
             //info("%s -> %lx", prefix.c_str(), seed);
-            hf = new H3HashFamily(numHashes, setBits, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
-        } else if (hashType == "SHA1") {
-            hf = new SHA1HashFamily(numHashes);
+            ac.hf = new H3HashFamily(ac.numHashes, ac.setBits, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+        } else if (ac.hashType == "SHA1") {
+            ac.hf = new SHA1HashFamily(ac.numHashes);
         } else {
-            panic("%s: Invalid value %s on array.hash", name.c_str(), hashType.c_str());
+            panic("%s: Invalid value %s on array.hash", name.c_str(), ac.hashType.c_str());
         }
     }
 
+    ac.replType = config.get<const char*>(prefix + "repl.type", (ac.arrayType == "IdealLRUPart")? "IdealLRUPart" : "LRU");
+
+    ac.alignSets = (ac.arrayType == "SetAssoc")? config.get<bool>(prefix + "array.alignSets", false) : false; //pad sets to host cache lines
+    ac.simdLookup = (ac.arrayType == "SetAssoc")? config.get<bool>(prefix + "array.simdLookup", true) : true; //use AVX2/AVX-512 tag matching if available
+    ac.memoHashes = (ac.arrayType == "Z")? config.get<bool>(prefix + "array.memoHashes", false) : false; //keep each line's positions instead of rehashing it on walks
+    return ac;
+}
+
+//Replacement policies that need no cache context; returns nullptr for the rest (LRU variants and partitioning policies)
+static ReplPolicy* BuildCommonReplPolicy(const ArrayConfig& ac, uint32_t numLines, bool devirt) {
+    if (ac.replType == "LFU") {
+        return new LFUReplPolicy(numLines);
+    } else if (ac.replType == "TreeLRU") {
+        return new TreeLRUReplPolicy(numLines, ac.candidates);
+    } else if (ac.replType == "NRU") {
+        return devirt? new FinalNRUReplPolicy(numLines, ac.candidates) : new NRUReplPolicy(numLines, ac.candidates);
+    } else if (ac.replType == "Rand") {
+        return new RandReplPolicy(ac.candidates);
+    } else {
+        return nullptr;
+    }
+}
+
+//Builds a SetAssoc, Z, or IdealLRU array. IdealLRU arrays have their own replacement policy, which replaces rp.
+static CacheArray* BuildCommonArray(const ArrayConfig& ac, uint32_t numLines, HashFamily* hf, ReplPolicy*& rp) {
+    if (ac.arrayType == "SetAssoc") {
+        return new SetAssocArray(numLines, ac.ways, rp, hf, ac.alignSets, ac.simdLookup);
+    } else if (ac.arrayType == "Z") {
+        return new ZArray(numLines, ac.ways, ac.candidates, rp, hf, ac.memoHashes);
+    } else {
+        assert(ac.arrayType == "IdealLRU");
+        assert(!hf);
+        IdealLRUArray* ila = new IdealLRUArray(numLines);
+        rp = ila->getRP();
+        return ila;
+    }
+}
+
+//Tag-only model of an alternative configuration of a bank; takes a subset of BuildCacheBank's array and repl options
+ShadowCache* BuildShadowCache(Config& config, const string& prefix, const g_string& name, uint32_t bankSize) {
+    uint32_t lineSize = zinfo->lineSize;
+    if (bankSize == 0 || bankSize % lineSize != 0) panic("%s: Bank size must be a non-zero multiple of line size", name.c_str());
+    uint32_t numLines = bankSize/lineSize;
+
+    ArrayConfig ac = ParseArrayConfig(config, prefix, name, numLines);
+    if (ac.arrayType == "IdealLRUPart") panic("%s: Invalid shadow array type %s (SetAssoc, Z, or IdealLRU)", name.c_str(), ac.arrayType.c_str());
+
+    //Shadows have no sharers, so LRU and LRUNoSh are the same
+    bool lru = ac.replType == "LRU" || ac.replType == "LRUNoSh";
+    ReplPolicy* rp = nullptr;
+    if (ac.arrayType == "IdealLRU") {
+        if (!lru) panic("%s: IdealLRU shadow arrays need LRU replacement", name.c_str());
+    } else {
+        rp = lru? new LRUReplPolicy<false>(numLines) : BuildCommonReplPolicy(ac, numLines, false);
+        if (!rp) panic("%s: Invalid shadow replacement type %s (LRU, LRUNoSh, LFU, TreeLRU, NRU, or Rand)", name.c_str(), ac.replType.c_str());
+    }
+    CacheArray* array = BuildCommonArray(ac, numLines, ac.hf, rp);
+
+    ShadowCC* scc = new ShadowCC(numLines);
+    rp->setCC(scc);
+    return new ShadowCache(array, rp, scc, name);
+}
+
+BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
+    string type = config.get<const char*>(prefix + "type", "Simple");
+    // Shortcut for TraceDriven type
+    if (type == "TraceDriven") {
+        assert(zinfo->traceDriven);
+        assert(isTerminal);
+        return new TraceDriverProxyCache(name);
+    }
+
+    uint32_t lineSize = zinfo->lineSize;
+    assert(lineSize > 0); //avoid config deps
+    if (bankSize % lineSize != 0) panic("%s: Bank size must be a multiple of line size", name.c_str());
+
+    uint32_t numLines = bankSize/lineSize;
+
+    //Array, hash function and replacement options
+    ArrayConfig ac = ParseArrayConfig(config, prefix, name, numLines);
+    const string& arrayType = ac.arrayType;
+    const string& hashType = ac.hashType;
+    const string& replType = ac.replType;
+    uint32_t ways = ac.ways;
+    uint32_t candidates = ac.candidates;
+    uint32_t numSets = ac.numSets;
+    HashFamily* hf = ac.hf;
+
+    //Set sampling: simulate only sampledSets of the numSets sets (0 -> all), and estimate the rest
+    uint32_t fullSets = numSets;
+    uint32_t sampledSets = config.get<uint32_t>(prefix + "sampledSets", 0);
+    SampledSetsHashFamily* sampler = nullptr;
+    if (sampledSets) {
+        if (type != "Simple" || isTerminal || !ac.numHashes) panic("%s: Set sampling requires a non-terminal Simple cache with a SetAssoc or Z array", name.c_str());
+        if (sampledSets < 2 || sampledSets >= numSets || (sampledSets & (sampledSets - 1))) {
+            panic("%s: sampledSets must be a power of two in [2, %d) (you specified %d)", name.c_str(), numSets, sampledSets);
+        }
+        uint32_t sampledBits = 31 - __builtin_clz(sampledSets);
+        sampler = new SampledSetsHashFamily(hf, ac.setBits, sampledBits);
+        hf = sampler;
+        numLines = sampledSets*ways;
+        numSets = sampledSets;
+    }
+
     //Replacement policy
-    string replType = config.get<const char*>(prefix + "repl.type", (arrayType == "IdealLRUPart")? "IdealLRUPart" : "LRU");
     ReplPolicy* rp = nullptr;
 
+    //Lock striping: lets accesses to different sets of a shared bank proceed in parallel (see CCLocks)
+    uint32_t lockStripes = config.get<uint32_t>(prefix + "lockStripes", 1);
+    if (lockStripes & (lockStripes - 1)) panic("%s: lockStripes must be a power of two (you specified %d)", name.c_str(), lockStripes);
+    if (lockStripes > numSets) panic("%s: lockStripes (%d) cannot exceed the number of sets (%d)", name.c_str(), lockStripes, numSets);
+    bool lockStats = config.get<bool>(prefix + "lockStats", false); //count lock acquisitions, contention and hold times
+    if (lockStripes > 1) {
+        //Accesses must only touch the state of their set, which rules out zcaches, policies with global state or
+        //scratch space, TimingCache's MSHRs, and sampled sets (whose untracked victims are in other sets)
+        if (isTerminal || type != "Simple" || arrayType != "SetAssoc" || sampler || (replType != "LRU" && replType != "LRUNoSh")) {
+            panic("%s: Lock striping requires a non-terminal Simple cache with a SetAssoc array and LRU or LRUNoSh replacement, without set sampling", name.c_str());
+        }
+        //Stripes are selected concurrently, and SHA1 hash families memoize their last hash in shared state
+        if (hashType == "SHA1") panic("%s: Lock striping cannot be used with SHA1 array hashing", name.c_str());
+    }
+
+    //Common non-terminal configs use a cache specialized on its component types, which avoids virtual calls on accesses
+    bool devirt = !isTerminal && type == "Simple" && !sampler && (arrayType == "SetAssoc" || arrayType == "Z") &&
+        (replType == "LRU" || replType == "LRUNoSh" || replType == "NRU") && config.get<bool>(prefix + "devirtualize", true);
+
     if (replType == "LRU" || replType == "LRUNoSh") {
         bool sharersAware = (replType == "LRU") && !isTerminal;
-        if (sharersAware) {
-            rp = new LRUReplPolicy<true>(numLines);
+        bool atomicTimestamp = lockStripes > 1;
+        if (devirt) {
+            if (sharersAware) rp = new FinalLRUReplPolicy(numLines, atomicTimestamp);
+            else rp = new FinalLRUNoShReplPolicy(numLines, atomicTimestamp);
+        } else if (sharersAware) {
+            rp = new LRUReplPolicy<true>(numLines, atomicTimestamp);
         } else {
-            rp = new LRUReplPolicy<false>(numLines);
+            rp = new LRUReplPolicy<false>(numLines, atomicTimestamp);
         }
-    } else if (replType == "LFU") {
-        rp = new LFUReplPolicy(numLines);
+    } else if ((rp = BuildCommonReplPolicy(ac, numLines, devirt))) {
+        //LFU, TreeLRU, NRU, or Rand
     } else if (replType == "LRUProfViol") {
         ProfViolReplPolicy< LRUReplPolicy<true> >* pvrp = new ProfViolReplPolicy< LRUReplPolicy<true> >(numLines);
         pvrp->init(numLines);
         rp = pvrp;
-    } else if (replType == "TreeLRU") {
-        rp = new TreeLRUReplPolicy(numLines, candidates);
-    } else if (replType == "NRU") {
-        rp = new NRUReplPolicy(numLines, candidates);
-    } else if (replType == "Rand") {
-        rp = new RandReplPolicy(candidates);
     } else if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") {
         if (replType == "WayPart" && arrayType != "SetAssoc") panic("WayPart replacement requires SetAssoc array");
 
@@ -190,6 +334,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         // Partition monitor
         uint32_t umonLines = config.get<uint32_t>(prefix + "repl.umonLines", 256);
         uint32_t umonWays = config.get<uint32_t>(prefix + "repl.umonWays", ways);
+        uint32_t umonLevels = config.get<uint32_t>(prefix + "repl.umonLevels", 1); //>1 extends miss curves (stats only) to 2^(levels-1)x the bank size
         uint32_t buckets;
         if (replType == "WayPart") {
             buckets = ways; //not an option with WayPart
@@ -197,7 +342,7 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             buckets = config.get<uint32_t>(prefix + "repl.buckets", 256);
         }
 
-        PartitionMonitor* mon = new UMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets);
+        PartitionMonitor* mon = new UMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets, umonLevels);
 
         //Finally, instantiate the repl policy
         PartReplPolicy* prp;
@@ -218,7 +363,15 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
         // Partitioner
         // TODO: Depending on partitioner type, we want one per bank or one per cache.
-        Partitioner* p = new LookaheadPartitioner(prp, pm->getNumPartitions(), buckets, 1, allocPortion);
+        string partitionerType = config.get<const char*>(prefix + "repl.partitioner", "Lookahead");
+        Partitioner* p;
+        if (partitionerType == "Lookahead") {
+            p = new LookaheadPartitioner(prp, pm->getNumPartitions(), buckets, 1, allocPortion);
+        } else if (partitionerType == "Peekahead") {
+            p = new PeekaheadPartitioner(prp, pm->getNumPartitions(), buckets, 1, allocPortion);
+        } else {
+            panic("%s: Invalid partitioner type %s", name.c_str(), partitionerType.c_str());
+        }
 
         //Schedule its tick
         uint32_t interval = config.get<uint32_t>(prefix + "repl.interval", 5000); //phases
@@ -229,25 +382,16 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     assert(rp);
 
 
-    //Alright, build the array
+    //Alright, build the array (devirtualized caches build their own below)
     CacheArray* array = nullptr;
-    if (arrayType == "SetAssoc") {
-        array = new SetAssocArray(numLines, ways, rp, hf);
-    } else if (arrayType == "Z") {
-        array = new ZArray(numLines, ways, candidates, rp, hf);
-    } else if (arrayType == "IdealLRU") {
-        assert(replType == "LRU");
-        assert(!hf);
-        IdealLRUArray* ila = new IdealLRUArray(numLines);
-        rp = ila->getRP();
-        array = ila;
-    } else if (arrayType == "IdealLRUPart") {
+    if (arrayType == "IdealLRUPart") {
         assert(!hf);
         IdealLRUPartReplPolicy* irp = dynamic_cast<IdealLRUPartReplPolicy*>(rp);
         if (!irp) panic("IdealLRUPart array needs IdealLRUPart repl policy!");
         array = new IdealLRUPartArray(numLines, irp);
-    } else {
-        panic("This should not happen, we already checked for it!"); //unless someone changed arrayStr...
+    } else if (!devirt) {
+        if (arrayType == "IdealLRU") assert(replType == "LRU");
+        array = BuildCommonArray(ac, numLines, hf, rp);
     }
 
     //Latency
@@ -262,14 +406,48 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     // Finally, build the cache
     Cache* cache;
     CC* cc;
+    MESICC* mesiCC = nullptr;
     if (isTerminal) {
         cc = new MESITerminalCC(numLines, name);
     } else {
-        cc = new MESICC(numLines, nonInclusiveHack, name);
+        //Sharer directory format
+        SharerDirConfig dirConfig;
+        string dirType = config.get<const char*>(prefix + "dir.type", "Full");
+        if (dirType == "Full") {
+            dirConfig.type = SharerDirConfig::FULL;
+        } else if (dirType == "LimitedPtr") {
+            dirConfig.type = SharerDirConfig::LIMITED_PTR;
+        } else if (dirType == "CoarseVector") {
+            dirConfig.type = SharerDirConfig::COARSE_VECTOR;
+        } else {
+            panic("%s: Invalid directory type %s", name.c_str(), dirType.c_str());
+        }
+        dirConfig.pointers = (dirType == "LimitedPtr")? config.get<uint32_t>(prefix + "dir.pointers", 4) : 0;
+        dirConfig.groupSize = (dirType == "CoarseVector")? config.get<uint32_t>(prefix + "dir.groupSize", 0) : 0; //0 -> smallest that fits in 64 bits
+        //LimitedPtr directories share their overflow vectors across lines
+        if (lockStripes > 1 && dirType == "LimitedPtr") panic("%s: Lock striping cannot be used with LimitedPtr directories", name.c_str());
+
+        CCLockConfig lockConfig;
+        lockConfig.stripes = lockStripes;
+        lockConfig.hf = hf;
+        lockConfig.profile = lockStats;
+        mesiCC = new MESICC(numLines, nonInclusiveHack, dirConfig, name, lockConfig);
+        cc = mesiCC;
     }
     rp->setCC(cc);
     if (!isTerminal) {
-        if (type == "Simple") {
+        if (devirt) {
+            if (replType == "LRU") {
+                cache = BuildTypedCache(arrayType, dynamic_cast<FinalLRUReplPolicy*>(rp), mesiCC, hf, numLines, ways, candidates, ac.alignSets, ac.simdLookup, ac.memoHashes, accLat, invLat, name);
+            } else if (replType == "LRUNoSh") {
+                cache = BuildTypedCache(arrayType, dynamic_cast<FinalLRUNoShReplPolicy*>(rp), mesiCC, hf, numLines, ways, candidates, ac.alignSets, ac.simdLookup, ac.memoHashes, accLat, invLat, name);
+            } else {
+                assert(replType == "NRU");
+                cache = BuildTypedCache(arrayType, dynamic_cast<FinalNRUReplPolicy*>(rp), mesiCC, hf, numLines, ways, candidates, ac.alignSets, ac.simdLookup, ac.memoHashes, accLat, invLat, name);
+            }
+        } else if (sampler) {
+            cache = new SampledCache(numLines, mesiCC, array, rp, accLat, invLat, sampler, sampledSets, fullSets, name);
+        } else if (type == "Simple") {
             cache = new Cache(numLines, cc, array, rp, accLat, invLat, name);
         } else if (type == "Timing") {
             uint32_t mshrs = config.get<uint32_t>(prefix + "mshrs", 16);
@@ -290,6 +468,33 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
     }
 
+    //Shadow caches: sizes are per cache, like size, and split across banks like it
+    vector<const char*> shadowNames;
+    config.subgroups(prefix + "shadows", shadowNames);
+    if (!shadowNames.empty()) {
+        if (isTerminal) panic("%s: Terminal caches cannot have shadows", name.c_str());
+        uint32_t banks = config.get<uint32_t>(prefix + "banks", 1);
+        ShadowCaches* shadows = new ShadowCaches();
+        for (const char* shadowName : shadowNames) {
+            string shadowPrefix = prefix + "shadows." + shadowName + ".";
+            uint32_t shadowSize = config.get<uint32_t>(shadowPrefix + "size");
+            if (shadowSize % banks != 0) panic("%s: banks (%d) does not divide the size (%d bytes) of shadow %s", name.c_str(), banks, shadowSize, shadowName);
+            shadows->add(BuildShadowCache(config, shadowPrefix, g_string(shadowName), shadowSize/banks));
+        }
+        cache->setShadows(shadows);
+    }
+
+    //Miss ratio curve of this bank's accesses, for LRU sizes up to repl.mrcLines lines (4x the bank by default)
+    if (config.get<bool>(prefix + "repl.mrc", false)) {
+        if (isTerminal) panic("%s: Terminal caches cannot profile miss ratio curves (filter hits bypass the cache)", name.c_str());
+        uint32_t mrcLines = config.get<uint32_t>(prefix + "repl.mrcLines", 4*(bankSize/lineSize));
+        uint32_t mrcBuckets = config.get<uint32_t>(prefix + "repl.mrcBuckets", 64);
+        uint32_t mrcSampling = config.get<uint32_t>(prefix + "repl.mrcSampling", 64); //track 1 in mrcSampling lines
+        if (!mrcBuckets || mrcLines % mrcBuckets != 0) panic("%s: repl.mrcBuckets (%d) must divide repl.mrcLines (%d)", name.c_str(), mrcBuckets, mrcLines);
+        if (!mrcSampling || mrcSampling > (1u << 24)) panic("%s: repl.mrcSampling must be in [1, 2^24] (you specified %d)", name.c_str(), mrcSampling);
+        cache->setMRCProfiler(new MRCProfiler(mrcLines, mrcBuckets, mrcSampling));
+    }
+
 #if 0
     info("Built L%d bank, %d bytes, %d lines, %d ways (%d candidates if array is Z), %s array, %s hash, %s replacement, accLat %d, invLat %d name %s",
             level, bankSize, numLines, ways, candidates, arrayType.c_str(), hashType.c_str(), replType.c_str(), accLat, invLat, name.c_str());
@@ -508,6 +713,7 @@ static void InitSystem(Config& config) {
         uint32_t domain = i*zinfo->numDomains/memControllers;
         mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
     }
+    zinfo->memControllers = new g_vector<MemObject*>(mems);
 
     if (memControllers > 1) {
         bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
@@ -630,7 +836,6 @@ static void InitSystem(Config& config) {
             union {
                 SimpleCore* simpleCores;
                 TimingCore* timingCores;
-                OOOCore* oooCores;
                 NullCore* nullCores;
             };
             if (type == "Simple") {
@@ -638,7 +843,7 @@ static void InitSystem(Config& config) {
             } else if (type == "Timing") {
                 timingCores = gm_memalign<TimingCore>(CACHE_LINE_BYTES, cores);
             } else if (type == "OOO") {
-                oooCores = gm_memalign<OOOCore>(CACHE_LINE_BYTES, cores);
+                //built one by one by BuildOOOCore, as their type depends on their sizes
                 zinfo->oooDecode = true; //enable uop decoding, this is false by default, must be true if even one OOO cpu is in the system
             } else if (type == "Null") {
                 nullCores = gm_memalign<NullCore>(CACHE_LINE_BYTES, cores);
@@ -646,6 +851,27 @@ static void InitSystem(Config& config) {
                 panic("%s: Invalid core type %s", group, type.c_str());
             }
 
+            //OOO core structure sizes; the defaults model Nehalem
+            OOOCoreConfig oooConfig;
+            if (type == "OOO") {
+                oooConfig.iwSize = config.get<uint32_t>(prefix + "iwSize", oooConfig.iwSize);
+                oooConfig.robSize = config.get<uint32_t>(prefix + "robSize", oooConfig.robSize);
+                oooConfig.retireWidth = config.get<uint32_t>(prefix + "retireWidth", oooConfig.retireWidth);
+                oooConfig.lqSize = config.get<uint32_t>(prefix + "lqSize", oooConfig.lqSize);
+                oooConfig.sqSize = config.get<uint32_t>(prefix + "sqSize", oooConfig.sqSize);
+                oooConfig.uopQueueSize = config.get<uint32_t>(prefix + "uopQueueSize", oooConfig.uopQueueSize);
+                oooConfig.bpIndexBits = config.get<uint32_t>(prefix + "bpIndexBits", oooConfig.bpIndexBits);
+                oooConfig.bpHistBits = config.get<uint32_t>(prefix + "bpHistBits", oooConfig.bpHistBits);
+                oooConfig.bpPhtBits = config.get<uint32_t>(prefix + "bpPhtBits", oooConfig.bpPhtBits);
+                if (!oooConfig.iwSize || !oooConfig.robSize || !oooConfig.retireWidth || !oooConfig.lqSize || !oooConfig.sqSize || !oooConfig.uopQueueSize) {
+                    panic("%s: OOO core structure sizes and retireWidth must be non-zero", group);
+                }
+                if (oooConfig.bpPhtBits < oooConfig.bpIndexBits || oooConfig.bpPhtBits > oooConfig.bpHistBits || oooConfig.bpHistBits > 31) {
+                    panic("%s: Branch predictor needs bpIndexBits <= bpPhtBits <= bpHistBits <= 31 (%d, %d, %d given)",
+                            group, oooConfig.bpIndexBits, oooConfig.bpPhtBits, oooConfig.bpHistBits);
+                }
+            }
+
             if (type != "Null") {
                 string icache = config.get<const char*>(prefix + "icache");
                 string dcache = config.get<const char*>(prefix + "dcache");
@@ -691,7 +917,7 @@ static void InitSystem(Config& config) {
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        OOOCore* ocore = BuildOOOCore(oooConfig, ic, dc, name);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
@@ -751,7 +977,8 @@ static void InitSystem(Config& config) {
         zinfo->traceDriver = new TraceDriver(traceFile, retraceFile, proxies,
                 config.get<bool>("sim.useSkews", true), // incorporate skews in to playback and simulator results, not only the output trace
                 config.get<bool>("sim.playPuts", true),
-                config.get<bool>("sim.playAllGets", true));
+                config.get<bool>("sim.playAllGets", true),
+                config.get<uint32_t>("sim.traceThreads", 1)); // host threads replaying the trace; children are split among them
         zinfo->traceDriver->initStats(zinfo->rootStat);
     }
 
@@ -763,6 +990,12 @@ static void InitSystem(Config& config) {
         zinfo->rootStat->append(groupStat);
     }
 
+    //Cache banks in a fixed (config) order, for checkpoints
+    zinfo->caches = new g_vector<BaseCache*>();
+    for (const char* group : cacheGroupNames) {
+        for (vector<BaseCache*>& banks : *cMap[group]) for (BaseCache* bank : banks) zinfo->caches->push_back(bank);
+    }
+
     //Initialize event recorders
     //for (uint32_t i = 0; i < zinfo->numCores; i++) eventRecorders[i] = new EventRecorder();
 
@@ -900,7 +1133,8 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    bool contentionStealing = config.get<bool>("sim.contentionStealing", false); //idle contention threads steal domains from busy ones
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, contentionStealing);
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
@@ -927,11 +1161,23 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->skipStatsVectors = config.get<bool>("sim.skipStatsVectors", false);
     zinfo->compactPeriodicStats = config.get<bool>("sim.compactPeriodicStats", false);
 
+    zinfo->batchMemOps = config.get<bool>("sim.batchMemOps", false);
+
     //Fast-forwarding and magic ops
     zinfo->ignoreHooks = config.get<bool>("sim.ignoreHooks", false);
     zinfo->ffReinstrument = config.get<bool>("sim.ffReinstrument", false);
     if (zinfo->ffReinstrument) warn("sim.ffReinstrument = true, switching fast-forwarding on a multi-threaded process may be unstable");
 
+    //Checkpoints of warm state (see checkpoint.h). Relative checkpointFile paths are in the output dir
+    string ckptFile = config.get<const char*>("sim.checkpointFile", ""); //if set, save a checkpoint here at checkpointPhase or on the checkpoint magic op
+    if (!ckptFile.empty() && ckptFile[0] != '/') ckptFile = string(zinfo->outputDir) + "/" + ckptFile;
+    zinfo->checkpointFile = ckptFile.empty()? nullptr : gm_strdup(ckptFile.c_str());
+    zinfo->checkpointPhase = config.get<uint64_t>("sim.checkpointPhase", 0); //0 means only on the magic op
+    if (zinfo->checkpointPhase && !zinfo->checkpointFile) panic("sim.checkpointPhase needs sim.checkpointFile");
+    zinfo->checkpointPending = false;
+    string restoreFile = config.get<const char*>("sim.restoreFile", ""); //checkpoint to start from, usually with ffwd to where it was taken
+    bool restoreStats = config.get<bool>("sim.restoreStats", false); //also restore counter stats; off by default, since ROI stats usually start fresh
+
     zinfo->registerThreads = config.get<bool>("sim.registerThreads", false);
     zinfo->globalPauseFlag = config.get<bool>("sim.startInGlobalPause", false);
 
@@ -979,11 +1225,38 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     //Caches, cores, memory controllers
     InitSystem(config);
 
+    //Decoded BBL cache, only useful with OOO decoding. Relative decodeCacheFile paths are in the output dir.
+    //Off by default: lookups lock and hash every instrumented BBL, which only pays off across processes or runs.
+    bool decodeCache = config.get<bool>("sim.decodeCache", false);
+    string decodeCacheFile = config.get<const char*>("sim.decodeCacheFile", ""); //if set, load the cache from here on startup and save it on termination
+    if (!decodeCacheFile.empty() && decodeCacheFile[0] != '/') decodeCacheFile = string(zinfo->outputDir) + "/" + decodeCacheFile;
+    if (decodeCache && zinfo->oooDecode) {
+        zinfo->decodeCache = new DecodeCache(config.get<uint32_t>("sim.decodeCacheBuckets", 64*1024));
+        zinfo->decodeCache->initStats(zinfo->rootStat);
+        zinfo->decodeCacheFile = decodeCacheFile.empty()? nullptr : gm_strdup(decodeCacheFile.c_str());
+        if (zinfo->decodeCacheFile) zinfo->decodeCache->load(zinfo->decodeCacheFile);
+    } else {
+        zinfo->decodeCache = nullptr;
+        zinfo->decodeCacheFile = nullptr;
+    }
+
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
 
     zinfo->processStats = new ProcessStats(zinfo->rootStat);
 
+    //Periodic sampling stats, only for processes that use it
+    AggregateStat* samplingStat = nullptr;
+    for (uint32_t p = 0; p < zinfo->numProcs; p++) {
+        if (!zinfo->procArray[p]->getSamplingPeriod()) continue;
+        if (!samplingStat) {
+            samplingStat = new AggregateStat();
+            samplingStat->init("sampling", "Periodic sampling stats");
+        }
+        zinfo->procArray[p]->setSamplingStats(new SamplingStats(p, samplingStat));
+    }
+    if (samplingStat) zinfo->rootStat->append(samplingStat);
+
     const char* procStatsFilter = config.get<const char*>("sim.procStatsFilter", "");
     if (strlen(procStatsFilter)) {
         zinfo->procStats = new ProcStats(zinfo->rootStat, FilterStats(zinfo->rootStat, procStatsFilter));
@@ -999,6 +1272,9 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     bool perProcessDir = config.get<bool>("sim.perProcessDir", false);
     PostInitStats(perProcessDir, config);
 
+    //Done once stats are immutable, so they can be traversed
+    if (!restoreFile.empty()) RestoreCheckpoint(restoreFile.c_str(), restoreStats);
+
     zinfo->perProcessCpuEnum = config.get<bool>("sim.perProcessCpuEnum", false);
 
     //Odds and ends
@@ -0,0 +1,125 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINE_INDEX_H_
+#define LINE_INDEX_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+
+/* Maps line addresses to line ids, for fully-associative arrays. Open addressing with linear probing,
+ * preallocated for a maximum number of entries at construction (at most half full, so probe sequences
+ * stay short), and backward-shift deletion, so there are no tombstones and it never allocates or rehashes.
+ */
+class LineIndex : public GlobAlloc {
+    private:
+        static const uint32_t EMPTY = (uint32_t)-1;
+
+        struct Slot {
+            Address lineAddr;
+            uint32_t lineId; //EMPTY if free
+        };
+
+        Slot* slots;
+        uint32_t mask;
+        uint32_t shift;
+        uint32_t entries;
+        uint32_t maxEntries;
+
+        inline uint32_t home(Address lineAddr) const {
+            //Fibonacci hashing; line addresses are often strided, so use the high bits of the product
+            return (lineAddr * 0x9E3779B97F4A7C15ULL) >> shift;
+        }
+
+    public:
+        explicit LineIndex(uint32_t _maxEntries) : entries(0), maxEntries(_maxEntries) {
+            uint32_t bits = 1;
+            while ((1ul << bits) < 2ul*maxEntries) bits++;
+            mask = (1u << bits) - 1;
+            shift = 64 - bits;
+            slots = gm_calloc<Slot>(mask + 1);
+            for (uint32_t i = 0; i <= mask; i++) slots[i].lineId = EMPTY;
+        }
+
+        ~LineIndex() {
+            gm_free(slots);
+        }
+
+        //Returns lineAddr's id, or -1 if not present
+        inline int32_t find(Address lineAddr) const {
+            for (uint32_t i = home(lineAddr);; i = (i + 1) & mask) {
+                const Slot& s = slots[i];
+                if (s.lineId == EMPTY) return -1;
+                if (s.lineAddr == lineAddr) return s.lineId;
+            }
+        }
+
+        //lineAddr must not be present
+        inline void insert(Address lineAddr, uint32_t lineId) {
+            assert(lineId != EMPTY);
+            assert_msg(entries < maxEntries, "LineIndex full (%d entries)", maxEntries);
+            uint32_t i = home(lineAddr);
+            while (slots[i].lineId != EMPTY) {
+                assert(slots[i].lineAddr != lineAddr);
+                i = (i + 1) & mask;
+            }
+            slots[i].lineAddr = lineAddr;
+            slots[i].lineId = lineId;
+            entries++;
+        }
+
+        //Removes lineAddr if it maps to lineId (so callers need not track whether a line id was ever filled)
+        inline void erase(Address lineAddr, uint32_t lineId) {
+            uint32_t i = home(lineAddr);
+            while (true) {
+                if (slots[i].lineId == EMPTY) return;
+                if (slots[i].lineAddr == lineAddr) break;
+                i = (i + 1) & mask;
+            }
+            if (slots[i].lineId != lineId) return;
+            entries--;
+
+            //Backward-shift deletion: move up later entries of the cluster that can't be reached past the hole
+            uint32_t j = i;
+            while (true) {
+                j = (j + 1) & mask;
+                if (slots[j].lineId == EMPTY) break;
+                uint32_t h = home(slots[j].lineAddr);
+                //Entry at j can fill the hole at i iff its home is not in the cyclic range (i, j]
+                bool inRange = (i <= j)? (i < h && h <= j) : (i < h || h <= j);
+                if (!inRange) {
+                    slots[i] = slots[j];
+                    i = j;
+                }
+            }
+            slots[i].lineId = EMPTY;
+        }
+
+        uint32_t size() const {return entries;}
+};
+
+#endif  // LINE_INDEX_H_
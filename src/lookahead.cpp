@@ -32,6 +32,12 @@ using std::tuple;
 using std::tie;
 using std::make_tuple;
 
+//Misses saved per bucket by growing part from partAlloc to partAlloc+inc (use this when utility == misses)
+static inline double marginalUtility(const PartitionMonitor& monitor, uint32_t part, uint32_t partAlloc, uint32_t inc) {
+    uint64_t extraHits = monitor.get(part, partAlloc) - monitor.get(part, partAlloc+inc);
+    return ((double)extraHits)/((double)inc);
+}
+
 // generic lookahead algorithm
 namespace lookahead {
 
@@ -41,9 +47,7 @@ static tuple<double, uint32_t> getMaxMarginalUtility(
     double maxMu = -1.0;
     uint32_t maxMuAlloc = 0;
     for (uint32_t i = 1; i <= balance; i++) {
-        //Use this when utility == misses
-        uint64_t extraHits = monitor.get(part, partAlloc) - monitor.get(part, partAlloc+i);
-        double mu = ((double)extraHits)/((double)i);
+        double mu = marginalUtility(monitor, part, partAlloc, i);
 
         if (mu > maxMu) {
             maxMu = mu;
@@ -110,6 +114,119 @@ void computeBestPartitioning(
 
 }  // namespace lookahead
 
+/* Peekahead (Beckmann and Sanchez, PACT 2013). Lookahead always moves a partition from its current
+ * allocation a to the point of its miss curve reached with the steepest slope from a, which is the next
+ * vertex of the lower convex hull of the curve from a onwards. Peekahead precomputes that vertex for every
+ * point of every curve in a single right-to-left pass (the monotone chain algorithm), so each lookahead
+ * step takes O(1) per partition instead of O(buckets). Only when the next vertex is beyond the remaining
+ * balance does it scan, as lookahead does, up to the balance. Slopes are compared with the same
+ * expressions and tie-breaking as lookahead, so allocations are identical.
+ */
+namespace peekahead {
+
+static const uint32_t NO_HULL = (uint32_t)-1;
+
+//Same arithmetic as marginalUtility(), on a copy of the curve
+static inline double curveUtility(const uint32_t* curve, uint32_t partAlloc, uint32_t inc) {
+    uint64_t extraHits = curve[partAlloc] - curve[partAlloc+inc];
+    return ((double)extraHits)/((double)inc);
+}
+
+//next[a] = smallest b > a maximizing curveUtility(a, b-a), for a in [from, buckets). Sets next[from] =
+//NO_HULL if the curve is not non-increasing (uint32 differences wrap, so hulls don't apply; scan instead).
+static void computeHull(const uint32_t* curve, uint32_t from, uint32_t buckets, uint32_t* next) {
+    for (uint32_t b = from; b < buckets; b++) {
+        if (curve[b] < curve[b+1]) {
+            next[from] = NO_HULL;
+            return;
+        }
+    }
+
+    uint32_t hull[buckets+1];  // stack of lower hull vertices of the curve from a+1 onwards, leftmost on top
+    uint32_t top = 0;
+    hull[top++] = buckets;
+    for (uint32_t a = buckets; a-- > from;) {
+        //Pop vertices strictly above the line from a to the one below them; keep collinear ones, so
+        //that the top is the closest point among those of maximum slope
+        while (top >= 2 && curveUtility(curve, a, hull[top-2] - a) > curveUtility(curve, a, hull[top-1] - a)) top--;
+        next[a] = hull[top-1];
+        hull[top++] = a;
+    }
+}
+
+static tuple<double, uint32_t> getMaxMarginalUtility(const uint32_t* curve, const uint32_t* next, bool useHull,
+                                                      uint32_t partAlloc, uint32_t balance) {
+    if (useHull && next[partAlloc] - partAlloc <= balance) {
+        uint32_t inc = next[partAlloc] - partAlloc;
+        return make_tuple(curveUtility(curve, partAlloc, inc), inc);
+    }
+    double maxMu = -1.0;
+    uint32_t maxMuAlloc = 0;
+    for (uint32_t i = 1; i <= balance; i++) {
+        double mu = curveUtility(curve, partAlloc, i);
+        if (mu > maxMu) {
+            maxMu = mu;
+            maxMuAlloc = i;
+        }
+    }
+    return make_tuple(maxMu, maxMuAlloc);
+}
+
+void computeBestPartitioning(
+    uint32_t numPartitions, uint32_t buckets, uint32_t minAlloc, bool* forbidden,
+    uint32_t* allocs, const PartitionMonitor& monitor, uint32_t* hullBuf) {
+    uint32_t curveBuckets = monitor.getBuckets();
+    uint32_t balance = buckets;
+
+    for (uint32_t i = 0; i < numPartitions; i++) {
+        allocs[i] = minAlloc;
+    }
+
+    balance -= minAlloc;
+    if (!balance) return;
+    assert(minAlloc + balance <= curveBuckets);
+
+    // Each partition's curve (buckets+1 points), followed by the next hull vertex of each point
+    auto curveOf = [&](uint32_t p) { return &hullBuf[p*(2*curveBuckets + 1)]; };
+    auto nextOf = [&](uint32_t p) { return &hullBuf[p*(2*curveBuckets + 1) + curveBuckets + 1]; };
+    bool useHull[numPartitions];
+
+    // Best increment of each partition from its current allocation; it stays the best as the balance
+    // shrinks for as long as it fits (a maximum within [1, h] is still one within [1, h'] if h' >= it)
+    double mus[numPartitions];
+    uint32_t incs[numPartitions];
+    for (uint32_t i = 0; i < numPartitions; i++) {
+        if (forbidden && forbidden[i]) continue;
+        uint32_t* curve = curveOf(i);
+        for (uint32_t b = minAlloc; b <= curveBuckets; b++) curve[b] = monitor.get(i, b);
+        computeHull(curve, minAlloc, curveBuckets, nextOf(i));
+        useHull[i] = nextOf(i)[minAlloc] != NO_HULL;
+        tie(mus[i], incs[i]) = getMaxMarginalUtility(curve, nextOf(i), useHull[i], allocs[i], balance);
+    }
+
+    while (balance > 0) {
+        double maxMu = -1.0;
+        uint32_t maxMuPart = numPartitions;  // illegal
+        for (uint32_t i = 0; i < numPartitions; i++) {
+            if (forbidden && forbidden[i]) continue;
+            if (incs[i] > balance) {
+                tie(mus[i], incs[i]) = getMaxMarginalUtility(curveOf(i), nextOf(i), useHull[i], allocs[i], balance);
+            }
+            if (mus[i] > maxMu) {
+                maxMu = mus[i];
+                maxMuPart = i;
+            }
+        }
+        assert(maxMuPart < numPartitions);
+        uint32_t p = maxMuPart;
+        allocs[p] += incs[p];
+        balance -= incs[p];
+        if (balance) tie(mus[p], incs[p]) = getMaxMarginalUtility(curveOf(p), nextOf(p), useHull[p], allocs[p], balance);
+    }
+}
+
+}  // namespace peekahead
+
 // LookaheadPartitioner
 
 LookaheadPartitioner::LookaheadPartitioner(PartReplPolicy* _repl, uint32_t _numPartitions, uint32_t _buckets,
@@ -125,14 +242,18 @@ LookaheadPartitioner::LookaheadPartitioner(PartReplPolicy* _repl, uint32_t _numP
     info("LookaheadPartitioner: %d part buckets", buckets);
 }
 
+void LookaheadPartitioner::computeBestPartitioning(uint32_t* allocs, const PartitionMonitor& monitor) {
+    lookahead::computeBestPartitioning(
+        numPartitions, allocPortion*buckets, minAlloc*numPartitions,
+        forbidden, allocs, monitor);
+}
+
 //allocs are in buckets
 void LookaheadPartitioner::partition() {
     auto& monitor = *repl->getMonitor();
 
     uint32_t bestAllocs[numPartitions];
-    lookahead::computeBestPartitioning(
-        numPartitions, allocPortion*buckets, minAlloc*numPartitions,
-        forbidden, bestAllocs, monitor);
+    computeBestPartitioning(bestAllocs, monitor);
 
     uint64_t newUtility = lookahead::computePartitioningTotalUtility(
         numPartitions, bestAllocs, monitor);
@@ -162,3 +283,19 @@ void LookaheadPartitioner::partition() {
     repl->setPartitionSizes(curAllocs);
     repl->getMonitor()->reset();
 }
+
+// PeekaheadPartitioner
+
+PeekaheadPartitioner::PeekaheadPartitioner(PartReplPolicy* _repl, uint32_t _numPartitions, uint32_t _buckets,
+                                           uint32_t _minAlloc, double _allocPortion, bool* _forbidden)
+        : LookaheadPartitioner(_repl, _numPartitions, _buckets, _minAlloc, _allocPortion, _forbidden) {
+    hullBuf = gm_calloc<uint32_t>(numPartitions*(2*buckets + 1));
+    info("PeekaheadPartitioner: using convex hulls");
+}
+
+void PeekaheadPartitioner::computeBestPartitioning(uint32_t* allocs, const PartitionMonitor& monitor) {
+    assert(monitor.getBuckets() == buckets);
+    peekahead::computeBestPartitioning(
+        numPartitions, allocPortion*buckets, minAlloc*numPartitions,
+        forbidden, allocs, monitor, hullBuf);
+}
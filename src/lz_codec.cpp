@@ -0,0 +1,132 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lz_codec.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5  // sequences end this far from the end, so the decoder's last sequence is literals only
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint8_t* writeLen(uint8_t* op, uint32_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+static inline uint8_t* writeLiterals(uint8_t* op, uint8_t token, const uint8_t* lits, uint32_t litLen) {
+    *op++ = token | ((litLen >= 15)? 15 : litLen) << 4;
+    if (litLen >= 15) op = writeLen(op, litLen - 15);
+    memcpy(op, lits, litLen);
+    return op + litLen;
+}
+
+uint32_t LZCompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst) {
+    int32_t table[1 << LZ_HASH_BITS];
+    for (uint32_t i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+    uint8_t* op = dst;
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    while (ip + LZ_MIN_MATCH + LZ_LAST_LITERALS <= srcLen) {
+        uint32_t seq = read32(&src[ip]);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int32_t ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(&src[ref]) != seq) {
+            ip++;
+            continue;
+        }
+
+        uint32_t matchLen = LZ_MIN_MATCH;
+        while (ip + matchLen < srcLen - LZ_LAST_LITERALS && src[ref + matchLen] == src[ip + matchLen]) matchLen++;
+
+        uint32_t ml = matchLen - LZ_MIN_MATCH;
+        op = writeLiterals(op, (ml >= 15)? 15 : ml, &src[anchor], ip - anchor);
+        uint16_t offset = ip - ref;
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (ml >= 15) op = writeLen(op, ml - 15);
+
+        ip += matchLen;
+        anchor = ip;
+    }
+
+    op = writeLiterals(op, 0, &src[anchor], srcLen - anchor);
+    return op - dst;
+}
+
+bool LZDecompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst, uint32_t dstLen) {
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    auto readLen = [&](uint32_t& len) -> bool {
+        uint8_t b;
+        do {
+            if (ip >= srcLen) return false;
+            b = src[ip++];
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < srcLen) {
+        uint8_t token = src[ip++];
+
+        uint32_t litLen = token >> 4;
+        if (litLen == 15 && !readLen(litLen)) return false;
+        if (litLen > srcLen - ip || litLen > dstLen - op) return false;
+        memcpy(&dst[op], &src[ip], litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == srcLen) break;  // last sequence has no match
+
+        if (srcLen - ip < 2) return false;
+        uint32_t offset = src[ip] | (src[ip+1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        uint32_t matchLen = token & 15;
+        if (matchLen == 15 && !readLen(matchLen)) return false;
+        matchLen += LZ_MIN_MATCH;
+        if (matchLen > dstLen - op) return false;
+
+        //Byte by byte, since matches may overlap their output
+        const uint8_t* ref = &dst[op - offset];
+        for (uint32_t i = 0; i < matchLen; i++) dst[op + i] = ref[i];
+        op += matchLen;
+    }
+    return op == dstLen;
+}
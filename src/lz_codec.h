@@ -0,0 +1,47 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LZ_CODEC_H_
+#define LZ_CODEC_H_
+
+#include <stdint.h>
+
+/* Small LZ77 block codec for trace blocks (same sequence layout as LZ4 blocks: a token with literal
+ * and match length nibbles, extended lengths, literals, and a 16-bit match offset). Optimized for
+ * simplicity and decode speed, not ratio.
+ */
+
+//Worst-case compressed size of srcLen bytes
+inline uint32_t LZCompressBound(uint32_t srcLen) {
+    return srcLen + srcLen/255 + 16;
+}
+
+//Compresses src into dst, which must have LZCompressBound(srcLen) bytes. Returns the compressed size
+uint32_t LZCompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst);
+
+//Decompresses src into dst. Returns false if src is corrupt or does not decompress to exactly dstLen bytes
+bool LZDecompress(const uint8_t* src, uint32_t srcLen, uint8_t* dst, uint32_t dstLen);
+
+#endif  // LZ_CODEC_H_
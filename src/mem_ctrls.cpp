@@ -26,6 +26,7 @@
 //#include "timing_event.h"
 //#include "event_recorder.h"
 #include "mem_ctrls.h"
+#include "checkpoint.h"
 #include "zsim.h"
 
 uint64_t SimpleMemory::access(MemReq& req) {
@@ -106,6 +107,17 @@ void MD1Memory::updateLatency() {
     lastPhase = zinfo->numPhases;
 }
 
+//The load estimate is warm state; the current phase's accesses restart with the restored run's phases
+void MD1Memory::serialize(Checkpoint& ck) {
+    ck.section(name.c_str());
+    ck.io(smoothedPhaseAccesses);
+    ck.io(curLatency);
+    if (ck.restoring()) {
+        curPhaseAccesses = 0;
+        lastPhase = zinfo->numPhases;
+    }
+}
+
 uint64_t MD1Memory::access(MemReq& req) {
     if (zinfo->numPhases > lastPhase) {
         futex_lock(&updateLock);
@@ -116,11 +128,17 @@ uint64_t MD1Memory::access(MemReq& req) {
         futex_unlock(&updateLock);
     }
 
+    //Warmup accesses only update coherence state; they are not part of the load
+    if (unlikely(req.is(MemReq::WARMUP))) {
+        *req.state = (req.type == PUTS || req.type == PUTX)? I : (req.type == GETX)? M : req.is(MemReq::NOEXCL)? S : E;
+        return req.cycle + ((req.type == PUTS)? 0 : curLatency);
+    }
+
     switch (req.type) {
         case PUTX:
             //Dirty wback
-            profWrites.atomicInc();
-            profTotalWrLat.atomicInc(curLatency);
+            profWrites.inc();
+            profTotalWrLat.inc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             //Note no break
         case PUTS:
@@ -128,14 +146,14 @@ uint64_t MD1Memory::access(MemReq& req) {
             *req.state = I;
             break;
         case GETS:
-            profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
+            profReads.inc();
+            profTotalRdLat.inc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             *req.state = req.is(MemReq::NOEXCL)? S : E;
             break;
         case GETX:
-            profReads.atomicInc();
-            profTotalRdLat.atomicInc(curLatency);
+            profReads.inc();
+            profTotalRdLat.inc(curLatency);
             __sync_fetch_and_add(&curPhaseAccesses, 1);
             *req.state = M;
             break;
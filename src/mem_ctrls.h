@@ -59,10 +59,10 @@ class MD1Memory : public MemObject {
 
         PAD();
 
-        Counter profReads;
-        Counter profWrites;
-        Counter profTotalRdLat;
-        Counter profTotalWrLat;
+        ShardedCounter profReads;  // updated by all cores on every access
+        ShardedCounter profWrites;
+        ShardedCounter profTotalRdLat;
+        ShardedCounter profTotalWrLat;
         Counter profLoad;
         Counter profUpdates;
         Counter profClampedLoads;
@@ -93,6 +93,8 @@ class MD1Memory : public MemObject {
 
         const char* getName() {return name.c_str();}
 
+        void serialize(Checkpoint& ck);
+
     private:
         void updateLatency();
 };
@@ -97,6 +97,7 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        WARMUP        = (1<<6), //Functional access to warm up state during fast-forwarding. Updates tags, replacement and coherence state, but records no timing events, is not counted in cache or memory stats. Also propagates to the writebacks it causes
     };
     uint32_t flags;
 
@@ -112,11 +113,13 @@ struct InvReq {
     bool* writeback;
     uint64_t cycle;
     uint32_t srcId;
+    bool inexact; //sent by an inexact directory, the receiver may not hold the line
 };
 
 /** INTERFACES **/
 
 class AggregateStat;
+class Checkpoint;
 class Network;
 
 /* Base class for all memory objects (caches and memories) */
@@ -126,6 +129,8 @@ class MemObject : public GlobAlloc {
         virtual uint64_t access(MemReq& req) = 0;
         virtual void initStats(AggregateStat* parentStat) {}
         virtual const char* getName() = 0;
+        //Saves or restores warm state (see checkpoint.h); most memory objects have none
+        virtual void serialize(Checkpoint& ck) {}
 };
 
 /* Base class for all cache objects */
@@ -23,21 +23,22 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sstream>
 #include "partitioner.h"
 
 // UMon
 
-UMonMonitor::UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets)
+UMonMonitor::UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets, uint32_t _umonLevels)
         : PartitionMonitor(_buckets)
         , missCache(nullptr)
         , missCacheValid(false)
         , monitors(_numPartitions, nullptr) {
     assert(_numPartitions > 0);
 
-    missCache = gm_calloc<uint32_t>(_buckets * _numPartitions);
+    missCache = gm_calloc<uint32_t>((_buckets + 1) * _numPartitions);
 
     for (auto& monitor : monitors) {
-        monitor = new UMon(_numLines, _umonLines, _umonBuckets);
+        monitor = new UMon(_numLines, _umonLines, _umonBuckets, _umonLevels);
     }
 }
 
@@ -74,12 +75,13 @@ uint32_t UMonMonitor::get(uint32_t partition, uint32_t bucket) const {
         missCacheValid = true;
     }
 
-    return missCache[partition*buckets+bucket];
+    assert(bucket <= buckets);
+    return missCache[partition*(buckets+1)+bucket];
 }
 
 void UMonMonitor::getMissCurves() const {
     for (uint32_t partition = 0; partition < getNumPartitions(); partition++) {
-        getMissCurve(&missCache[partition*buckets], partition);
+        getMissCurve(&missCache[partition*(buckets+1)], partition);
     }
 }
 
@@ -88,7 +90,7 @@ void UMonMonitor::getMissCurve(uint32_t* misses, uint32_t partition) const {
 
     auto monitor = monitors[partition];
     uint32_t umonBuckets = monitor->getBuckets();
-    uint64_t umonMisses[ umonBuckets ];
+    uint64_t umonMisses[ umonBuckets+1 ];
 
     monitor->getMisses(umonMisses);
 
@@ -127,6 +129,20 @@ void UMonMonitor::getMissCurve(uint32_t* misses, uint32_t partition) const {
       */
 }
 
+void UMonMonitor::initStats(AggregateStat* parentStat) {
+    AggregateStat* umonStat = new AggregateStat();
+    umonStat->init("umon", "Utility monitor stats");
+    for (uint32_t p = 0; p < monitors.size(); p++) {
+        std::stringstream pss;
+        pss << "part-" << p;
+        AggregateStat* partStat = new AggregateStat();
+        partStat->init(gm_strdup(pss.str().c_str()), "Partition utility monitor stats");
+        monitors[p]->initStats(partStat);
+        umonStat->append(partStat);
+    }
+    parentStat->append(umonStat);
+}
+
 void UMonMonitor::reset() {
     for (auto monitor : monitors) {
         monitor->startNextInterval();
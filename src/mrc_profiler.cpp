@@ -0,0 +1,192 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mrc_profiler.h"
+#include <sstream>
+#include "checkpoint.h"
+
+MRCProfiler::MRCProfiler(uint32_t maxLines, uint32_t _buckets, uint32_t samplingRatio)
+    : maxNodes((uint32_t)(((uint64_t)maxLines * ((1u << SAMPLE_BITS)/samplingRatio) + (1u << SAMPLE_BITS) - 1) >> SAMPLE_BITS) + 1),
+      numNodes(0), root(0), curTs(0), priState(0x9E3779B9), index(maxNodes),
+      sampleThreshold((1u << SAMPLE_BITS)/samplingRatio), buckets(_buckets), bucketLines(maxLines/_buckets)
+{
+    assert(buckets && maxLines % buckets == 0);
+    assert(samplingRatio && samplingRatio <= (1u << SAMPLE_BITS));
+    nodes = gm_calloc<Node>(maxNodes + 1);
+    futex_init(&lock);
+}
+
+void MRCProfiler::access(const MemReq& req) {
+    if (req.type != GETS && req.type != GETX) return;
+    futex_lock(&lock);
+    profAccesses.inc();
+    if (sampled(req.lineAddr)) {
+        profSampled.inc();
+        int32_t n = index.find(req.lineAddr);
+        if (n >= 0) {
+            profReuses.inc(reuseBucket(countNewer(nodes[n].ts)));
+            erase(n);
+        } else {
+            profReuses.inc(buckets);
+            if (numNodes < maxNodes) {
+                n = ++numNodes;
+            } else {
+                //Any later reuse of the oldest line would be beyond maxLines, so reuse its node
+                n = oldest();
+                erase(n);
+                index.erase(nodes[n].lineAddr, n);
+            }
+            nodes[n].lineAddr = req.lineAddr;
+            index.insert(req.lineAddr, n);
+        }
+        nodes[n].ts = curTs++;
+        insert(n);
+    }
+    futex_unlock(&lock);
+}
+
+uint32_t MRCProfiler::reuseBucket(uint64_t distance) const {
+    //Scale the sampled distance back to the full stream
+    uint64_t lines = (distance << SAMPLE_BITS)/sampleThreshold;
+    return (lines >= (uint64_t)buckets*bucketLines)? buckets : lines/bucketLines;
+}
+
+/* Estimated misses of an LRU cache of idx*bucketLines lines. A reuse at scaled distance d hits in caches
+ * of more than d lines. As in SHARDS_adj, the difference between the expected and actual number of sampled
+ * accesses is counted as reuses at distance 0, which corrects most of the error of small samples.
+ */
+uint64_t MRCProfiler::curvePoint(uint32_t idx) const {
+    assert(idx <= buckets);
+    double rate = ((double)sampleThreshold)/(1u << SAMPLE_BITS);
+    double accs = profAccesses.get();
+    double sampledHits = (idx > 0)? accs*rate - (double)profSampled.get() : 0.0;
+    for (uint32_t b = 0; b < idx; b++) sampledHits += profReuses.count(b);
+    double misses = accs - sampledHits/rate;
+    if (misses < 0.0) return 0;
+    return (misses > accs)? (uint64_t)accs : (uint64_t)(misses + 0.5);
+}
+
+void MRCProfiler::initStats(AggregateStat* parentStat) {
+    AggregateStat* mrcStat = new AggregateStat();
+    mrcStat->init("mrc", "Miss ratio curve profiler");
+    profAccesses.init("accs", "GETs");
+    profSampled.init("sampled", "Sampled GETs");
+    profReuses.init("reuses", "Sampled GETs by reuse distance bucket (last is cold or beyond the largest size)", buckets + 1);
+    mrcStat->append(&profAccesses);
+    mrcStat->append(&profSampled);
+    mrcStat->append(&profReuses);
+
+    //NOTE: Evaluated at dump time from the counters above, so periodic dumps give per-interval curves by differencing
+    auto curveLambda = [this](uint32_t idx) -> uint64_t { return curvePoint(idx); };
+    auto curveStat = makeLambdaVectorStat(curveLambda, buckets + 1);
+    std::stringstream ss;
+    ss << "Estimated GET misses of an LRU cache of i*" << bucketLines << " lines";
+    curveStat->init("misses", gm_strdup(ss.str().c_str()));
+    mrcStat->append(curveStat);
+    parentStat->append(mrcStat);
+}
+
+void MRCProfiler::serialize(Checkpoint& ck) {
+    ck.section("MRCProfiler");
+    ck.check("nodes", maxNodes);
+    ck.io(numNodes);
+    ck.io(root);
+    ck.io(curTs);
+    ck.io(priState);
+    ck.io(nodes, maxNodes + 1);
+    if (ck.restoring()) {
+        assert(index.size() == 0);
+        for (uint32_t n = 1; n <= numNodes; n++) index.insert(nodes[n].lineAddr, n);
+    }
+}
+
+uint32_t MRCProfiler::merge(uint32_t a, uint32_t b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (nodes[a].pri > nodes[b].pri) {
+        nodes[a].right = merge(nodes[a].right, b);
+        update(a);
+        return a;
+    } else {
+        nodes[b].left = merge(a, nodes[b].left);
+        update(b);
+        return b;
+    }
+}
+
+void MRCProfiler::split(uint32_t t, uint64_t ts, uint32_t* l, uint32_t* r) {
+    if (!t) {
+        *l = *r = 0;
+    } else if (nodes[t].ts < ts) {
+        split(nodes[t].right, ts, &nodes[t].right, r);
+        *l = t;
+        update(t);
+    } else {
+        split(nodes[t].left, ts, l, &nodes[t].left);
+        *r = t;
+        update(t);
+    }
+}
+
+void MRCProfiler::insert(uint32_t n) {
+    //xorshift32; deterministic, so runs are repeatable
+    priState ^= priState << 13;
+    priState ^= priState >> 17;
+    priState ^= priState << 5;
+    nodes[n].pri = priState;
+    nodes[n].left = nodes[n].right = 0;
+    nodes[n].size = 1;
+    //n has the newest timestamp, so it goes to the right of every other node
+    root = merge(root, n);
+}
+
+void MRCProfiler::erase(uint32_t n) {
+    uint32_t l, m, r;
+    split(root, nodes[n].ts, &l, &m);
+    split(m, nodes[n].ts + 1, &m, &r);
+    assert(m == n);
+    root = merge(l, r);
+}
+
+uint32_t MRCProfiler::countNewer(uint64_t ts) const {
+    uint32_t count = 0;
+    uint32_t t = root;
+    while (t) {
+        if (nodes[t].ts > ts) {
+            count += 1 + nodes[nodes[t].right].size;
+            t = nodes[t].left;
+        } else {
+            t = nodes[t].right;
+        }
+    }
+    return count;
+}
+
+uint32_t MRCProfiler::oldest() const {
+    uint32_t t = root;
+    assert(t);
+    while (nodes[t].left) t = nodes[t].left;
+    return t;
+}
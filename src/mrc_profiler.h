@@ -0,0 +1,103 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRC_PROFILER_H_
+#define MRC_PROFILER_H_
+
+#include <stdint.h>
+#include "galloc.h"
+#include "line_index.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class Checkpoint;
+
+/* Miss ratio curve profiler (SHARDS: Waldspurger et al., FAST 2015). Computes the LRU miss curve of the
+ * access stream of a cache, at all sizes up to maxLines, in a single pass. A spatially-hashed 1 in N
+ * sample of lines is tracked; the reuse (stack) distance of each sampled access is the number of distinct
+ * sampled lines accessed since the line's previous access, scaled by N. Distances come from an order-statistic
+ * treap over the lines' last-access timestamps, so each sampled access takes O(log(maxLines/N)).
+ *
+ * Only lines within maxLines (scaled) of the most recent access can hit, so the treap tracks at most
+ * maxLines/N+1 lines and drops the least recently accessed one when full.
+ */
+class MRCProfiler : public GlobAlloc {
+    private:
+        struct Node {
+            Address lineAddr;
+            uint64_t ts;     //last access
+            uint32_t pri;    //treap heap priority
+            uint32_t left, right;
+            uint32_t size;   //nodes in subtree
+        };
+
+        static const uint32_t SAMPLE_BITS = 24;
+
+        Node* nodes;       //1-based; node 0 is the null node
+        uint32_t maxNodes;
+        uint32_t numNodes; //nodes 1..numNodes are always in the tree
+        uint32_t root;
+        uint64_t curTs;
+        uint32_t priState;
+        LineIndex index;   //lineAddr -> node
+
+        const uint32_t sampleThreshold; //sample lines whose hash, in [0, 2^SAMPLE_BITS), is below this
+        const uint32_t buckets;
+        const uint32_t bucketLines;
+
+        lock_t lock;
+
+        Counter profAccesses, profSampled;
+        VectorCounter profReuses; //sampled reuses by scaled distance bucket; last one is beyond maxLines or cold
+
+    public:
+        MRCProfiler(uint32_t maxLines, uint32_t _buckets, uint32_t samplingRatio);
+
+        //Called by the cache on each access it does not skip; only GETs are profiled
+        void access(const MemReq& req);
+
+        void initStats(AggregateStat* parentStat);
+        void serialize(Checkpoint& ck);
+
+    private:
+        inline bool sampled(Address lineAddr) const {
+            return ((lineAddr * 0xC2B2AE3D27D4EB4FULL) >> (64 - SAMPLE_BITS)) < sampleThreshold;
+        }
+
+        uint32_t reuseBucket(uint64_t distance) const;
+        uint64_t curvePoint(uint32_t idx) const;
+
+        //Treap operations
+        inline void update(uint32_t n) {nodes[n].size = 1 + nodes[nodes[n].left].size + nodes[nodes[n].right].size;}
+        uint32_t merge(uint32_t a, uint32_t b);
+        void split(uint32_t t, uint64_t ts, uint32_t* l, uint32_t* r); //l gets nodes with timestamp < ts
+        void insert(uint32_t n);
+        void erase(uint32_t n);
+        uint32_t countNewer(uint64_t ts) const;
+        uint32_t oldest() const;
+};
+
+#endif  // MRC_PROFILER_H_
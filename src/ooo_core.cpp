@@ -28,6 +28,7 @@
 #include <queue>
 #include <string>
 #include "bithacks.h"
+#include "checkpoint.h"
 #include "decoder.h"
 #include "filter_cache.h"
 #include "zsim.h"
@@ -116,6 +117,27 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     parentStat->append(coreStat);
 }
 
+template <typename P>
+OOOCoreImpl<P>::OOOCoreImpl(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, const OOOCoreConfig& cfg)
+    : OOOCore(_l1i, _l1d, _name), loadQueue(cfg.lqSize, cfg.retireWidth), storeQueue(cfg.sqSize, cfg.retireWidth),
+      insWindow(cfg.iwSize), rob(cfg.robSize, cfg.retireWidth), branchPred(cfg.bpIndexBits, cfg.bpHistBits, cfg.bpPhtBits),
+      uopQueue(cfg.uopQueueSize) {}
+
+template<uint32_t NB, uint32_t HB, uint32_t LB>
+void BranchPredictorPAg<NB, HB, LB>::serialize(Checkpoint& ck) {
+    ck.check("bhsrs", bhsr.size());
+    ck.check("phtEntries", pht.size());
+    ck.io(&bhsr[0], bhsr.size());
+    ck.io(&pht[0], pht.size());
+}
+
+//The branch predictor is the only warm state; the window, queues, and cycle counters are timing state
+template <typename P>
+void OOOCoreImpl<P>::serialize(Checkpoint& ck) {
+    ck.section("core", name.c_str());
+    branchPred.serialize(ck);
+}
+
 uint64_t OOOCore::getInstrs() const {return instrs;}
 uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
 
@@ -131,7 +153,8 @@ void OOOCore::contextSwitch(int32_t gid) {
 }
 
 
-InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
+template <typename P>
+InstrFuncPtrs OOOCoreImpl<P>::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
 
 inline void OOOCore::load(Address addr) {
     loadAddrs[loads++] = addr;
@@ -155,7 +178,8 @@ void OOOCore::branch(Address pc, bool taken, Address takenNpc, Address notTakenN
     branchNotTakenNpc = notTakenNpc;
 }
 
-inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
+template <typename P>
+inline void OOOCoreImpl<P>::bbl(Address bblAddr, BblInfo* bblInfo) {
     if (!prevBbl) {
         // This is the 1st BBL since scheduled, nothing to simulate
         prevBbl = bblInfo;
@@ -457,6 +481,10 @@ void OOOCore::leave() {
     cRec.notifyLeave(curCycle);
 }
 
+void OOOCore::warmAccess(ADDRINT addr, bool isLoad) {
+    l1d->warm(addr, isLoad, zinfo->globPhaseCycles);
+}
+
 void OOOCore::cSimStart() {
     uint64_t targetCycle = cRec.cSimStart(curCycle);
     assert(targetCycle >= curCycle);
@@ -469,7 +497,8 @@ void OOOCore::cSimEnd() {
     if (targetCycle > curCycle) advance(targetCycle);
 }
 
-void OOOCore::advance(uint64_t targetCycle) {
+template <typename P>
+void OOOCoreImpl<P>::advance(uint64_t targetCycle) {
     assert(targetCycle > curCycle);
     decodeCycle += targetCycle - curCycle;
     insWindow.longAdvance(curCycle, targetCycle);
@@ -499,8 +528,9 @@ void OOOCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {
     else core->predFalseMemOp();
 }
 
-void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename P>
+void OOOCoreImpl<P>::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    OOOCoreImpl<P>* core = static_cast<OOOCoreImpl<P>*>(cores[tid]);
     core->bbl(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
@@ -523,3 +553,23 @@ void OOOCore::BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc,
     static_cast<OOOCore*>(cores[tid])->branch(pc, taken, takenNpc, notTakenNpc);
 }
 
+
+// Specialized variants. Add configurations used often here; others use the runtime-sized variant, which is slower.
+
+typedef OOOCoreParams<16, 32, 2, 10, 16, 16, 10, 16, 12> OOOSmallParams;     // Silvermont-like
+typedef OOOCoreParams<36, 128, 4, 32, 32, 28, 11, 18, 14> OOOMediumParams;   // Nehalem (the defaults)
+typedef OOOCoreParams<97, 224, 4, 72, 56, 64, 12, 20, 16> OOOLargeParams;    // Skylake-like
+typedef OOOCoreParams<0, 0, 0, 0, 0, 0, 0, 0, 0> OOORuntimeParams;
+
+template <typename P>
+static OOOCore* NewOOOCore(const OOOCoreConfig& cfg, FilterCache* l1i, FilterCache* l1d, g_string& name) {
+    OOOCoreImpl<P>* core = gm_memalign<OOOCoreImpl<P>>(CACHE_LINE_BYTES, 1);
+    return new (core) OOOCoreImpl<P>(l1i, l1d, name, cfg);
+}
+
+OOOCore* BuildOOOCore(const OOOCoreConfig& cfg, FilterCache* l1i, FilterCache* l1d, g_string& name) {
+    if (OOOMediumParams::matches(cfg)) return NewOOOCore<OOOMediumParams>(cfg, l1i, l1d, name);
+    if (OOOSmallParams::matches(cfg)) return NewOOOCore<OOOSmallParams>(cfg, l1i, l1d, name);
+    if (OOOLargeParams::matches(cfg)) return NewOOOCore<OOOLargeParams>(cfg, l1i, l1d, name);
+    return NewOOOCore<OOORuntimeParams>(cfg, l1i, l1d, name);
+}
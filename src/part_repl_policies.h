@@ -38,10 +38,11 @@ struct PartInfo {
     uint64_t size; //in lines
     uint64_t targetSize; //in lines
 
-    Counter profHits;
-    Counter profMisses;
-    Counter profSelfEvictions; // from our same partition
-    Counter profExtEvictions; // from other partitions (if too large, we're probably doing something wrong, e.g., too small an adjustment period)
+    //Partitioned caches are shared, so these are updated by many threads
+    ShardedCounter profHits;
+    ShardedCounter profMisses;
+    ShardedCounter profSelfEvictions; // from our same partition
+    ShardedCounter profExtEvictions; // from other partitions (if too large, we're probably doing something wrong, e.g., too small an adjustment period)
 };
 
 class PartReplPolicy : public virtual ReplPolicy {
@@ -104,10 +105,10 @@ class WayPartReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
                 partInfo[i].targetSize = 0;
 
                 //Need placement new, these object have vptr
-                new (&partInfo[i].profHits) Counter;
-                new (&partInfo[i].profMisses) Counter;
-                new (&partInfo[i].profSelfEvictions) Counter;
-                new (&partInfo[i].profExtEvictions) Counter;
+                new (&partInfo[i].profHits) ShardedCounter;
+                new (&partInfo[i].profMisses) ShardedCounter;
+                new (&partInfo[i].profSelfEvictions) ShardedCounter;
+                new (&partInfo[i].profExtEvictions) ShardedCounter;
             }
 
             array = gm_calloc<WayPartInfo>(totalSize); //all have ts, p == 0...
@@ -145,6 +146,7 @@ class WayPartReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
 
                 partsStat->append(partStat);
             }
+            monitor->initStats(partsStat);
             parentStat->append(partsStat);
         }
 
@@ -327,10 +329,10 @@ class VantageReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
                 partInfo[i].extendedSize = 0;
 
                 //Need placement new, these objects have vptr
-                new (&partInfo[i].profHits) Counter;
-                new (&partInfo[i].profMisses) Counter;
-                new (&partInfo[i].profSelfEvictions) Counter;
-                new (&partInfo[i].profExtEvictions) Counter;
+                new (&partInfo[i].profHits) ShardedCounter;
+                new (&partInfo[i].profMisses) ShardedCounter;
+                new (&partInfo[i].profSelfEvictions) ShardedCounter;
+                new (&partInfo[i].profExtEvictions) ShardedCounter;
                 new (&partInfo[i].profDemotions) Counter;
                 new (&partInfo[i].profEvictions) Counter;
                 new (&partInfo[i].profSizeCycles) Counter;
@@ -390,6 +392,7 @@ class VantageReplPolicy : public PartReplPolicy, public LegacyReplPolicy {
 
                 rpStat->append(partStat);
             }
+            monitor->initStats(rpStat);
             parentStat->append(rpStat);
         }
 
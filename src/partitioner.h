@@ -58,9 +58,18 @@ class Partitioner : public GlobAlloc {
 
 // Gives best partition sizes as estimated with the greedy lookahead
 // algorithm proposed in the UCP paper (Qureshi and Patt, ISCA 2006)
+class PartitionMonitor;
 namespace lookahead {
-    uint64_t computePartitioningTotalUtility(uint32_t numPartitions, const uint32_t* parts, const uint32_t* missCurves);
-    void computeBestPartitioning(uint32_t numPartitions, uint32_t* allocs, uint32_t* missCurves);
+    uint64_t computePartitioningTotalUtility(uint32_t numPartitions, const uint32_t* parts, const PartitionMonitor& monitor);
+    void computeBestPartitioning(uint32_t numPartitions, uint32_t buckets, uint32_t minAlloc, bool* forbidden,
+                                 uint32_t* allocs, const PartitionMonitor& monitor);
+}
+
+// Gives the same partition sizes as lookahead in linear time, using the convex hulls of the miss curves
+// (Peekahead, Beckmann and Sanchez, PACT 2013). hullBuf needs numPartitions*(2*monitor.getBuckets() + 1) entries.
+namespace peekahead {
+    void computeBestPartitioning(uint32_t numPartitions, uint32_t buckets, uint32_t minAlloc, bool* forbidden,
+                                 uint32_t* allocs, const PartitionMonitor& monitor, uint32_t* hullBuf);
 }
 
 class LookaheadPartitioner : public Partitioner {
@@ -69,13 +78,27 @@ class LookaheadPartitioner : public Partitioner {
                              uint32_t _minAlloc = 1, double _allocPortion = 1.0, bool* _forbidden = nullptr);
         void partition();
 
-    private:
+    protected:
+        virtual void computeBestPartitioning(uint32_t* allocs, const PartitionMonitor& monitor);
+
         PartReplPolicy* repl;
         uint32_t numPartitions;
         uint32_t buckets;
         uint32_t* curAllocs;
 };
 
+class PeekaheadPartitioner : public LookaheadPartitioner {
+    public:
+        PeekaheadPartitioner(PartReplPolicy* _repl, uint32_t _numPartitions, uint32_t _buckets,
+                             uint32_t _minAlloc = 1, double _allocPortion = 1.0, bool* _forbidden = nullptr);
+
+    protected:
+        void computeBestPartitioning(uint32_t* allocs, const PartitionMonitor& monitor);
+
+    private:
+        uint32_t* hullBuf;
+};
+
 // *********************************************************************
 
 // monitors the usage of partitions in a cache and generates miss curves
@@ -96,6 +119,9 @@ class PartitionMonitor : public GlobAlloc {
         // called by Partitioner each interval to reset miss counters
         virtual void reset() = 0;
 
+        // called by the PartReplPolicy that owns the monitor
+        virtual void initStats(AggregateStat* parentStat) {}
+
         uint32_t getBuckets() const { return buckets; }
 
     protected:
@@ -106,7 +132,7 @@ class PartitionMonitor : public GlobAlloc {
 // Stupid name...but what do you call it? -nzb
 class UMonMonitor : public PartitionMonitor {
     public:
-        UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets);
+        UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets, uint32_t _umonLevels = 1);
         ~UMonMonitor();
 
         uint32_t getNumPartitions() const { return monitors.size(); }
@@ -114,12 +140,13 @@ class UMonMonitor : public PartitionMonitor {
         uint32_t get(uint32_t partition, uint32_t bucket) const;
         uint32_t getNumAccesses(uint32_t partition) const;
         void reset();
+        void initStats(AggregateStat* parentStat);
 
     private:
         void getMissCurves() const;
         void getMissCurve(uint32_t* misses, uint32_t partition) const;
 
-        mutable uint32_t* missCache;
+        mutable uint32_t* missCache; //buckets+1 points per partition
         mutable bool missCacheValid;
         g_vector<UMon*> monitors;       // individual monitors per partition
 };
@@ -61,6 +61,7 @@ uint64_t StreamPrefetcher::access(MemReq& req) {
     req.childId = childId;
 
     if (req.type != GETS) return parent->access(req); //other reqs ignored, including stores
+    if (req.is(MemReq::WARMUP)) return parent->access(req); //warmup accesses neither train nor count
 
     profAccesses.inc();
 
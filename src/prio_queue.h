@@ -28,6 +28,24 @@
 
 #include "g_std/g_multimap.h"
 
+/* Far elements (B*64 or more cycles ahead) are kept in a separate structure and moved to
+ * blocks[] every B/2 blocks. With PQ_CALENDAR (default), this is a two-tier ladder: a calendar of
+ * PQ_CAL_BUCKETS buckets, each covering B/2 blocks (i.e., one migration); a coarse calendar of
+ * PQ_CAL_BUCKETS buckets, each covering PQ_CAL_BUCKETS/2 windows (i.e., one calendar extension);
+ * and an unsorted overflow list beyond both. Each tier is refilled from the next one every half
+ * rotation, so an element is moved or rescanned O(1) times per PQ_CAL_BUCKETS^2/4 migrations.
+ * Buckets are intrusive FIFO lists (through T::next), so far enqueues are O(1) and do not
+ * allocate, and events with the same cycle are dequeued in the same order as with the multimap.
+ * The calendar requires T to record its enqueue cycle in T::privCycle. Set PQ_CALENDAR to 0 to
+ * use a g_multimap instead.
+ */
+#ifndef PQ_CALENDAR
+#define PQ_CALENDAR 1
+//#define PQ_CALENDAR 0
+#endif
+
+#define PQ_CAL_BUCKETS 64  // must be 64, we track occupancy in a single word
+
 template <typename T, uint32_t B>
 class PrioQueue {
     struct PQBlock {
@@ -62,10 +80,40 @@ class PrioQueue {
 
     PQBlock blocks[B];
 
+#if PQ_CALENDAR
+    struct CalBucket {
+        T* head;
+        T* tail;
+        uint64_t minCycle;
+
+        inline void append(T* obj, uint64_t cycle) {
+            assert(!obj->next);
+            if (head) tail->next = obj;
+            else head = obj;
+            tail = obj;
+            minCycle = MIN(minCycle, cycle);
+        }
+
+        inline void clear() {
+            head = tail = nullptr;
+            minCycle = (uint64_t)-1L;
+        }
+    };
+
+    CalBucket cal[PQ_CAL_BUCKETS]; //indexed by window % PQ_CAL_BUCKETS, a window is B/2 blocks
+    uint64_t calOcc; // bit i is 1 if cal[i] is populated
+    uint64_t calEnd; //first window not in cal[]
+    CalBucket coarse[PQ_CAL_BUCKETS]; //indexed by coarseWindow % PQ_CAL_BUCKETS
+    uint64_t coarseOcc; // bit i is 1 if coarse[i] is populated
+    uint64_t coarseEnd; //first coarse window not in coarse[]
+    CalBucket overflow; //elements beyond both calendars, unsorted
+    uint64_t farElems;
+#else
     typedef g_multimap<uint64_t, T*> FEMap; //far element map
     typedef typename FEMap::iterator FEMapIterator;
 
     FEMap feMap;
+#endif
 
     uint64_t curBlock;
     uint64_t elems;
@@ -74,6 +122,14 @@ class PrioQueue {
         PrioQueue() {
             curBlock = 0;
             elems = 0;
+#if PQ_CALENDAR
+            for (uint32_t i = 0; i < PQ_CAL_BUCKETS; i++) cal[i].clear();
+            for (uint32_t i = 0; i < PQ_CAL_BUCKETS; i++) coarse[i].clear();
+            calOcc = coarseOcc = 0;
+            calEnd = coarseEnd = 2 + PQ_CAL_BUCKETS;
+            overflow.clear();
+            farElems = 0;
+#endif
         }
 
         void enqueue(T* obj, uint64_t cycle) {
@@ -86,7 +142,7 @@ class PrioQueue {
                 blocks[i].enqueue(obj, offset);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                farEnqueue(obj, cycle);
             }
             elems++;
         }
@@ -95,24 +151,7 @@ class PrioQueue {
             assert(elems);
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % (B/2)) == 0) farMigrate();
             }
 
             //We're now at the first populated block
@@ -142,12 +181,148 @@ class PrioQueue {
                 if (occ) {
                     uint64_t pos = __builtin_ctzl(occ);
                     uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                    return farEmpty()? cycle : MIN(cycle, farFirstCycle());
+                }
+            }
+
+            return farFirstCycle();
+        }
+
+    private:
+        inline void nearEnqueue(T* obj, uint64_t cycle) {
+            uint64_t absBlock = cycle/64;
+            assert(absBlock >= curBlock);
+            assert(absBlock < curBlock + B);
+            uint32_t i = absBlock % B;
+            uint32_t offset = cycle % 64;
+            blocks[i].enqueue(obj, offset);
+        }
+
+#if PQ_CALENDAR
+        //Far elements are grouped in windows of B/2 blocks; the current window is curBlock's
+        static inline uint64_t window(uint64_t cycle) { return cycle/(64*(B/2)); }
+
+        /* cal[] holds windows [curWindow+2, calEnd), coarse[] holds coarse windows [calEnd's, coarseEnd), and
+         * overflow the rest; anything closer than curWindow+2 is in blocks[]. Every PQ_CAL_BUCKETS/2 windows,
+         * calEnd grows to curWindow+2+PQ_CAL_BUCKETS and cal[] takes the next coarse bucket; every
+         * PQ_CAL_BUCKETS/2 coarse windows, coarseEnd grows likewise and coarse[] takes overflow elements
+         * that now fit. Between refills, the ends stay put, so each tier only holds elements later than the
+         * previous tier's, and same-cycle elements keep their enqueue order.
+         */
+        static inline uint64_t coarseWindow(uint64_t cycle) { return (window(cycle) - 2)/(PQ_CAL_BUCKETS/2); }
+
+        static inline void bucketEnqueue(CalBucket* buckets, uint64_t& occ, uint64_t idx, T* obj, uint64_t cycle) {
+            uint32_t b = idx % PQ_CAL_BUCKETS;
+            buckets[b].append(obj, cycle);
+            occ |= 1L << b;
+        }
+
+        inline void farEnqueue(T* obj, uint64_t cycle) {
+            assert(obj->privCycle == cycle);
+            if (window(cycle) < calEnd) bucketEnqueue(cal, calOcc, window(cycle), obj, cycle);
+            else if (coarseWindow(cycle) < coarseEnd) bucketEnqueue(coarse, coarseOcc, coarseWindow(cycle), obj, cycle);
+            else overflow.append(obj, cycle);
+            farElems++;
+        }
+
+        inline bool farEmpty() const {
+            return farElems == 0;
+        }
+
+        //First populated bucket at or after firstIdx, wrapping around
+        static inline uint32_t firstBucket(uint64_t occ, uint64_t firstIdx) {
+            uint32_t first = firstIdx % PQ_CAL_BUCKETS;
+            uint64_t rotOcc = (occ >> first) | (first? (occ << (64 - first)) : 0);
+            return (first + __builtin_ctzl(rotOcc)) % PQ_CAL_BUCKETS;
+        }
+
+        inline uint64_t farFirstCycle() const {
+            assert(farElems);
+            uint64_t curWindow = curBlock/(B/2);
+            if (calOcc) return cal[firstBucket(calOcc, curWindow + 2)].minCycle;
+            if (coarseOcc) return coarse[firstBucket(coarseOcc, curWindow/(PQ_CAL_BUCKETS/2) + 2)].minCycle;
+            return overflow.minCycle;
+        }
+
+        //Called when curBlock reaches a window boundary; moves the next window to blocks[] and refills tiers
+        void farMigrate() {
+            uint64_t curWindow = curBlock/(B/2);
+            uint64_t curCoarse = curWindow/(PQ_CAL_BUCKETS/2);
+            bool extendCal = (curWindow % (PQ_CAL_BUCKETS/2)) == 0;
+            bool extendCoarse = extendCal && (curCoarse % (PQ_CAL_BUCKETS/2)) == 0;
+            if (extendCal) calEnd = curWindow + 2 + PQ_CAL_BUCKETS;
+            if (extendCoarse) coarseEnd = curCoarse + 2 + PQ_CAL_BUCKETS;
+            if (!farElems) return;
+
+            uint32_t b = (curWindow + 1) % PQ_CAL_BUCKETS;
+            if (calOcc & (1L << b)) {
+                T* obj = cal[b].head;
+                while (obj) {
+                    T* next = obj->next;
+                    obj->next = nullptr;
+                    nearEnqueue(obj, obj->privCycle);
+                    farElems--;
+                    obj = next;
                 }
+                cal[b].clear();
+                calOcc ^= 1L << b;
             }
 
+            //The calendar was just extended by one coarse window; move it from coarse[]
+            uint32_t cb = (curCoarse + 1) % PQ_CAL_BUCKETS;
+            if (extendCal && (coarseOcc & (1L << cb))) {
+                T* obj = coarse[cb].head;
+                while (obj) {
+                    T* next = obj->next;
+                    obj->next = nullptr;
+                    uint64_t cycle = obj->privCycle;
+                    assert(window(cycle) < calEnd);
+                    bucketEnqueue(cal, calOcc, window(cycle), obj, cycle);
+                    obj = next;
+                }
+                coarse[cb].clear();
+                coarseOcc ^= 1L << cb;
+            }
+
+            //coarse[] was just extended; pull overflow elements that now fit
+            if (extendCoarse && overflow.head && coarseWindow(overflow.minCycle) < coarseEnd) {
+                T* obj = overflow.head;
+                overflow.clear();
+                while (obj) {
+                    T* next = obj->next;
+                    obj->next = nullptr;
+                    uint64_t cycle = obj->privCycle;
+                    if (coarseWindow(cycle) < coarseEnd) bucketEnqueue(coarse, coarseOcc, coarseWindow(cycle), obj, cycle);
+                    else overflow.append(obj, cycle);
+                    obj = next;
+                }
+            }
+        }
+#else
+        inline void farEnqueue(T* obj, uint64_t cycle) {
+            feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+        }
+
+        inline bool farEmpty() const {
+            return feMap.empty();
+        }
+
+        inline uint64_t farFirstCycle() const {
             return feMap.begin()->first;
         }
+
+        void farMigrate() {
+            if (feMap.empty()) return;
+            uint64_t topCycle = (curBlock + B)*64;
+            //Move every element with cycle < topCycle to blocks[]
+            FEMapIterator it = feMap.begin();
+            while (it != feMap.end() && it->first < topCycle) {
+                nearEnqueue(it->second, it->first);
+                it++;
+            }
+            feMap.erase(feMap.begin(), it);
+        }
+#endif
 };
 
 #endif  // PRIO_QUEUE_H_
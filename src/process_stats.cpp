@@ -23,6 +23,8 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
+#include <sstream>
 #include "process_stats.h"
 #include "process_tree.h"
 #include "scheduler.h"
@@ -93,3 +95,82 @@ void ProcessStats::update() {
     lastUpdatePhase = zinfo->numPhases;
 }
 
+
+SamplingStats::SamplingStats(uint32_t _procIdx, AggregateStat* parentStat) : procIdx(_procIdx) {
+    inWindow = false;
+    windowStartInstrs = windowStartCycles = 0;
+    cpiSum = cpiSqSum = 0.0;
+    ffInstrs = 0;
+
+    std::stringstream ss;
+    ss << "process" << procIdx;
+    AggregateStat* procStat = new AggregateStat();
+    procStat->init(gm_strdup(ss.str().c_str()), "Periodic sampling stats (only cpi is estimated from windows; other stats include warmups)");
+    profUnits.init("units", "Measured sampling units");
+    profInstrs.init("instrs", "Instructions in measurement windows");
+    profCycles.init("cycles", "Cycles in measurement windows");
+    procStat->append(&profUnits);
+    procStat->append(&profInstrs);
+    procStat->append(&profCycles);
+
+    auto totalInstrsStat = makeLambdaStat([this]() { return totalInstrs(); });
+    totalInstrsStat->init("totalInstrs", "Instructions of the full run, including fast-forwarded ones");
+    procStat->append(totalInstrsStat);
+
+    auto cpiStat = makeLambdaStat([this]() -> uint64_t { return (uint64_t)(1e6*cpi() + 0.5); });
+    cpiStat->init("cpi", "Estimated CPI of the full run, in millionths");
+    procStat->append(cpiStat);
+
+    auto ciStat = makeLambdaStat([this]() -> uint64_t { return (uint64_t)(1e6*cpiCI95() + 0.5); });
+    ciStat->init("cpiCI95", "Half-width of the 95% confidence interval of cpi, in millionths");
+    procStat->append(ciStat);
+
+    auto estCyclesStat = makeLambdaStat([this]() -> uint64_t { return (uint64_t)(cpi()*totalInstrs() + 0.5); });
+    estCyclesStat->init("estCycles", "Estimated cycles of the full run (cpi * totalInstrs)");
+    procStat->append(estCyclesStat);
+
+    parentStat->append(procStat);
+}
+
+void SamplingStats::beginWindow() {
+    windowStartInstrs = zinfo->processStats->getProcessInstrs(procIdx);
+    windowStartCycles = zinfo->processStats->getProcessCycles(procIdx);
+    inWindow = true;
+}
+
+void SamplingStats::endWindow() {
+    if (!inWindow) return; //window was too short to start (e.g., process blocked for a while); skip unit
+    inWindow = false;
+    uint64_t instrs = zinfo->processStats->getProcessInstrs(procIdx) - windowStartInstrs;
+    uint64_t cycles = zinfo->processStats->getProcessCycles(procIdx) - windowStartCycles;
+    if (!instrs) return;
+
+    double unitCpi = ((double)cycles)/instrs;
+    cpiSum += unitCpi;
+    cpiSqSum += unitCpi*unitCpi;
+    profUnits.inc();
+    profInstrs.inc(instrs);
+    profCycles.inc(cycles);
+}
+
+uint64_t SamplingStats::totalInstrs() const {
+    return ffInstrs + zinfo->processStats->getProcessInstrs(procIdx);
+}
+
+/* Units are (nearly) equal-sized and systematically sampled, so the mean of per-unit CPIs is an
+ * unbiased estimator of the run's CPI, and its CI follows from the sample variance of unit CPIs.
+ * We ignore the finite population correction, so the CI is slightly conservative.
+ */
+double SamplingStats::cpi() const {
+    uint64_t n = profUnits.get();
+    return n? cpiSum/n : 0.0;
+}
+
+double SamplingStats::cpiCI95() const {
+    uint64_t n = profUnits.get();
+    if (n < 2) return 0.0;
+    double mean = cpiSum/n;
+    double var = (cpiSqSum - n*mean*mean)/(n - 1);
+    if (var < 0.0) var = 0.0; //rounding
+    return 1.96*sqrt(var/n);
+}
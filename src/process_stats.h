@@ -54,4 +54,35 @@ class ProcessStats : public GlobAlloc {
         void update(); //transparent
 };
 
+/* Periodic (SMARTS-style) sampling of a process: every samplingPeriod instructions, the process
+ * runs a detailed warmup interval followed by a measurement window, and is fast-forwarded (with
+ * functional warming) otherwise. This class gathers the CPI of each measurement window and
+ * estimates the CPI of the whole run, with its confidence interval, from them. Only CPI (and
+ * cycles derived from it) is estimated this way; all other stats accumulate over every detailed
+ * interval, including warmups.
+ */
+class SamplingStats : public GlobAlloc {
+    private:
+        const uint32_t procIdx;
+        bool inWindow;
+        uint64_t windowStartInstrs, windowStartCycles;
+        double cpiSum, cpiSqSum; //over measured units
+        volatile uint64_t ffInstrs; //fast-forwarded instrs, written by the process itself
+
+        Counter profUnits, profInstrs, profCycles;
+
+    public:
+        SamplingStats(uint32_t _procIdx, AggregateStat* parentStat);
+
+        // Called from events (see FFI code in zsim.cpp), should call ONLY when quiesced
+        void beginWindow();
+        void endWindow();
+
+        void setFFInstrs(uint64_t instrs) { ffInstrs = instrs; }
+        uint64_t totalInstrs() const;
+
+        double cpi() const;
+        double cpiCI95() const;
+};
+
 #endif  // PROCESS_STATS_H_
@@ -187,6 +187,32 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
         }  //  else leave mask empty, no cores
         g_vector<uint64_t> ffiPoints(ParseList<uint64_t>(config.get<const char*>(p_ss.str() +  ".ffiPoints", "")));
 
+        //Periodic sampling: every samplingPeriod instrs, simulate samplingWarmup + samplingWindow instrs in detail and fast-forward the rest.
+        //Only the window is measured. FFI switches are detected at phase granularity, so warmup and window should span several phases.
+        uint64_t samplingPeriod = config.get<uint64_t>(p_ss.str() +  ".samplingPeriod", 0);
+        uint64_t samplingWarmup = 0;
+        if (samplingPeriod) {
+            samplingWarmup = config.get<uint64_t>(p_ss.str() +  ".samplingWarmup", 100000);
+            uint64_t samplingWindow = config.get<uint64_t>(p_ss.str() +  ".samplingWindow", 100000);
+            if (!ffiPoints.empty()) panic("%s.ffiPoints and %s.samplingPeriod are incompatible", p_ss.str().c_str(), p_ss.str().c_str());
+            if (!samplingWindow) panic("%s.samplingWindow must be non-zero", p_ss.str().c_str());
+            if (samplingWarmup + samplingWindow >= samplingPeriod) {
+                panic("%s: samplingWarmup + samplingWindow (%ld) must be smaller than samplingPeriod (%ld)",
+                        p_ss.str().c_str(), samplingWarmup + samplingWindow, samplingPeriod);
+            }
+            //Each unit starts fast-forwarded, so the process must too
+            if (!startFastForwarded) {
+                info("%s: periodic sampling, starting fast-forwarded", p_ss.str().c_str());
+                startFastForwarded = true;
+            }
+            ffiPoints.push_back(samplingPeriod - samplingWarmup - samplingWindow);
+            ffiPoints.push_back(samplingWarmup + samplingWindow);
+        }
+
+        bool ffWarm = config.get<bool>(p_ss.str() +  ".ffWarm", samplingPeriod != 0); //warm up caches with the accesses of fast-forwarded code
+        if (ffWarm && zinfo->traceDriven) panic("%s.ffWarm needs an execution-driven simulation", p_ss.str().c_str());
+        if (ffWarm && zinfo->ffReinstrument) panic("%s.ffWarm needs memory instrumentation during fast-forwarding, incompatible with sim.ffReinstrument", p_ss.str().c_str());
+
         if (dumpInstrs) {
             if (dumpHeartbeats) warn("Dumping eventual stats on both heartbeats AND instructions; you won't be able to distinguish both!");
             auto getInstrs = [procIdx]() { return zinfo->processStats->getProcessInstrs(procIdx); };
@@ -207,7 +233,7 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
         else
             panic("Invalid synced fast forward mode %s", syncedFastForwardStr.c_str());
 
-        ProcessTreeNode* ptn = new ProcessTreeNode(procIdx, groupIdx, startFastForwarded, startPaused, syncedFastForward, clockDomain, portDomain, dumpHeartbeats, dumpsResetHeartbeats, restarts, mask, ffiPoints, syscallBlacklistRegex, gpr);
+        ProcessTreeNode* ptn = new ProcessTreeNode(procIdx, groupIdx, startFastForwarded, startPaused, syncedFastForward, clockDomain, portDomain, dumpHeartbeats, dumpsResetHeartbeats, restarts, mask, ffiPoints, ffWarm, samplingPeriod, samplingWarmup, syscallBlacklistRegex, gpr);
         //info("Created ProcessTreeNode, procIdx %d", procIdx);
         parent->addChild(ptn);
         children.push_back(ptn);
@@ -229,7 +255,7 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
 }
 
 void CreateProcessTree(Config& config) {
-    ProcessTreeNode* rootNode = new ProcessTreeNode(-1, -1, false, false, SFF_NEVER, 0, 0, 0, false, 0, g_vector<bool> {},  g_vector<uint64_t> {}, g_string {}, nullptr);
+    ProcessTreeNode* rootNode = new ProcessTreeNode(-1, -1, false, false, SFF_NEVER, 0, 0, 0, false, 0, g_vector<bool> {},  g_vector<uint64_t> {}, false, 0, 0, g_string {}, nullptr);
     uint32_t procIdx = 0;
     uint32_t groupIdx = 0;
     std::vector<ProcessTreeNode*> globProcVector;
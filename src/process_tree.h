@@ -33,6 +33,7 @@
 #include "zsim.h"
 
 class Config;
+class SamplingStats;
 
 enum SyncedFastForwardMode {
     SFF_ALWAYS,
@@ -59,14 +60,20 @@ class ProcessTreeNode : public GlobAlloc {
         const bool dumpsResetHeartbeats;
         const g_vector<bool> mask;
         const g_vector<uint64_t> ffiPoints;
+        const bool ffWarm; //if true, memory accesses during fast-forwarding warm up caches
+        const uint64_t samplingPeriod; //if non-zero, ffiPoints are a periodic sampling schedule that repeats forever
+        const uint64_t samplingWarmup; //detailed instrs at the start of each sampling unit that are not measured
+        SamplingStats* samplingStats; //set post-system init
         const g_string syscallBlacklistRegex;
 
     public:
         ProcessTreeNode(uint32_t _procIdx, uint32_t _groupIdx, bool _inFastForward, bool _inPause, const SyncedFastForwardMode& _syncedFastForward,
                         uint32_t _clockDomain, uint32_t _portDomain, uint64_t _dumpHeartbeats, bool _dumpsResetHeartbeats, uint32_t _restarts,
-                        const g_vector<bool>& _mask, const g_vector<uint64_t>& _ffiPoints, const g_string& _syscallBlacklistRegex, const char*_patchRoot)
+                        const g_vector<bool>& _mask, const g_vector<uint64_t>& _ffiPoints, bool _ffWarm,
+                        uint64_t _samplingPeriod, uint64_t _samplingWarmup, const g_string& _syscallBlacklistRegex, const char*_patchRoot)
             : patchRoot(_patchRoot), procIdx(_procIdx), groupIdx(_groupIdx), curChildren(0), heartbeats(0), started(false), inFastForward(_inFastForward),
-              inPause(_inPause), restartsLeft(_restarts), syncedFastForward(_syncedFastForward), clockDomain(_clockDomain), portDomain(_portDomain), dumpHeartbeats(_dumpHeartbeats), dumpsResetHeartbeats(_dumpsResetHeartbeats), mask(_mask), ffiPoints(_ffiPoints), syscallBlacklistRegex(_syscallBlacklistRegex) {}
+              inPause(_inPause), restartsLeft(_restarts), syncedFastForward(_syncedFastForward), clockDomain(_clockDomain), portDomain(_portDomain), dumpHeartbeats(_dumpHeartbeats), dumpsResetHeartbeats(_dumpsResetHeartbeats), mask(_mask), ffiPoints(_ffiPoints), ffWarm(_ffWarm),
+              samplingPeriod(_samplingPeriod), samplingWarmup(_samplingWarmup), samplingStats(nullptr), syscallBlacklistRegex(_syscallBlacklistRegex) {}
 
         void addChild(ProcessTreeNode* child) {
             children.push_back(child);
@@ -74,6 +81,8 @@ class ProcessTreeNode : public GlobAlloc {
 
         ProcessTreeNode* getNextChild() {
             if (curChildren == children.size()) { //allocate a new child
+                //Stats are fixed after init, so children created on the fly cannot get their own sampling stats
+                if (samplingPeriod) panic("Process %d uses periodic sampling and forked a child not in the config; sampled processes cannot fork", procIdx);
                 uint32_t childProcIdx = __sync_fetch_and_add(&zinfo->numProcs, 1);
                 if (childProcIdx >= (uint32_t)zinfo->lineSize) {
                     panic("Cannot simulate more than sys.lineSize=%d processes (to avoid aliasing), limit reached", zinfo->lineSize);
@@ -140,6 +149,27 @@ class ProcessTreeNode : public GlobAlloc {
             return ffiPoints;
         }
 
+        inline bool getFFWarm() const {
+            return ffWarm;
+        }
+
+        inline uint64_t getSamplingPeriod() const {
+            return samplingPeriod;
+        }
+
+        inline uint64_t getSamplingWarmup() const {
+            return samplingWarmup;
+        }
+
+        inline SamplingStats* getSamplingStats() const {
+            return samplingStats;
+        }
+
+        void setSamplingStats(SamplingStats* s) {
+            assert(samplingPeriod);
+            samplingStats = s;
+        }
+
         const g_string& getSyscallBlacklistRegex() const {
             return syscallBlacklistRegex;
         }
@@ -29,6 +29,7 @@
 #include <functional>
 #include "bithacks.h"
 #include "cache_arrays.h"
+#include "checkpoint.h"
 #include "coherence_ctrls.h"
 #include "memory_hierarchy.h"
 #include "mtrand.h"
@@ -54,6 +55,9 @@ class ReplPolicy : public GlobAlloc {
         virtual uint32_t rankCands(const MemReq* req, ZCands cands) = 0;
 
         virtual void initStats(AggregateStat* parent) {}
+
+        //Saves or restores replacement state (see checkpoint.h)
+        virtual void serialize(Checkpoint& ck) {panic("This replacement policy does not support checkpoints");}
 };
 
 /* Add DECL_RANK_BINDINGS to each class that implements the new interface,
@@ -92,17 +96,19 @@ class LegacyReplPolicy : public virtual ReplPolicy {
 };
 
 /* Plain ol' LRU, though this one is sharers-aware, prioritizing lines that have
- * sharers down in the hierarchy vs lines not shared by anyone.
+ * sharers down in the hierarchy vs lines not shared by anyone. CCType can be set
+ * to the exact (final) coherence controller type to devirtualize candidate scoring.
  */
-template <bool sharersAware>
+template <bool sharersAware, typename CCType = CC>
 class LRUReplPolicy : public ReplPolicy {
     protected:
         uint64_t timestamp; // incremented on each access
         uint64_t* array;
         uint32_t numLines;
+        bool atomicTimestamp; // with lock striping, updates to different sets can race (see CCLocks)
 
     public:
-        explicit LRUReplPolicy(uint32_t _numLines) : timestamp(1), numLines(_numLines) {
+        explicit LRUReplPolicy(uint32_t _numLines, bool _atomicTimestamp = false) : timestamp(1), numLines(_numLines), atomicTimestamp(_atomicTimestamp) {
             array = gm_calloc<uint64_t>(numLines);
         }
 
@@ -111,13 +117,20 @@ class LRUReplPolicy : public ReplPolicy {
         }
 
         void update(uint32_t id, const MemReq* req) {
-            array[id] = timestamp++;
+            array[id] = unlikely(atomicTimestamp)? __sync_fetch_and_add(&timestamp, 1) : timestamp++;
         }
 
         void replaced(uint32_t id) {
             array[id] = 0;
         }
 
+        void serialize(Checkpoint& ck) {
+            ck.section("LRU");
+            ck.check("lines", numLines);
+            ck.io(timestamp);
+            ck.io(array, numLines);
+        }
+
         template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
             uint32_t bestCand = -1;
             uint64_t bestScore = (uint64_t)-1L;
@@ -137,10 +150,20 @@ class LRUReplPolicy : public ReplPolicy {
             // (1) valid (if not valid, it's 0)
             // (2) sharers, and
             // (3) timestamp
-            return (sharersAware? cc->numSharers(id) : 0)*timestamp + array[id]*cc->isValid(id);
+            CCType* tcc = static_cast<CCType*>(cc);
+            return (sharersAware? tcc->numSharers(id) : 0)*timestamp + array[id]*tcc->isValid(id);
         }
 };
 
+/* Leaf (final) version of a replacement policy. Calls through a pointer to it are direct and can be inlined,
+ * which devirtualized arrays and caches (see TypedCache) rely on. Behavior is the same as T's.
+ */
+template <typename T>
+class FinalReplPolicy final : public T {
+    public:
+        template <typename... Args> explicit FinalReplPolicy(Args... args) : T(args...) {}
+};
+
 //This is VERY inefficient, uses LRU timestamps to do something that in essence requires a few bits.
 //If you want to use this frequently, consider a reimplementation
 class TreeLRUReplPolicy : public LRUReplPolicy<true> {
@@ -243,12 +266,29 @@ class NRUReplPolicy : public LegacyReplPolicy {
             return candArray[youngLines % candIdx]; // youngLines used to sort-of-randomize
         }
 
+        // Same as LegacyReplPolicy's, but with direct calls, so it can be inlined in devirtualized arrays
+        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                NRUReplPolicy::recordCandidate(*ci);
+            }
+            return NRUReplPolicy::getBestCandidate();
+        }
+
+        DECL_RANK_BINDINGS;
+
         void replaced(uint32_t id) {
             //info("repl %d val %d cands %d", id, array[id], candIdx);
             candVal = (1<<20);
             candIdx = 0;
             array[id] = 0;
         }
+
+        void serialize(Checkpoint& ck) {
+            ck.section("NRU");
+            ck.check("lines", numLines);
+            ck.io(youngLines);
+            ck.io(array, numLines);
+        }
 };
 
 class RandReplPolicy : public LegacyReplPolicy {
@@ -286,6 +326,14 @@ class RandReplPolicy : public LegacyReplPolicy {
         void replaced(uint32_t id) {
             candIdx = 0;
         }
+
+        void serialize(Checkpoint& ck) {
+            ck.section("Rand");
+            uint64_t rndState[MTRand::SAVE];
+            if (ck.saving()) rnd.save(rndState);
+            ck.io(rndState, MTRand::SAVE);
+            if (ck.restoring()) rnd.load(rndState);
+        }
 };
 
 class LFUReplPolicy : public LegacyReplPolicy {
@@ -370,6 +418,13 @@ class LFUReplPolicy : public LegacyReplPolicy {
             bestRank.reset();
             array[id].acc = 0;
         }
+
+        void serialize(Checkpoint& ck) {
+            ck.section("LFU");
+            ck.check("lines", numLines);
+            ck.io(timestamp);
+            ck.io(array, numLines);
+        }
 };
 
 //Extends a given replacement policy to profile access ordering violations
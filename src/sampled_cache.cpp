@@ -0,0 +1,177 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sampled_cache.h"
+#include <math.h>
+#include "checkpoint.h"
+
+//Window of sampled-set GETs and evictions that untracked accesses follow; halved when full
+#define WINDOW_GETS (16*1024)
+#define WINDOW_EVICTIONS (4*1024)
+
+SampledCache::SampledCache(uint32_t _numLines, MESICC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat,
+        SampledSetsHashFamily* _sampler, uint32_t _sampledSets, uint32_t _fullSets, const g_string& _name)
+    : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), mcc(_cc), sampler(_sampler), sampledSets(_sampledSets),
+      fullSets(_fullSets), rnd(0x5A3B1ED + _sampledSets), winGETs(0), winMisses(0), victimPoolPos(0)
+{
+    assert(sampledSets < fullSets);
+    for (uint32_t i = 0; i < 3; i++) winEvictions[i] = 0;
+    victimPool = gm_calloc<Address>(SampledAccess::VICTIM_POOL_SIZE);
+    setGETs = gm_calloc<uint64_t>(sampledSets);
+    setMisses = gm_calloc<uint64_t>(sampledSets);
+}
+
+void SampledCache::setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
+    for (MemObject* p : parents) {
+        if (dynamic_cast<BaseCache*>(p)) {
+            panic("[%s] Set-sampled caches must be last-level caches (parent %s is a cache)", name.c_str(), p->getName());
+        }
+    }
+    Cache::setParents(childId, parents, network);
+}
+
+void SampledCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* cacheStat = new AggregateStat();
+    cacheStat->init(name.c_str(), "Set-sampled cache stats");
+    initCacheStats(cacheStat);
+
+    AggregateStat* samplingStat = new AggregateStat();
+    samplingStat->init("sampling", "Set sampling stats (hit/miss counters above include estimated untracked accesses)");
+    profSampledGETs.init("sGETs", "GETs on sampled sets, excluding upgrades");
+    profSampledMisses.init("sMisses", "GET misses on sampled sets");
+    profUntrackedGETs.init("uGETs", "GETs on untracked sets, excluding upgrades");
+    profUntrackedMisses.init("uMisses", "Estimated GET misses on untracked sets");
+    samplingStat->append(&profSampledGETs);
+    samplingStat->append(&profSampledMisses);
+    samplingStat->append(&profUntrackedGETs);
+    samplingStat->append(&profUntrackedMisses);
+
+    auto ratioLambda = [this]() -> uint64_t { return (uint64_t)(1e6*missRatio() + 0.5); };
+    auto ratioStat = makeLambdaStat(ratioLambda);
+    ratioStat->init("missRatio", "Estimated GET miss ratio of the full cache, in parts per million");
+    samplingStat->append(ratioStat);
+
+    auto ciLambda = [this]() -> uint64_t { return (uint64_t)(1e6*missRatioCI95() + 0.5); };
+    auto ciStat = makeLambdaStat(ciLambda);
+    ciStat->init("missRatioCI95", "Half-width of the 95% confidence interval of missRatio, in parts per million");
+    samplingStat->append(ciStat);
+
+    cacheStat->append(samplingStat);
+    parentStat->append(cacheStat);
+}
+
+void SampledCache::serialize(Checkpoint& ck) {
+    Cache::serialize(ck);
+    ck.io(winGETs);
+    ck.io(winMisses);
+    ck.io(winEvictions, 3);
+    ck.io(victimPool, SampledAccess::VICTIM_POOL_SIZE);
+    ck.io(victimPoolPos);
+    ck.io(setGETs, sampledSets);
+    ck.io(setMisses, sampledSets);
+}
+
+uint64_t SampledCache::access(MemReq& req) {
+    SampledAccess sa(this, req.lineAddr);
+    return accessImpl(&sa, &sa, req);
+}
+
+bool SampledCache::untrackedHit(const MemReq& req) {
+    //PUTs and upgrades hit: children may only hold lines we hold, and we are exclusive w.r.t. memory
+    if (req.type == PUTS || req.type == PUTX) return true;
+    if (isUpgrade(req)) return true;
+
+    //Until sampled sets have seen any GETs, untracked ones miss (as in a cold cache)
+    bool hit = winGETs && rnd.randExc()*winGETs >= winMisses;
+    if (!req.is(MemReq::WARMUP)) { //warmup accesses are not profiled
+        profUntrackedGETs.inc();
+        if (!hit) profUntrackedMisses.inc();
+    }
+    return hit;
+}
+
+MESIState SampledCache::untrackedVictimState() {
+    uint64_t total = winEvictions[0] + winEvictions[1] + winEvictions[2];
+    if (!total) return I;
+    double r = rnd.randExc()*total;
+    if (r < winEvictions[0]) return I;
+    else if (r < winEvictions[0] + winEvictions[1]) return E;
+    else return M;
+}
+
+//Warmup GETs (prof == false) train the miss ratio window, but are not profiled
+void SampledCache::recordSampledGET(uint32_t set, bool miss, bool prof) {
+    assert(set < sampledSets);
+    if (prof) profSampledGETs.inc();
+    setGETs[set]++;
+    winGETs++;
+    if (miss) {
+        if (prof) profSampledMisses.inc();
+        setMisses[set]++;
+        winMisses++;
+    }
+    if (winGETs == WINDOW_GETS) {
+        winGETs /= 2;
+        winMisses /= 2;
+    }
+}
+
+void SampledCache::recordSampledEviction(MESIState state) {
+    uint32_t idx = (state == I)? 0 : ((state == M)? 2 : 1);
+    winEvictions[idx]++;
+    if (winEvictions[0] + winEvictions[1] + winEvictions[2] == WINDOW_EVICTIONS) {
+        for (uint32_t i = 0; i < 3; i++) winEvictions[i] /= 2;
+    }
+}
+
+double SampledCache::missRatio() const {
+    uint64_t gets = profSampledGETs.get();
+    return gets? ((double)profSampledMisses.get())/gets : 0.0;
+}
+
+/* Sampled sets are a cluster sample of the bank's sets, so the miss ratio is a ratio estimator over
+ * clusters. Its variance is (1 - k/K) * s^2 / (k * gbar^2), with k of K sets sampled, gbar the mean
+ * GETs per sampled set, and s^2 the sample variance of the per-set residuals misses_i - r*GETs_i.
+ */
+double SampledCache::missRatioCI95() const {
+    uint64_t gets = 0;
+    uint64_t misses = 0;
+    for (uint32_t s = 0; s < sampledSets; s++) {
+        gets += setGETs[s];
+        misses += setMisses[s];
+    }
+    if (!gets) return 0.0;
+
+    double r = ((double)misses)/gets;
+    double ssr = 0.0;
+    for (uint32_t s = 0; s < sampledSets; s++) {
+        double res = setMisses[s] - r*setGETs[s];
+        ssr += res*res;
+    }
+    double k = sampledSets;
+    double gbar = gets/k;
+    double var = (1.0 - k/fullSets) * (ssr/(k - 1)) / (k*gbar*gbar);
+    return 1.96*sqrt(var);
+}
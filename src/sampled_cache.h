@@ -0,0 +1,200 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLED_CACHE_H_
+#define SAMPLED_CACHE_H_
+
+#include "cache.h"
+#include "hash.h"
+#include "mtrand.h"
+
+/* Set sampling: a large last-level cache bank simulates only 1 of every N of its sets (chosen by hashing,
+ * so the sample is spread evenly over the address space), and treats the rest statistically. The sampled
+ * sets have full tags, replacement and directory state, in an array N times smaller than the full bank.
+ */
+
+/* Wraps the bank's hash family. hash() scrambles the set index of the full bank with a bijection; a
+ * line is sampled iff its scrambled set (hash 0) falls in [0, sampledSets), which is then its set in the
+ * small array. Other hash functions (zcache ways) are scrambled the same way and masked by the array.
+ */
+class SampledSetsHashFamily : public HashFamily {
+    private:
+        HashFamily* const hf;
+        const uint64_t fullMask; //set mask of the full bank
+        const uint32_t xorShift;
+        const uint32_t sampledBits;
+
+        inline uint64_t mix(uint64_t h) const {
+            //Multiplications by odd constants and xorshifts are bijective modulo 2^setBits
+            uint64_t x = ((h & fullMask) * 0x9E3779B97F4A7C15ULL) & fullMask;
+            x ^= x >> xorShift;
+            return (x * 0xC2B2AE3D27D4EB4FULL) & fullMask;
+        }
+
+    public:
+        SampledSetsHashFamily(HashFamily* _hf, uint32_t setBits, uint32_t _sampledBits)
+            : hf(_hf), fullMask((1ul << setBits) - 1), xorShift((setBits + 1)/2), sampledBits(_sampledBits) {}
+
+        uint64_t hash(uint32_t id, uint64_t val) {
+            return mix(hf->hash(id, val));
+        }
+
+        void hashes(uint64_t val, uint32_t n, uint64_t* res) {
+            hf->hashes(val, n, res);
+            for (uint32_t i = 0; i < n; i++) res[i] = mix(res[i]);
+        }
+
+        //Returns the line's set in the sampled array, or -1 if its set is not sampled
+        inline int32_t sampledSet(Address lineAddr) {
+            uint64_t h = mix(hf->hash(0, lineAddr));
+            return (h >> sampledBits)? -1 : (int32_t)h;
+        }
+};
+
+/* Set-sampled cache. Accesses to sampled sets are simulated as in Cache. Accesses to other sets hit
+ * with the miss ratio recently observed on the sampled sets, and their misses evict a line chosen from
+ * a small pool of recently missed untracked lines, clean or dirty as recently observed on sampled
+ * evictions. Coherence controller stats thus estimate full-bank behavior; the "sampling" stats report
+ * exact sampled-set counts, the estimated miss ratio and its 95% confidence interval.
+ *
+ * Untracked sets have no directory, so coherence with children is kept by broadcasting inexact invalidates
+ * (see MESICC::processUntrackedAccess): sharing among children is exact, but untracked GETS never grant E.
+ * Limitations: the bank must be the last level (nothing above it can invalidate untracked lines). Only MESICC.
+ */
+class SampledCache : public Cache {
+    private:
+        class SampledAccess;
+
+        MESICC* mcc;
+        SampledSetsHashFamily* sampler;
+        uint32_t sampledSets;
+        uint32_t fullSets;
+        MTRand rnd;
+
+        //Recent behavior of sampled sets, used to model untracked accesses. Decayed; protected by the CC's locks
+        uint64_t winGETs, winMisses;
+        uint64_t winEvictions[3]; //victims in I, clean, and dirty state
+
+        //Recently missed untracked lines, evicted by later untracked misses
+        Address* victimPool;
+        uint32_t victimPoolPos;
+
+        //Per-sampled-set GETs and misses, for the confidence interval
+        uint64_t* setGETs;
+        uint64_t* setMisses;
+
+        Counter profSampledGETs, profSampledMisses;
+        Counter profUntrackedGETs, profUntrackedMisses;
+
+    public:
+        SampledCache(uint32_t _numLines, MESICC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat,
+                SampledSetsHashFamily* _sampler, uint32_t _sampledSets, uint32_t _fullSets, const g_string& _name);
+
+        void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network);
+        void initStats(AggregateStat* parentStat);
+        void serialize(Checkpoint& ck);
+
+        uint64_t access(MemReq& req);
+
+    private:
+        //Upgrades always hit (children only hold lines we hold), so neither path counts them as GETs
+        static inline bool isUpgrade(const MemReq& req) {return req.type == GETX && *req.state == S;}
+
+        bool untrackedHit(const MemReq& req);
+        MESIState untrackedVictimState();
+        void recordSampledGET(uint32_t set, bool miss, bool prof);
+        void recordSampledEviction(MESIState state);
+
+        double missRatio() const;
+        double missRatioCI95() const;
+};
+
+/* Adapts an access to the array and CC interfaces used by Cache::accessImpl, so sampled-set accesses
+ * follow Cache's path exactly and untracked ones replace the array and CC steps with estimates.
+ */
+class SampledCache::SampledAccess {
+    private:
+        SampledCache* const sc;
+        const int32_t set; //-1 if untracked
+        bool untrackedHit;
+        Address victimAddr;
+
+        static const int32_t UNTRACKED_LINE = 0; //lineId passed around by accessImpl for untracked lines
+
+    public:
+        static const uint32_t VICTIM_POOL_SIZE = 64;
+
+        SampledAccess(SampledCache* _sc, Address lineAddr) : sc(_sc), set(_sc->sampler->sampledSet(lineAddr)),
+            untrackedHit(false), victimAddr(0) {}
+
+        //Array interface
+        inline int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+            if (set >= 0) {
+                int32_t lineId = sc->array->lookup(lineAddr, req, updateReplacement);
+                if (updateReplacement && !SampledCache::isUpgrade(*req)) sc->recordSampledGET(set, lineId == -1, !req->is(MemReq::WARMUP));
+                return lineId;
+            } else {
+                untrackedHit = sc->untrackedHit(*req);
+                return untrackedHit? UNTRACKED_LINE : -1;
+            }
+        }
+
+        inline uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+            if (set >= 0) return sc->array->preinsert(lineAddr, req, wbLineAddr);
+            uint32_t pos = sc->victimPoolPos;
+            victimAddr = sc->victimPool[pos];
+            sc->victimPool[pos] = lineAddr;
+            sc->victimPoolPos = (pos + 1 == VICTIM_POOL_SIZE)? 0 : pos + 1;
+            *wbLineAddr = victimAddr;
+            return UNTRACKED_LINE;
+        }
+
+        inline void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) {
+            if (set >= 0) sc->array->postinsert(lineAddr, req, lineId);
+        }
+
+        //CC interface
+        inline bool startAccess(MemReq& req) {return sc->mcc->startAccess(req);}
+        inline bool shouldAllocate(const MemReq& req) {return sc->mcc->shouldAllocate(req);}
+        inline void endAccess(const MemReq& req) {sc->mcc->endAccess(req);}
+
+        inline uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
+            if (set >= 0) {
+                sc->recordSampledEviction(sc->mcc->getState(lineId));
+                return sc->mcc->processEviction(triggerReq, wbLineAddr, lineId, startCycle);
+            } else {
+                //An empty pool slot is an invalid victim, as with the first misses to an empty set
+                MESIState victimState = victimAddr? sc->untrackedVictimState() : I;
+                return sc->mcc->processUntrackedEviction(triggerReq, wbLineAddr, victimState, startCycle);
+            }
+        }
+
+        inline uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle) {
+            if (set >= 0) return sc->mcc->processAccess(req, lineId, startCycle);
+            return sc->mcc->processUntrackedAccess(req, untrackedHit, startCycle);
+        }
+};
+
+#endif  // SAMPLED_CACHE_H_
@@ -0,0 +1,105 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shadow_cache.h"
+#include "checkpoint.h"
+
+void ShadowCC::serialize(Checkpoint& ck) {
+    ck.section("ShadowCC");
+    ck.check("lines", numLines);
+    ck.io(state, numLines);
+}
+
+void ShadowCache::access(const MemReq& req) {
+    switch (req.type) {
+        case GETS:
+        case GETX:
+            {
+                int32_t lineId = array->lookup(req.lineAddr, &req, true);
+                if (lineId == -1) {
+                    Address wbLineAddr;
+                    lineId = array->preinsert(req.lineAddr, &req, &wbLineAddr);
+                    if (scc->isDirty(lineId)) profWritebacks.inc();
+                    array->postinsert(req.lineAddr, &req, lineId);
+                    scc->setClean(lineId);
+                    if (req.type == GETS) profGETSMiss.inc();
+                    else profGETXMiss.inc();
+                } else {
+                    if (req.type == GETS) profGETSHit.inc();
+                    else profGETXHit.inc();
+                }
+            }
+            break;
+        case PUTX:
+            {
+                //As in the bank, writebacks do not update replacement state
+                int32_t lineId = array->lookup(req.lineAddr, &req, false);
+                if (lineId == -1) profWritebacks.inc(); //the shadow evicted the line but children kept it; data goes up
+                else scc->setDirty(lineId);
+            }
+            break;
+        case PUTS:
+            break;
+        default:
+            panic("[%s] Invalid request type %s", name.c_str(), AccessTypeName(req.type));
+    }
+}
+
+void ShadowCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* shadowStat = new AggregateStat();
+    shadowStat->init(name.c_str(), "Shadow cache stats");
+    profGETSHit.init("hGETS", "GETS hits");
+    profGETXHit.init("hGETX", "GETX hits");
+    profGETSMiss.init("mGETS", "GETS misses");
+    profGETXMiss.init("mGETX", "GETX misses");
+    profWritebacks.init("wbs", "Dirty lines written back to the next level");
+    shadowStat->append(&profGETSHit);
+    shadowStat->append(&profGETXHit);
+    shadowStat->append(&profGETSMiss);
+    shadowStat->append(&profGETXMiss);
+    shadowStat->append(&profWritebacks);
+    array->initStats(shadowStat);
+    rp->initStats(shadowStat);
+    parentStat->append(shadowStat);
+}
+
+void ShadowCache::serialize(Checkpoint& ck) {
+    ck.section("shadow", name.c_str());
+    array->serialize(ck);
+    rp->serialize(ck);
+    scc->serialize(ck);
+}
+
+void ShadowCaches::initStats(AggregateStat* cacheStat) {
+    AggregateStat* shadowsStat = new AggregateStat();
+    shadowsStat->init("shadows", "Shadow caches (alternative configurations, tags only)");
+    for (ShadowCache* s : shadows) s->initStats(shadowsStat);
+    cacheStat->append(shadowsStat);
+}
+
+void ShadowCaches::serialize(Checkpoint& ck) {
+    ck.check("shadows", shadows.size());
+    for (ShadowCache* s : shadows) s->serialize(ck);
+}
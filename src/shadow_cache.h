@@ -0,0 +1,129 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHADOW_CACHE_H_
+#define SHADOW_CACHE_H_
+
+#include "cache_arrays.h"
+#include "coherence_ctrls.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "repl_policies.h"
+#include "stats.h"
+
+/* Shadow caches: tag-only models of alternative configurations of a cache bank (size, array, replacement),
+ * fed the same access stream as the bank. They do not affect timing or coherence; they only count the hits
+ * and misses each configuration would have had, so a single run can evaluate many configurations.
+ *
+ * A shadow sees the requests its bank receives, which depend on the bank's own contents only through
+ * inclusion (children's evictions caused by the real bank's replacements). Results match a run with the
+ * shadow's configuration for banks whose children are much smaller, e.g., the LLC.
+ */
+
+/* Keeps per-line valid and dirty state for a shadow cache's replacement policy. Shadows have no sharers
+ * and no coherence traffic, so only the replacement policy interface is used.
+ */
+class ShadowCC : public CC {
+    private:
+        enum LineState : uint8_t {INVALID = 0, CLEAN, DIRTY};
+        LineState* state;
+        uint32_t numLines;
+
+    public:
+        explicit ShadowCC(uint32_t _numLines) : numLines(_numLines) {
+            state = gm_calloc<LineState>(numLines);
+        }
+
+        inline bool isDirty(uint32_t lineId) const {return state[lineId] == DIRTY;}
+        inline void setClean(uint32_t lineId) {state[lineId] = CLEAN;}
+        inline void setDirty(uint32_t lineId) {state[lineId] = DIRTY;}
+
+        //Repl policy interface
+        uint32_t numSharers(uint32_t lineId) {return 0;}
+        bool isValid(uint32_t lineId) {return state[lineId] != INVALID;}
+
+        void serialize(Checkpoint& ck);
+
+        //Not used by shadows
+        void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {panic("ShadowCC has no parents");}
+        void setChildren(const g_vector<BaseCache*>& children, Network* network) {panic("ShadowCC has no children");}
+        void initStats(AggregateStat* cacheStat) {}
+        uint32_t getNumChildren() const {return 1;}
+        bool startAccess(MemReq& req) {panic("ShadowCC does not process accesses");}
+        bool shouldAllocate(const MemReq& req) {panic("ShadowCC does not process accesses");}
+        uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {panic("ShadowCC does not process accesses");}
+        uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle = nullptr) {panic("ShadowCC does not process accesses");}
+        void endAccess(const MemReq& req) {panic("ShadowCC does not process accesses");}
+        void startInv(const InvReq& req) {panic("ShadowCC does not process invalidations");}
+        uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {panic("ShadowCC does not process invalidations");}
+        void skipInv(const InvReq& req) {panic("ShadowCC does not process invalidations");}
+};
+
+// A single alternative configuration
+class ShadowCache : public GlobAlloc {
+    private:
+        CacheArray* array;
+        ReplPolicy* rp;
+        ShadowCC* scc;
+        g_string name;
+
+        Counter profGETSHit, profGETSMiss, profGETXHit, profGETXMiss;
+        Counter profWritebacks; //dirty evictions, and PUTXs of lines the shadow no longer has
+
+    public:
+        //rp must already be bound to scc (rp->setCC)
+        ShadowCache(CacheArray* _array, ReplPolicy* _rp, ShadowCC* _scc, const g_string& _name)
+            : array(_array), rp(_rp), scc(_scc), name(_name) {}
+
+        void access(const MemReq& req);
+        void initStats(AggregateStat* parentStat);
+        void serialize(Checkpoint& ck);
+};
+
+// The shadow caches of a bank. Banks may process accesses concurrently (see CCLocks), so shadows have their own lock
+class ShadowCaches : public GlobAlloc {
+    private:
+        g_vector<ShadowCache*> shadows;
+        lock_t lock;
+
+    public:
+        ShadowCaches() {futex_init(&lock);}
+
+        void add(ShadowCache* shadow) {shadows.push_back(shadow);}
+
+        //Called by the bank on each access it does not skip, after startAccess()
+        void access(const MemReq& req) {
+            futex_lock(&lock);
+            for (ShadowCache* s : shadows) s->access(req);
+            futex_unlock(&lock);
+        }
+
+        void initStats(AggregateStat* cacheStat);
+        void serialize(Checkpoint& ck);
+};
+
+#endif  // SHADOW_CACHE_H_
@@ -0,0 +1,351 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARER_DIRS_H_
+#define SHARER_DIRS_H_
+
+#include <stdint.h>
+#include "bithacks.h"
+#include "checkpoint.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+
+/* Sharer directories: the per-line sharer sets MESITopCC keeps for its children. Sharer counts and
+ * exclusivity stay in MESITopCC; the directory only answers which children may hold a line.
+ *
+ * Exact formats (FullBitVector, LimitedPtr) return exactly the sharers. Inexact formats (CoarseVector)
+ * may return extra children, which then receive invalidates for lines they do not hold; MESITopCC
+ * marks those invalidates as inexact, and children drop them (see Cache::finishInvalidate).
+ */
+class SharerDirectory : public GlobAlloc {
+    public:
+        //Called only when childId does not hold the line
+        virtual void add(uint32_t lineId, uint32_t childId) = 0;
+        //Called only when childId holds the line. Inexact formats may keep childId as a potential sharer
+        virtual void remove(uint32_t lineId, uint32_t childId) = 0;
+        virtual void clear(uint32_t lineId) = 0;
+        //Writes the (potential) sharers of lineId to out, returns how many. out must fit all children
+        virtual uint32_t getSharers(uint32_t lineId, uint32_t* out) = 0;
+        //For exact formats, true iff childId is a sharer; for inexact ones, true if it may be
+        virtual bool mayShare(uint32_t lineId, uint32_t childId) = 0;
+        virtual bool isExact() const = 0;
+        virtual void initStats(AggregateStat* parentStat) {}
+        virtual void serialize(Checkpoint& ck) = 0;
+};
+
+/* Full bit vector, sized to the actual number of children (the reference format) */
+class FullBitVectorDirectory : public SharerDirectory {
+    private:
+        uint64_t* bits;
+        uint32_t numLines;
+        uint32_t wordsPerLine;
+
+    public:
+        FullBitVectorDirectory(uint32_t _numLines, uint32_t numChildren) : numLines(_numLines) {
+            wordsPerLine = (numChildren + 63)/64;
+            bits = gm_calloc<uint64_t>(numLines*wordsPerLine);
+        }
+
+        void add(uint32_t lineId, uint32_t childId) {
+            bits[lineId*wordsPerLine + childId/64] |= 1ul << (childId % 64);
+        }
+
+        void remove(uint32_t lineId, uint32_t childId) {
+            bits[lineId*wordsPerLine + childId/64] &= ~(1ul << (childId % 64));
+        }
+
+        void clear(uint32_t lineId) {
+            for (uint32_t w = 0; w < wordsPerLine; w++) bits[lineId*wordsPerLine + w] = 0;
+        }
+
+        uint32_t getSharers(uint32_t lineId, uint32_t* out) {
+            uint32_t n = 0;
+            for (uint32_t w = 0; w < wordsPerLine; w++) {
+                uint64_t word = bits[lineId*wordsPerLine + w];
+                while (word) {
+                    out[n++] = w*64 + __builtin_ctzl(word);
+                    word &= word - 1;
+                }
+            }
+            return n;
+        }
+
+        bool mayShare(uint32_t lineId, uint32_t childId) {
+            return bits[lineId*wordsPerLine + childId/64] & (1ul << (childId % 64));
+        }
+
+        bool isExact() const {return true;}
+
+        void serialize(Checkpoint& ck) {
+            ck.section("FullBitVectorDirectory");
+            ck.io(bits, numLines*wordsPerLine);
+        }
+};
+
+/* Limited pointers, with a sparse overflow table of full bit vectors for the (hopefully few) lines
+ * with more sharers than pointers. Exact. Lines go back to pointers when they have few enough sharers.
+ */
+class LimitedPtrDirectory : public SharerDirectory {
+    private:
+        static const uint8_t OVERFLOWED = 0xff;
+
+        uint16_t* ptrs; //numPtrs per line
+        uint8_t* counts; //valid pointers per line, or OVERFLOWED
+        uint32_t numLines;
+        uint32_t numPtrs;
+        uint32_t wordsPerVec;
+
+        g_unordered_map<uint32_t, uint32_t> overflowMap; //lineId -> first word of its vector in overflowBits
+        g_vector<uint64_t> overflowBits;
+        g_vector<uint32_t> freeVecs;
+
+        Counter profOverflows;
+
+    public:
+        LimitedPtrDirectory(uint32_t _numLines, uint32_t numChildren, uint32_t _numPtrs) : numLines(_numLines), numPtrs(_numPtrs) {
+            if (numPtrs == 0 || numPtrs >= OVERFLOWED) panic("LimitedPtr directory needs 1-%d pointers, %d specified", OVERFLOWED-1, numPtrs);
+            if (numChildren > (1 << 16)) panic("LimitedPtr directory supports up to %d children, %d specified", 1 << 16, numChildren);
+            ptrs = gm_calloc<uint16_t>(numLines*numPtrs);
+            counts = gm_calloc<uint8_t>(numLines);
+            wordsPerVec = (numChildren + 63)/64;
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            profOverflows.init("dirOvf", "Directory pointer overflows");
+            parentStat->append(&profOverflows);
+        }
+
+        void add(uint32_t lineId, uint32_t childId) {
+            uint8_t& count = counts[lineId];
+            if (count == OVERFLOWED) {
+                uint64_t* vec = &overflowBits[overflowMap[lineId]];
+                vec[childId/64] |= 1ul << (childId % 64);
+            } else if (count < numPtrs) {
+                ptrs[lineId*numPtrs + count++] = childId;
+            } else {
+                uint64_t* vec = allocVec(lineId);
+                for (uint32_t i = 0; i < numPtrs; i++) {
+                    uint32_t c = ptrs[lineId*numPtrs + i];
+                    vec[c/64] |= 1ul << (c % 64);
+                }
+                vec[childId/64] |= 1ul << (childId % 64);
+                count = OVERFLOWED;
+                profOverflows.inc();
+            }
+        }
+
+        void remove(uint32_t lineId, uint32_t childId) {
+            uint8_t& count = counts[lineId];
+            if (count == OVERFLOWED) {
+                uint32_t vecIdx = overflowMap[lineId];
+                uint64_t* vec = &overflowBits[vecIdx];
+                vec[childId/64] &= ~(1ul << (childId % 64));
+                uint32_t sharers = 0;
+                for (uint32_t w = 0; w < wordsPerVec; w++) sharers += __builtin_popcountl(vec[w]);
+                if (sharers <= numPtrs) { //fits in pointers again
+                    uint32_t n = 0;
+                    for (uint32_t w = 0; w < wordsPerVec; w++) {
+                        uint64_t word = vec[w];
+                        while (word) {
+                            ptrs[lineId*numPtrs + n++] = w*64 + __builtin_ctzl(word);
+                            word &= word - 1;
+                        }
+                    }
+                    freeVec(lineId, vecIdx);
+                    count = n;
+                }
+            } else {
+                uint16_t* p = &ptrs[lineId*numPtrs];
+                for (uint32_t i = 0; i < count; i++) {
+                    if (p[i] == childId) {
+                        p[i] = p[--count];
+                        return;
+                    }
+                }
+                panic("LimitedPtrDirectory: removing non-sharer %d from line %d", childId, lineId);
+            }
+        }
+
+        void clear(uint32_t lineId) {
+            if (counts[lineId] == OVERFLOWED) freeVec(lineId, overflowMap[lineId]);
+            counts[lineId] = 0;
+        }
+
+        uint32_t getSharers(uint32_t lineId, uint32_t* out) {
+            uint32_t count = counts[lineId];
+            if (count == OVERFLOWED) {
+                uint64_t* vec = &overflowBits[overflowMap[lineId]];
+                uint32_t n = 0;
+                for (uint32_t w = 0; w < wordsPerVec; w++) {
+                    uint64_t word = vec[w];
+                    while (word) {
+                        out[n++] = w*64 + __builtin_ctzl(word);
+                        word &= word - 1;
+                    }
+                }
+                return n;
+            } else {
+                for (uint32_t i = 0; i < count; i++) out[i] = ptrs[lineId*numPtrs + i];
+                return count;
+            }
+        }
+
+        bool mayShare(uint32_t lineId, uint32_t childId) {
+            uint32_t count = counts[lineId];
+            if (count == OVERFLOWED) {
+                return overflowBits[overflowMap[lineId] + childId/64] & (1ul << (childId % 64));
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                if (ptrs[lineId*numPtrs + i] == childId) return true;
+            }
+            return false;
+        }
+
+        bool isExact() const {return true;}
+
+        void serialize(Checkpoint& ck) {
+            ck.section("LimitedPtrDirectory");
+            ck.check("pointers", numPtrs);
+            ck.io(ptrs, numLines*numPtrs);
+            ck.io(counts, numLines);
+            ck.io(overflowBits);
+            ck.io(freeVecs);
+
+            uint64_t overflowed = overflowMap.size();
+            ck.io(overflowed);
+            if (ck.saving()) {
+                for (auto& kv : overflowMap) {
+                    uint32_t lineId = kv.first;
+                    uint32_t vecIdx = kv.second;
+                    ck.io(lineId);
+                    ck.io(vecIdx);
+                }
+            } else {
+                overflowMap.clear();
+                for (uint64_t i = 0; i < overflowed; i++) {
+                    uint32_t lineId, vecIdx;
+                    ck.io(lineId);
+                    ck.io(vecIdx);
+                    overflowMap[lineId] = vecIdx;
+                }
+            }
+        }
+
+    private:
+        uint64_t* allocVec(uint32_t lineId) {
+            uint32_t vecIdx;
+            if (freeVecs.empty()) {
+                vecIdx = overflowBits.size();
+                overflowBits.resize(vecIdx + wordsPerVec);
+            } else {
+                vecIdx = freeVecs.back();
+                freeVecs.pop_back();
+            }
+            overflowMap[lineId] = vecIdx;
+            uint64_t* vec = &overflowBits[vecIdx];
+            for (uint32_t w = 0; w < wordsPerVec; w++) vec[w] = 0;
+            return vec;
+        }
+
+        void freeVec(uint32_t lineId, uint32_t vecIdx) {
+            overflowMap.erase(lineId);
+            freeVecs.push_back(vecIdx);
+        }
+};
+
+/* Coarse bit vector: each bit covers groupSize consecutive children. Inexact: a PUT cannot clear its
+ * group's bit (another child in the group may share the line), so bits are only cleared when the
+ * line has no sharers left, and invalidates go to every child of each marked group.
+ */
+class CoarseVectorDirectory : public SharerDirectory {
+    private:
+        uint64_t* vecs;
+        uint32_t numLines;
+        uint32_t numChildren;
+        uint32_t groupSize;
+
+    public:
+        CoarseVectorDirectory(uint32_t _numLines, uint32_t _numChildren, uint32_t _groupSize) : numLines(_numLines), numChildren(_numChildren) {
+            uint32_t minGroupSize = (numChildren + 63)/64;
+            groupSize = _groupSize? _groupSize : minGroupSize;
+            if (groupSize < minGroupSize) panic("CoarseVector directory: groupSize %d too small for %d children (min %d)", groupSize, numChildren, minGroupSize);
+            vecs = gm_calloc<uint64_t>(numLines);
+        }
+
+        void add(uint32_t lineId, uint32_t childId) {
+            vecs[lineId] |= 1ul << (childId/groupSize);
+        }
+
+        void remove(uint32_t lineId, uint32_t childId) {}
+
+        void clear(uint32_t lineId) {
+            vecs[lineId] = 0;
+        }
+
+        uint32_t getSharers(uint32_t lineId, uint32_t* out) {
+            uint32_t n = 0;
+            uint64_t vec = vecs[lineId];
+            while (vec) {
+                uint32_t g = __builtin_ctzl(vec);
+                vec &= vec - 1;
+                uint32_t sup = MIN((g+1)*groupSize, numChildren);
+                for (uint32_t c = g*groupSize; c < sup; c++) out[n++] = c;
+            }
+            return n;
+        }
+
+        bool mayShare(uint32_t lineId, uint32_t childId) {
+            return vecs[lineId] & (1ul << (childId/groupSize));
+        }
+
+        bool isExact() const {return false;}
+
+        void serialize(Checkpoint& ck) {
+            ck.section("CoarseVectorDirectory");
+            ck.check("group size", groupSize);
+            ck.io(vecs, numLines);
+        }
+};
+
+/* Per-cache directory format, from sys.caches.<group>.dir.* */
+struct SharerDirConfig {
+    enum Type {FULL, LIMITED_PTR, COARSE_VECTOR};
+    Type type;
+    uint32_t pointers; //LimitedPtr only
+    uint32_t groupSize; //CoarseVector only, 0 picks the smallest that fits in 64 bits
+
+    SharerDirectory* build(uint32_t numLines, uint32_t numChildren) const {
+        switch (type) {
+            case LIMITED_PTR: return new LimitedPtrDirectory(numLines, numChildren, pointers);
+            case COARSE_VECTOR: return new CoarseVectorDirectory(numLines, numChildren, groupSize);
+            default: return new FullBitVectorDirectory(numLines, numChildren);
+        }
+    }
+};
+
+#endif  // SHARER_DIRS_H_
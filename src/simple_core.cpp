@@ -74,6 +74,10 @@ void SimpleCore::contextSwitch(int32_t gid) {
     }
 }
 
+void SimpleCore::warmAccess(ADDRINT addr, bool isLoad) {
+    l1d->warm(addr, isLoad, zinfo->globPhaseCycles);
+}
+
 void SimpleCore::join() {
     //info("[%s] Joining, curCycle %ld phaseEnd %ld haltedCycles %ld", name.c_str(), curCycle, phaseEndCycle, haltedCycles);
     if (curCycle < zinfo->globPhaseCycles) { //carry up to the beginning of the phase
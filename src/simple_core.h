@@ -55,6 +55,8 @@ class SimpleCore : public Core {
         void contextSwitch(int32_t gid);
         virtual void join();
 
+        void warmAccess(ADDRINT addr, bool isLoad);
+
         InstrFuncPtrs GetFuncPtrs();
 
     protected:
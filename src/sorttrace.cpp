@@ -23,19 +23,36 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to sort a trace. It reads in the trace sequntially until it
- * has seen at least one access from every thread, then dumps the sorted trace
- * out. This may consume large amounts of memory if traces are largely
- * imbalanced. A simple way to fix this would be to dump N separate traces,
- * then join them together --- that's more I/O though.
+/* Sorts a trace by request cycle. There are two modes:
+ *
+ * - Streaming (default): reads the trace sequentially until it has seen at
+ *   least one access from every thread, then dumps the sorted trace out. This
+ *   is a merge of the per-child streams, so it assumes each child's accesses
+ *   are already in order, and may consume large amounts of memory if traces
+ *   are largely imbalanced.
+ *
+ * - External (-x): a parallel external-memory merge sort with bounded memory.
+ *   Worker threads each read disjoint ranges of the input, sort them, and
+ *   spill them as sorted runs to temporary native-format files; the runs are
+ *   then k-way merged (in parallel passes if there are more than the fan-in)
+ *   into the output. The sort is stable and does not assume anything about
+ *   the input order; if each child's accesses are in order, it produces the
+ *   same output as the streaming sort.
  */
 
+#include <algorithm>
 #include <deque>
 #include <queue>
 #include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "access_tracing.h"
+#include "bithacks.h"
 #include "galloc.h"
+#include "locks.h"
 
 using namespace std;
 
@@ -44,20 +61,10 @@ void printProgress(uint64_t read, uint64_t written, uint64_t total) {
     fflush(stdout);
 }
 
-int main(int argc, const char* argv[]) {
-    InitLog(""); //no log header
-    if (argc != 3) {
-        info("Sorts an access trace");
-        info("Usage: %s <input_trace> <output_trace>", argv[0]);
-        exit(1);
-    }
-
-    gm_init(32<<20 /*32 MB --- should be enough*/);
+/* Streaming sort */
 
-    AccessTraceReader* tr = new AccessTraceReader(argv[1]);
+static void streamSort(AccessTraceReader* tr, AccessTraceWriter* tw) {
     uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
-
     deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
     for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
     priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
@@ -108,10 +115,208 @@ int main(int argc, const char* argv[]) {
     printf("\n");
     assert(readRecords == writtenRecords);
     assert(readRecords == totalRecords);
+}
+
+/* External sort */
+
+// Upper bound on the global heap used by a reader or writer (buffers for an HDF5 chunk or a native block)
+#define TRACE_IO_BYTES (8ul << 20)
+
+struct ExtSortParams {
+    uint32_t threads;
+    uint64_t memBytes;  // budget for run buffers and merge readers
+    uint32_t fanIn;
+    uint32_t mergeThreads;  // concurrent intermediate merges
+    string tmpPrefix;
+};
+
+// Same order as the streaming sort: by cycle, then by decreasing childId
+static inline bool recordLess(const AccessRecord& a, const AccessRecord& b) {
+    return (a.reqCycle < b.reqCycle) || (a.reqCycle == b.reqCycle && a.childId > b.childId);
+}
+
+static string runFile(const ExtSortParams& p, uint32_t pass, uint64_t run) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), ".sort%d-%ld.ztrace", pass, run);
+    return p.tmpPrefix + buf;  // runs use the native format
+}
+
+// Merges the given (sorted) runs into tw. Ties are broken by run order, so the merge is stable.
+static void mergeRuns(const vector<string>& runs, AccessTraceWriter* tw, bool showProgress, uint64_t total) {
+    struct Head {
+        uint64_t reqCycle;
+        uint32_t childId;
+        uint32_t run;
+        bool operator>(const Head& h) const {
+            if (reqCycle != h.reqCycle) return reqCycle > h.reqCycle;
+            if (childId != h.childId) return childId < h.childId;
+            return run > h.run;
+        }
+    };
+
+    vector<AccessTraceReader*> readers;
+    vector<AccessRecord> cur(runs.size());
+    priority_queue<Head, vector<Head>, greater<Head> > heads;
+    for (uint32_t r = 0; r < runs.size(); r++) {
+        readers.push_back(new AccessTraceReader(runs[r]));
+        if (!readers[r]->empty()) {
+            cur[r] = readers[r]->read();
+            heads.push({cur[r].reqCycle, cur[r].childId, r});
+        }
+    }
+
+    uint64_t written = 0;
+    while (!heads.empty()) {
+        uint32_t r = heads.top().run;
+        heads.pop();
+        tw->write(cur[r]);
+        if (!readers[r]->empty()) {
+            cur[r] = readers[r]->read();
+            heads.push({cur[r].reqCycle, cur[r].childId, r});
+        }
+        if (showProgress && (++written % (1 << 20)) == 0) printProgress(total, written, total);
+    }
+
+    for (uint32_t r = 0; r < runs.size(); r++) {
+        delete readers[r];
+        unlink(runs[r].c_str());
+    }
+}
+
+static void externalSort(const char* inFile, AccessTraceReader* tr, AccessTraceWriter* tw, const ExtSortParams& p) {
+    uint32_t numChildren = tr->getNumChildren();
+    uint64_t totalRecords = tr->getNumRecords();
+
+    // Each worker sorts one run at a time; stable_sort needs a temporary buffer as large as the run
+    uint64_t runRecords = MAX(p.memBytes / p.threads / (2*sizeof(AccessRecord)), 1024ul);
+    uint64_t numRuns = (totalRecords + runRecords - 1) / runRecords;
+    info("Sorting %ld records: %ld runs of up to %ld records, %d threads, fan-in %d", totalRecords, numRuns, runRecords, p.threads, p.fanIn);
+
+    lock_t progressLock;
+    futex_init(&progressLock);
+    volatile uint64_t nextRun = 0;
+    volatile uint64_t doneRecords = 0;
+
+    auto genRuns = [&]() {
+        vector<AccessRecord> recs;
+        recs.reserve(MIN(runRecords, totalRecords));
+        AccessTraceReader* rd = new AccessTraceReader(inFile);
+
+        while (true) {
+            uint64_t run = __sync_fetch_and_add(&nextRun, 1);
+            if (run >= numRuns) break;
+            uint64_t first = run*runRecords;
+            uint64_t last = MIN(first + runRecords, totalRecords);
+
+            recs.clear();
+            rd->seek(first);
+            for (uint64_t i = first; i < last; i++) recs.push_back(rd->read());
+
+            stable_sort(recs.begin(), recs.end(), recordLess);
+
+            AccessTraceWriter* rw = new AccessTraceWriter(runFile(p, 0, run).c_str(), numChildren);
+            for (AccessRecord& acc : recs) rw->write(acc);
+            rw->dump(false);
+            delete rw;
+
+            uint64_t done = __sync_add_and_fetch(&doneRecords, last - first);
+            futex_lock(&progressLock);
+            printProgress(done, 0, totalRecords);
+            futex_unlock(&progressLock);
+        }
+
+        delete rd;
+    };
+
+    vector<thread> workers;
+    for (uint32_t t = 0; t < p.threads; t++) workers.push_back(thread(genRuns));
+    for (thread& w : workers) w.join();
+    workers.clear();
+
+    vector<string> runs;
+    for (uint64_t r = 0; r < numRuns; r++) runs.push_back(runFile(p, 0, r));
+
+    // Intermediate merge passes, until the final merge fits the fan-in
+    for (uint32_t pass = 1; runs.size() > p.fanIn; pass++) {
+        uint64_t numGroups = (runs.size() + p.fanIn - 1) / p.fanIn;
+        info("Merge pass %d: %ld runs -> %ld runs (%ld threads)", pass, runs.size(), numGroups, MIN((uint64_t)p.mergeThreads, numGroups));
+        volatile uint64_t nextGroup = 0;
+        auto mergeGroups = [&]() {
+            while (true) {
+                uint64_t g = __sync_fetch_and_add(&nextGroup, 1);
+                if (g >= numGroups) break;
+                vector<string> groupRuns(runs.begin() + g*p.fanIn, runs.begin() + MIN((g+1)*p.fanIn, runs.size()));
+                AccessTraceWriter* rw = new AccessTraceWriter(runFile(p, pass, g).c_str(), numChildren);
+                mergeRuns(groupRuns, rw, false, 0);
+                rw->dump(false);
+                delete rw;
+            }
+        };
+        for (uint32_t t = 0; t < MIN((uint64_t)p.mergeThreads, numGroups); t++) workers.push_back(thread(mergeGroups));
+        for (thread& w : workers) w.join();
+        workers.clear();
+
+        runs.clear();
+        for (uint64_t g = 0; g < numGroups; g++) runs.push_back(runFile(p, pass, g));
+    }
+
+    mergeRuns(runs, tw, true, totalRecords);
+    printProgress(totalRecords, totalRecords, totalRecords);
+    printf("\n");
+}
+
+static void usage(const char* prog) {
+    info("Sorts an access trace (output format follows the output file name, see access_tracing.h)");
+    info("Usage: %s [-x [-j threads] [-m memMB] [-k fanIn] [-t tmpPrefix]] <input_trace> <output_trace>", prog);
+    info("  -x: external sort, for traces that do not fit in memory (default: streaming sort)");
+    info("  -j: worker threads (default: all host cores)");
+    info("  -m: memory budget for runs and merges, in MB (default: 1024)");
+    info("  -k: runs merged at once (default: 64)");
+    info("  -t: path prefix of temporary run files (default: the output file name)");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    InitLog(""); //no log header
+
+    bool external = false;
+    ExtSortParams p;
+    p.threads = MAX(1u, thread::hardware_concurrency());
+    p.memBytes = 1024ul << 20;
+    p.fanIn = 64;
+    const char* tmpPrefix = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "xj:m:k:t:")) != -1) {
+        switch (opt) {
+            case 'x': external = true; break;
+            case 'j': p.threads = MAX(1, atoi(optarg)); break;
+            case 'm': p.memBytes = MAX(1l, atol(optarg)) << 20; break;
+            case 'k': p.fanIn = MAX(2, atoi(optarg)); break;
+            case 't': tmpPrefix = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) usage(argv[0]);
+    const char* inFile = argv[optind];
+    const char* outFile = argv[optind + 1];
+    p.tmpPrefix = tmpPrefix? tmpPrefix : outFile;
+    // Each merge keeps fanIn readers live, so the number of concurrent merges is limited by the memory budget
+    p.mergeThreads = MAX(1ul, MIN((uint64_t)p.threads, p.memBytes / (p.fanIn*TRACE_IO_BYTES)));
+
+    // Each sort worker has a reader and a writer; each merge has fanIn readers and a writer
+    size_t gmSize = 32ul << 20;
+    if (external) gmSize += MAX(2*p.threads, p.mergeThreads*(p.fanIn + 1)) * TRACE_IO_BYTES;
+    gm_init(gmSize);
+
+    AccessTraceReader* tr = new AccessTraceReader(inFile);
+    AccessTraceWriter* tw = new AccessTraceWriter(outFile, tr->getNumChildren());
+
+    if (external) externalSort(inFile, tr, tw, p);
+    else streamSort(tr, tw);
 
     delete tr;
     tw->dump(false); //flushes it
     delete tw;
     return 0;
 }
-
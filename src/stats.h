@@ -31,12 +31,14 @@
  * - Counter: A plain single counter.
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
- * - Histogram: A GEMS-style histogram, intended to profile a distribution.
- *   It has a fixed amount of buckets, and buckets are resized as samples
- *   are added, making profiling increasingly coarser but keeping storage
- *   space constant. Unlike GEMS-style stats, though, at some configurable
- *   point part of the array starts growing logarithmically, to capture
- *   outliers without hurting accuracy of most samples.
+ * - ShardedCounter and ShardedVectorCounter: Counters for components shared
+ *   by many threads (e.g., LLC banks), split in per-host-CPU shards.
+ * - Histogram: A constant-space histogram, intended to profile a distribution
+ *   (e.g., latencies). It has a fixed amount of buckets: unit-width buckets
+ *   up to a configurable point, then buckets that grow logarithmically, to
+ *   capture outliers without hurting accuracy of most samples. Unlike
+ *   GEMS-style histograms, buckets are never resized, so inserts are O(1)
+ *   and histograms with the same layout can be merged exactly.
  * - ProxyStat takes a function pointer uint64_t(*)(void) at initialization,
  *   and calls it to get its value. It is used for cases where a stat can't
  *   be stored as a counter (e.g. aggregates, RDTSC, performance counters,...)
@@ -74,10 +76,13 @@
 
 /* TODO: I want these to be POD types, but polymorphism (needed by dynamic_cast) probably disables it. Dang. */
 
+#include <sched.h>
 #include <stdint.h>
 #include <string>
+#include <unistd.h>
 #include "g_std/g_vector.h"
 #include "log.h"
+#include "pad.h"
 
 class Stat : public GlobAlloc {
     protected:
@@ -295,13 +300,254 @@ class VectorCounter : public VectorStat {
         inline uint32_t size() const {
             return _counters.size();
         }
+
+        inline void set(uint32_t idx, uint64_t data) {
+            _counters[idx] = data;
+        }
 };
 
-/*
-class Histogram : public Stat {
-    //TBD
+/* Sharded counters
+ *
+ * Plain counters in components shared by many simulation threads (e.g., LLC banks or memory controllers) are
+ * updated by all of them, so their cache lines ping-pong across host cores. Sharded counters keep one
+ * line-sized slot per shard, update the slot of the host CPU the caller runs on, and add up all slots when
+ * read. Threads that share a CPU over time may race on its slot, so updates are atomic, but uncontended.
+ * Each counter takes a line per shard, so use them only on shared components. Components that may or may
+ * not be shared (e.g., caches) can pass an explicit shard count; with a single explicit shard, counters
+ * behave (and cost) like plain, non-atomic counters.
+ */
+
+#define MAX_STAT_SHARDS 64u
+
+// Host CPUs, rounded up to a power of 2 (shards are picked with a mask)
+static inline uint32_t DefaultStatShards() {
+    static uint32_t shards = 0;
+    if (!shards) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        uint32_t s = 1;
+        while (s < cpus && s < MAX_STAT_SHARDS) s <<= 1;
+        shards = s;
+    }
+    return shards;
+}
+
+static inline uint32_t CurStatShard(uint32_t shardMask) {
+    int cpu = sched_getcpu();
+    return (cpu < 0)? 0 : (cpu & shardMask);
+}
+
+class ShardedCounter : public ScalarStat {
+    private:
+        static const uint32_t STRIDE = CACHE_LINE_BYTES/sizeof(uint64_t);
+        uint64_t* _shards;
+        uint32_t _shardMask;
+        bool _atomic;
+
+    public:
+        ShardedCounter() : ScalarStat(), _shards(gm_memalign<uint64_t>(CACHE_LINE_BYTES, STRIDE)), _shardMask(0), _atomic(false) {
+            _shards[0] = 0;
+        }
+
+        // Shared component
+        void init(const char* name, const char* desc) {
+            init(name, desc, DefaultStatShards());
+            _atomic = true;
+        }
+
+        void init(const char* name, const char* desc, uint32_t numShards) {
+            initStat(name, desc);
+            assert(numShards && (numShards & (numShards - 1)) == 0);
+            gm_free(_shards);
+            _shards = gm_memalign<uint64_t>(CACHE_LINE_BYTES, numShards*STRIDE);
+            for (uint32_t i = 0; i < numShards*STRIDE; i++) _shards[i] = 0;
+            _shardMask = numShards - 1;
+            _atomic = (numShards > 1);
+        }
+
+        inline void inc(uint64_t delta) {
+            if (_atomic) __sync_fetch_and_add(&_shards[_shardMask? CurStatShard(_shardMask)*STRIDE : 0], delta);
+            else _shards[0] += delta;
+        }
+
+        inline void inc() {
+            inc(1);
+        }
+
+        uint64_t get() const {
+            uint64_t count = 0;
+            for (uint32_t i = 0; i <= _shardMask; i++) count += _shards[i*STRIDE];
+            return count;
+        }
+
+        inline void set(uint64_t data) {
+            for (uint32_t i = 0; i <= _shardMask; i++) _shards[i*STRIDE] = 0;
+            _shards[0] = data;
+        }
+};
+
+class ShardedVectorCounter : public VectorStat {
+    private:
+        uint64_t* _shards;  // shard-major; each shard's vector starts on its own line
+        uint32_t _size;
+        uint32_t _stride;
+        uint32_t _shardMask;
+        bool _atomic;
+
+    public:
+        ShardedVectorCounter() : VectorStat(), _shards(nullptr), _size(0), _stride(0), _shardMask(0), _atomic(false) {}
+
+        /* Without counter names; shared component */
+        void init(const char* name, const char* desc, uint32_t size) {
+            init(name, desc, size, DefaultStatShards());
+            _atomic = true;
+        }
+
+        void init(const char* name, const char* desc, uint32_t size, uint32_t numShards) {
+            initStat(name, desc);
+            assert(size > 0);
+            assert(numShards && (numShards & (numShards - 1)) == 0);
+            const uint32_t lineCounters = CACHE_LINE_BYTES/sizeof(uint64_t);
+            _size = size;
+            _stride = (size + lineCounters - 1) / lineCounters * lineCounters;
+            _shards = gm_memalign<uint64_t>(CACHE_LINE_BYTES, numShards*_stride);
+            for (uint32_t i = 0; i < numShards*_stride; i++) _shards[i] = 0;
+            _shardMask = numShards - 1;
+            _atomic = (numShards > 1);
+            _counterNames = nullptr;
+        }
+
+        /* With counter names */
+        void init(const char* name, const char* desc, uint32_t size, const char** counterNames) {
+            init(name, desc, size);
+            assert(counterNames);
+            _counterNames = gm_dup<const char*>(counterNames, size);
+        }
+
+        void init(const char* name, const char* desc, uint32_t size, uint32_t numShards, const char** counterNames) {
+            init(name, desc, size, numShards);
+            assert(counterNames);
+            _counterNames = gm_dup<const char*>(counterNames, size);
+        }
+
+        inline void inc(uint32_t idx, uint64_t value) {
+            assert(idx < _size);
+            if (_atomic) __sync_fetch_and_add(&_shards[(_shardMask? CurStatShard(_shardMask)*_stride : 0) + idx], value);
+            else _shards[idx] += value;
+        }
+
+        inline void inc(uint32_t idx) {
+            inc(idx, 1);
+        }
+
+        uint64_t count(uint32_t idx) const {
+            assert(idx < _size);
+            uint64_t count = 0;
+            for (uint32_t i = 0; i <= _shardMask; i++) count += _shards[i*_stride + idx];
+            return count;
+        }
+
+        uint32_t size() const {
+            return _size;
+        }
+
+        inline void set(uint32_t idx, uint64_t data) {
+            assert(idx < _size);
+            for (uint32_t i = 0; i <= _shardMask; i++) _shards[i*_stride + idx] = 0;
+            _shards[idx] = data;
+        }
+};
+
+/* Log-linear histogram. With L linear buckets (a power of 2), values in [0, L) get a bucket each. Then, each
+ * octave [L*2^k, L*2^(k+1)) for k in [0, octaves) is split in L/2 equal buckets (so every bucket has a relative
+ * width of at most 2/L), and a last bucket holds everything above. Backends output the bucket counts, plus the
+ * number of samples and their sum.
+ */
+class Histogram : public VectorStat {
+    private:
+        uint64_t* _buckets;
+        uint64_t _samples;
+        uint64_t _sum;
+        uint32_t _linear;
+        uint32_t _linearBits;
+        uint32_t _octaves;
+        uint32_t _size;
+
+    public:
+        Histogram() : VectorStat(), _buckets(nullptr), _samples(0), _sum(0), _linear(0), _linearBits(0), _octaves(0), _size(0) {}
+
+        void init(const char* name, const char* desc, uint32_t linearBuckets, uint32_t octaves) {
+            initStat(name, desc);
+            if (linearBuckets < 2 || (linearBuckets & (linearBuckets - 1))) panic("Histogram %s: linear buckets (%d) must be a power of 2 >= 2", name, linearBuckets);
+            _linear = linearBuckets;
+            _linearBits = __builtin_ctz(linearBuckets);
+            _octaves = octaves;
+            if (_linearBits + _octaves > 63) panic("Histogram %s: too many octaves (%d)", name, octaves);
+            _size = _linear + _octaves*(_linear/2) + 1;
+            _buckets = gm_calloc<uint64_t>(_size);
+            _samples = 0;
+            _sum = 0;
+        }
+
+        inline uint32_t bucket(uint64_t value) const {
+            if (value < _linear) return value;
+            uint32_t octave = (63 - __builtin_clzl(value)) - _linearBits;
+            if (octave >= _octaves) return _size - 1;
+            return _linear + octave*(_linear/2) + (value >> (octave + 1)) - _linear/2;
+        }
+
+        // Smallest value that falls in the bucket
+        uint64_t bucketLow(uint32_t idx) const {
+            assert(idx < _size);
+            if (idx < _linear) return idx;
+            if (idx == _size - 1) return ((uint64_t)_linear) << _octaves;
+            uint32_t octave = (idx - _linear) / (_linear/2);
+            uint32_t sub = (idx - _linear) % (_linear/2);
+            return ((uint64_t)(_linear/2 + sub)) << (octave + 1);
+        }
+
+        inline void inc(uint64_t value) {
+            _buckets[bucket(value)]++;
+            _samples++;
+            _sum += value;
+        }
+
+        inline void atomicInc(uint64_t value) {
+            __sync_fetch_and_add(&_buckets[bucket(value)], 1);
+            __sync_fetch_and_add(&_samples, 1);
+            __sync_fetch_and_add(&_sum, value);
+        }
+
+        // Adds other's samples (e.g., per-thread histograms); layouts must match
+        void merge(const Histogram& other) {
+            assert_msg(_linear == other._linear && _octaves == other._octaves, "Merging histograms %s and %s with different layouts", name(), other.name());
+            for (uint32_t i = 0; i < _size; i++) _buckets[i] += other._buckets[i];
+            _samples += other._samples;
+            _sum += other._sum;
+        }
+
+        uint64_t count(uint32_t idx) const {
+            assert(idx < _size);
+            return _buckets[idx];
+        }
+
+        uint32_t size() const {
+            return _size;
+        }
+
+        uint64_t samples() const {return _samples;}
+        uint64_t sum() const {return _sum;}
+
+        // For checkpoints
+        void set(uint32_t idx, uint64_t data) {
+            assert(idx < _size);
+            _buckets[idx] = data;
+        }
+
+        void setTotals(uint64_t samples, uint64_t sum) {
+            _samples = samples;
+            _sum = sum;
+        }
 };
-*/
 
 class ProxyStat : public ScalarStat {
     private:
@@ -0,0 +1,94 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAG_MATCH_H_
+#define TAG_MATCH_H_
+
+#include <immintrin.h>  // NOLINT
+#include <stdint.h>
+#include "memory_hierarchy.h"
+
+/* Tag-match kernels for associative arrays: return the index of lineAddr in tags[0..n), or -1.
+ * The vector versions handle up to 64 ways, and are compiled with target attributes, so zsim
+ * does not need to be built with -mavx2/-mavx512f; arrays pick one at init with bestTagMatchImpl().
+ */
+
+enum TagMatchImpl {TM_SCALAR, TM_AVX2, TM_AVX512};
+
+static inline int32_t tagMatchScalar(const Address* tags, uint32_t n, Address lineAddr) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (tags[i] == lineAddr) return i;
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static inline int32_t tagMatchAVX2(const Address* tags, uint32_t n, Address lineAddr) {
+    assert(n <= 64);
+    __m256i key = _mm256_set1_epi64x(lineAddr);
+    uint64_t match = 0; //compare the whole set and branch once, since the hit way is unpredictable
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)&tags[i]);
+        match |= ((uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, key)))) << i;
+    }
+    for (; i < n; i++) {
+        match |= ((uint64_t)(tags[i] == lineAddr)) << i;
+    }
+    return match? __builtin_ctzl(match) : -1;
+}
+
+__attribute__((target("avx512f")))
+static inline int32_t tagMatchAVX512(const Address* tags, uint32_t n, Address lineAddr) {
+    assert(n <= 64);
+    __m512i key = _mm512_set1_epi64(lineAddr);
+    uint64_t match = 0;
+    for (uint32_t i = 0; i < n; i += 8) {
+        __mmask8 lanes = (n - i >= 8)? 0xff : ((1 << (n - i)) - 1); //masked tail, avoids reading past the set
+        __m512i t = _mm512_maskz_loadu_epi64(lanes, (const void*)&tags[i]);
+        match |= ((uint64_t)_mm512_mask_cmpeq_epi64_mask(lanes, t, key)) << i;
+    }
+    return match? __builtin_ctzl(match) : -1;
+}
+
+static inline int32_t tagMatch(TagMatchImpl impl, const Address* tags, uint32_t n, Address lineAddr) {
+    switch (impl) {
+        case TM_AVX512: return tagMatchAVX512(tags, n, lineAddr);
+        case TM_AVX2: return tagMatchAVX2(tags, n, lineAddr);
+        default: return tagMatchScalar(tags, n, lineAddr);
+    }
+}
+
+// Fastest implementation the host supports for n-way sets. Up to 16 ways, AVX2 and AVX-512
+// perform about the same, so prefer AVX2 (no frequency penalty on older parts)
+static inline TagMatchImpl bestTagMatchImpl(uint32_t n) {
+    if (n < 4 || n > 64) return TM_SCALAR;
+    __builtin_cpu_init();
+    if (n > 16 && __builtin_cpu_supports("avx512f")) return TM_AVX512;
+    if (__builtin_cpu_supports("avx2")) return TM_AVX2;
+    return TM_SCALAR;
+}
+
+#endif  // TAG_MATCH_H_
@@ -47,6 +47,25 @@ class TextBackendImpl : public GlobAlloc {
                 }
             } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
                 *out << ss->get() << " # " << ss->desc() << endl;
+            } else if (Histogram* hs = dynamic_cast<Histogram*>(s)) {
+                *out << "# " << hs->desc() << endl;
+                for (uint32_t j = 0; j < level+1; j++) *out << " ";
+                *out << "samples: " << hs->samples() << endl;
+                for (uint32_t j = 0; j < level+1; j++) *out << " ";
+                *out << "mean: " << (hs->samples()? ((double)hs->sum())/hs->samples() : 0.0) << endl;
+                // Only print non-empty buckets, labeled with their value range
+                for (uint32_t i = 0; i < hs->size(); i++) {
+                    if (!hs->count(i)) continue;
+                    for (uint32_t j = 0; j < level+1; j++) *out << " ";
+                    uint64_t low = hs->bucketLow(i);
+                    if (i == hs->size() - 1) {
+                        *out << low << "+: " << hs->count(i) << endl;
+                    } else if (hs->bucketLow(i+1) == low + 1) {
+                        *out << low << ": " << hs->count(i) << endl;
+                    } else {
+                        *out << low << "-" << hs->bucketLow(i+1) - 1 << ": " << hs->count(i) << endl;
+                    }
+                }
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
                 *out << "# " << vs->desc() << endl;
                 for (uint32_t i = 0; i < vs->size(); i++) {
@@ -25,6 +25,8 @@
 
 #include "timing_cache.h"
 #include "event_recorder.h"
+#include "mrc_profiler.h"
+#include "shadow_cache.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -99,9 +101,9 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     profOccHist.init("occHist", "Occupancy MSHR cycle histogram", numMSHRs+1);
     cacheStat->append(&profOccHist);
 
-    profHitLat.init("latHit", "Cumulative latency accesses that hit (demand and non-demand)");
-    profMissRespLat.init("latMissResp", "Cumulative latency for miss start to response");
-    profMissLat.init("latMiss", "Cumulative latency for miss start to finish (free MSHR)");
+    profHitLat.init("latHit", "Cumulative latency accesses that hit (demand and non-demand)", cc->statShards());
+    profMissRespLat.init("latMissResp", "Cumulative latency for miss start to response", cc->statShards());
+    profMissLat.init("latMiss", "Cumulative latency for miss start to finish (free MSHR)", cc->statShards());
 
     cacheStat->append(&profHitLat);
     cacheStat->append(&profMissRespLat);
@@ -112,6 +114,8 @@ void TimingCache::initStats(AggregateStat* parentStat) {
 
 // TODO(dsm): This is copied verbatim from Cache. We should split Cache into different methods, then call those.
 uint64_t TimingCache::access(MemReq& req) {
+    if (unlikely(req.is(MemReq::WARMUP))) return Cache::access(req); //functional, no events
+
     EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
     assert_msg(evRec, "TimingCache is not connected to TimingCore");
 
@@ -123,6 +127,8 @@ uint64_t TimingCache::access(MemReq& req) {
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
     if (likely(!skipAccess)) {
+        if (unlikely(shadows != nullptr)) shadows->access(req);
+        if (unlikely(mrc != nullptr)) mrc->access(req);
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
         respCycle += accLat;
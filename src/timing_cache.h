@@ -44,7 +44,7 @@ class TimingCache : public Cache {
 
         // Stats
         CycleBreakdownStat profOccHist;
-        Counter profHitLat, profMissRespLat, profMissLat;
+        ShardedCounter profHitLat, profMissRespLat, profMissLat;
 
         uint32_t domain;
 
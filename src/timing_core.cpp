@@ -77,6 +77,10 @@ void TimingCore::leave() {
     cRec.notifyLeave(curCycle);
 }
 
+void TimingCore::warmAccess(ADDRINT addr, bool isLoad) {
+    l1d->warm(addr, isLoad, zinfo->globPhaseCycles);
+}
+
 void TimingCore::loadAndRecord(Address addr) {
     uint64_t startCycle = curCycle;
     curCycle = l1d->load(addr, curCycle);
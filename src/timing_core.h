@@ -58,6 +58,8 @@ class TimingCore : public Core {
         virtual void join();
         virtual void leave();
 
+        void warmAccess(ADDRINT addr, bool isLoad);
+
         InstrFuncPtrs GetFuncPtrs();
 
         //Contention simulation interface
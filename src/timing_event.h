@@ -280,6 +280,7 @@ class TimingEvent {
 
 
     friend class ContentionSim;
+    template <typename T, uint32_t B> friend class PrioQueue; //reads privCycle with PQ_CALENDAR
     friend class DelayEvent; //DelayEvent is, for now, the only child of TimingEvent that should do anything other than implement simulate
     friend class CrossingEvent;
 };
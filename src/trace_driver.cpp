@@ -25,17 +25,23 @@
 
 #include <sstream>
 #include "trace_driver.h"
+#include "bithacks.h"
+#include "checkpoint.h"
+#include "pin.H"
 #include "zsim.h"
 
-TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
+TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads)
     : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
 {
     assert(numChildren > 0);
     assert(!useSkews || numChildren == 1);
     if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
     children = new ChildInfo[numChildren];
+    for (uint32_t i = 0; i < numChildren; i++) {
+        futex_init(&children[i].lock);
+        children[i].inFlight = false;
+    }
     futex_init(&lock);
-    lastAcc.childId = -1;
     parent = proxies[0]->getParent();
     for (uint32_t i = 0; i < numChildren; i++) proxies[i]->setDriver(this);
 
@@ -46,6 +52,33 @@ TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std:
     } else {
         atw = nullptr;
     }
+
+    numThreads = MAX(1u, MIN(_numThreads, numChildren));
+    if (numThreads < _numThreads) warn("Trace has %d children, using %d replay threads instead of %d", numChildren, numThreads, _numThreads);
+    replayThreads = gm_calloc<ReplayThread>(numThreads);
+    for (uint32_t i = 0; i < numThreads; i++) {
+        futex_init(&replayThreads[i].wakeLock);
+        futex_lock(&replayThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
+        replayThreads[i].lastAcc.childId = -1;
+        replayThreads[i].done = false;
+    }
+
+    queues = (numThreads > 1)? new std::deque<AccessRecord>[numThreads] : nullptr;
+
+    futex_init(&waitLock);
+    futex_lock(&waitLock); //wait lock must also start locked
+    threadsDone = 0;
+    phaseLimit = 0;
+
+    //With a single thread, the caller replays the trace itself
+    if (numThreads > 1) {
+        info("Replaying trace with %d threads", numThreads);
+        threadTicket = 0;
+        __sync_synchronize();
+        for (uint32_t i = 0; i < numThreads; i++) {
+            PIN_SpawnInternalThread(ReplayThreadTrampoline, this, 1024*1024, nullptr);
+        }
+    }
 }
 
 void TraceDriver::initStats(AggregateStat* parentStat) {
@@ -74,47 +107,158 @@ void TraceDriver::setParent(MemObject* _parent) {
     parent = _parent;
 }
 
-uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
+void TraceDriver::serialize(Checkpoint& ck) {
+    ck.section("TraceDriver");
+    ck.check("trace driver children", numChildren);
+    for (uint32_t c = 0; c < numChildren; c++) {
+        std::unordered_map<Address, MESIState>& cStore = children[c].cStore;
+        uint64_t lines = cStore.size();
+        ck.io(lines);
+        if (ck.saving()) {
+            for (auto& it : cStore) {
+                Address lineAddr = it.first;
+                MESIState state = it.second;
+                ck.io(lineAddr);
+                ck.io(state);
+            }
+        } else {
+            cStore.clear();
+            for (uint64_t i = 0; i < lines; i++) {
+                Address lineAddr;
+                MESIState state;
+                ck.io(lineAddr);
+                ck.io(state);
+                cStore[lineAddr] = state;
+            }
+        }
+    }
+}
+
+uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId, bool inexact) {
     assert(childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
+    ChildInfo& child = children[childId];
+    futex_lock(&child.lock);
+    std::unordered_map<Address, MESIState>& cStore = child.cStore;
     std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
+    if (inexact && it == cStore.end()) { //spurious invalidate from an inexact directory
+        futex_unlock(&child.lock);
+        return 0;
+    }
     assert((it != cStore.end()));
     *reqWriteback = (it->second == M);
     if (type == INVX) {
         it->second = S;
-        children[childId].profInvx.inc();
+        child.profInvx.inc();
     } else {
-        cStore.erase(it);
+        //If the child is racing on this line, the parent holds a pointer to its state; the child erases it when done
+        if (child.inFlight && child.inFlightLine == lineAddr) it->second = I;
+        else cStore.erase(it);
         if (srcId == childId) {
-            children[childId].profSelfInv.inc();
+            child.profSelfInv.inc();
         } else {
-            children[childId].profCrossInv.inc();
+            child.profCrossInv.inc();
         }
     }
+    futex_unlock(&child.lock);
     return 0;
 }
 
 //Returns false if done, true otherwise
 bool TraceDriver::executePhase() {
-    uint64_t limit = zinfo->globPhaseCycles + zinfo->phaseLength;
+    phaseLimit = zinfo->globPhaseCycles + zinfo->phaseLength;
+    if (numThreads == 1) return replayPhase(0);
+
+    fillQueues();
+    __sync_synchronize();
+    for (uint32_t i = 0; i < numThreads; i++) futex_unlock(&replayThreads[i].wakeLock);
+    futex_lock_nospin(&waitLock); //sleep until all threads finish the phase
+
+    for (uint32_t i = 0; i < numThreads; i++) {
+        if (!replayThreads[i].done) return true;
+    }
+    return false;
+}
+
+void TraceDriver::ReplayThreadTrampoline(void* arg) {
+    TraceDriver* drv = static_cast<TraceDriver*>(arg);
+    uint32_t thid = __sync_fetch_and_add(&drv->threadTicket, 1);
+    drv->replayThreadLoop(thid);
+}
+
+void TraceDriver::replayThreadLoop(uint32_t thid) {
+    while (true) {
+        futex_lock_nospin(&replayThreads[thid].wakeLock);
+        if (!replayThreads[thid].done) replayThreads[thid].done = !replayPhase(thid);
+
+        uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
+        if (val == numThreads) {
+            threadsDone = 0;
+            futex_unlock(&waitLock); //unblock caller
+        }
+    }
+}
+
+//Reads the next access (single-threaded replay); returns false if there are none left
+bool TraceDriver::nextAccess(AccessRecord& acc) {
+    if (tr.empty()) return false;
+    acc = tr.read();
+    if (useSkews) acc.reqCycle += children[acc.childId].skew;
+    return true;
+}
+
+/* Replay threads own disjoint sets of children, so each only needs the records of its children up to the
+ * first one at or past phaseLimit. Records for threads that already have one are queued too (traces need
+ * not be cycle-sorted across children), so queues can grow past a phase's worth on skewed traces.
+ */
+void TraceDriver::fillQueues() {
+    std::vector<bool> satisfied(numThreads, false);
+    uint32_t pending = numThreads;
+    for (uint32_t t = 0; t < numThreads; t++) {
+        for (const AccessRecord& acc : queues[t]) {
+            if (acc.reqCycle >= phaseLimit) {
+                satisfied[t] = true;
+                pending--;
+                break;
+            }
+        }
+    }
+
+    while (pending && !tr.empty()) {
+        AccessRecord acc = tr.read();
+        uint32_t t = acc.childId % numThreads;
+        queues[t].push_back(acc);
+        if (!satisfied[t] && acc.reqCycle >= phaseLimit) {
+            satisfied[t] = true;
+            pending--;
+        }
+    }
+}
+
+bool TraceDriver::replayPhase(uint32_t thid) {
+    if (numThreads > 1) {
+        std::deque<AccessRecord>& q = queues[thid];
+        while (!q.empty() && q.front().reqCycle < phaseLimit) {
+            executeAccess(q.front());
+            q.pop_front();
+        }
+        return !(q.empty() && tr.empty()); //tr is only read by the caller, which is waiting for us
+    }
+
+    AccessRecord& lastAcc = replayThreads[thid].lastAcc;
 
     //Load valid access
     AccessRecord acc;
     if (lastAcc.childId == (uint32_t)-1) {
-        if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        if (!nextAccess(acc)) return false;
     } else {
         acc = lastAcc;
         lastAcc.childId = (uint32_t)-1;
     }
 
     //Run until we reach the cycle limit or run out of phases
-    while (acc.reqCycle < limit) {
+    while (acc.reqCycle < phaseLimit) {
         executeAccess(acc);
-        if (tr.empty()) return false;
-        acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        if (!nextAccess(acc)) return false;
     }
 
     lastAcc = acc; //save this access for the next phase
@@ -123,18 +267,33 @@ bool TraceDriver::executePhase() {
 
 void TraceDriver::executeAccess(AccessRecord acc) {
     assert(acc.childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
+    ChildInfo& child = children[acc.childId];
+    std::unordered_map<Address, MESIState>& cStore = child.cStore;
 
+    /* Like a cache, we hold our lock except while the parent handles our requests (it releases and reacquires it).
+     * Requests that pass the parent a pointer to an existing line's state mark it in-flight, so that racing
+     * invalidations update it instead of erasing it, and the parent can detect the race.
+     */
+    futex_lock(&child.lock);
     int64_t lat = 0;
     switch (acc.type) {
         case PUTS:
         case PUTX:
             {
-                if (!playPuts) return;
+                if (!playPuts) {
+                    futex_unlock(&child.lock);
+                    return;
+                }
                 std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                if (it == cStore.end()) { //we don't currently have this line, skip
+                    futex_unlock(&child.lock);
+                    return;
+                }
+                child.inFlight = true;
+                child.inFlightLine = acc.lineAddr;
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, &child.lock, it->second, acc.childId};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
+                child.inFlight = false;
                 assert(it->second == I);
                 cStore.erase(it);
             }
@@ -144,39 +303,50 @@ void TraceDriver::executeAccess(AccessRecord acc) {
             {
                 std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
                 MESIState state = I;
+                MESIState* statePtr = &state;
                 if (it != cStore.end()) {
                     if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            child.inFlight = true;
+                            child.inFlightLine = acc.lineAddr;
+                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, &child.lock, it->second, acc.childId};
                             parent->access(req);
+                            child.inFlight = false;
                             assert(it->second == I);
+                            cStore.erase(it);
                         } else {
+                            futex_unlock(&child.lock);
                             return; //skip
                         }
-                    } else {
-                        state = it->second;
+                    } else { //upgrade miss
+                        child.inFlight = true;
+                        child.inFlightLine = acc.lineAddr;
+                        statePtr = &it->second;
                     }
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, statePtr, acc.reqCycle, &child.lock, *statePtr, acc.childId};
                 uint64_t respCycle = parent->access(req);
+                child.inFlight = false;
                 lat = respCycle - acc.reqCycle;
-                children[acc.childId].profLat.inc(lat);
-                children[acc.childId].skew += ((int64_t)lat - acc.latency);
-                assert(state != I);
-                cStore[acc.lineAddr] = state;
+                child.profLat.inc(lat);
+                child.skew += ((int64_t)lat - acc.latency);
+                assert(*statePtr != I);
+                if (statePtr == &state) cStore[acc.lineAddr] = state;
             }
             break;
         default:
             panic("Unknown access type %d, trace is probably corrupted", acc.type);
     }
 
-    children[acc.childId].lastReqCycle = acc.reqCycle;
+    child.lastReqCycle = acc.reqCycle;
     if (atw) {
         AccessRecord wAcc = acc;
         // We always want the outout trace to be skewed regardless... otherwise it does not make sense to produce an output trace
-        if (!useSkews) wAcc.reqCycle += children[acc.childId].skew;
+        if (!useSkews) wAcc.reqCycle += child.skew;
         wAcc.latency = lat;
+        futex_lock(&lock);
         atw->write(wAcc);
+        futex_unlock(&lock);
     }
+    futex_unlock(&child.lock);
 }
-
@@ -26,14 +26,22 @@
 #ifndef __TRACE_DRIVER_H__
 #define __TRACE_DRIVER_H__
 
+#include <deque>
 #include <unordered_map>
 #include <vector>
 #include "access_tracing.h"
 #include "g_std/g_string.h"
 #include "stats.h"
 
-/* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it */
+/* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it.
+ *
+ * Replay can be split across multiple host threads: each thread replays a subset of the children (childId % numThreads),
+ * and all threads sync at phase boundaries. The caller decodes the trace once per phase and fans records out to per-thread
+ * queues, so decoding and I/O do not grow with the number of threads. Children lock themselves like caches
+ * do (hand-over-hand, through MemReq::childLock), so the parent sees concurrent accesses as in execution-driven runs.
+ */
 
+class Checkpoint;
 class TraceDriverProxyCache;
 
 class TraceDriver {
@@ -42,6 +50,9 @@ class TraceDriver {
             std::unordered_map<Address, MESIState> cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
             int64_t skew;
             uint64_t lastReqCycle;
+            lock_t lock; //protects cStore; passed as the child lock of our requests
+            Address inFlightLine; //line whose cStore state the parent may be updating; invalidations must not erase it
+            bool inFlight;
             //Counter bypassedGETS;
             //Counter bypassedGETX;
             Counter profLat;
@@ -50,8 +61,15 @@ class TraceDriver {
             Counter profInvx;
         };
 
+        struct ReplayThread {
+            lock_t wakeLock; //used to sleep/wake up replay thread
+            //Last access, childId == -1 if invalid, acts as 1-elem buffer (single-threaded replay only)
+            AccessRecord lastAcc;
+            bool done;
+        };
+
         ChildInfo* children;
-        lock_t lock; //NOTE: not needed for now
+        lock_t lock; //serializes retrace writes
         AccessTraceReader tr;
         uint32_t numChildren;
         bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child.
@@ -61,20 +79,37 @@ class TraceDriver {
 
         AccessTraceWriter* atw;
 
-        //Last access, childId == -1 if invalid, acts as 1-elem buffer
-        AccessRecord lastAcc;
+        ReplayThread* replayThreads;
+        std::deque<AccessRecord>* queues; //per replay thread, filled by the caller (the trace is decoded once)
+        uint32_t numThreads;
+        uint64_t phaseLimit;
+        lock_t waitLock; //caller sleeps here while replay threads run
+        volatile uint32_t threadsDone;
+        volatile uint32_t threadTicket;
 
     public:
-        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets);
+        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads);
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
 
-        uint64_t invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId);
+        uint64_t invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId, bool inexact);
+
+        //Saves/restores the lines each child holds, which must match the sharers of the parent's directory
+        void serialize(Checkpoint& ck);
 
         //Returns false if done, true otherwise
         bool executePhase();
 
     private:
+        static void ReplayThreadTrampoline(void* arg);
+        void replayThreadLoop(uint32_t thid);
+
+        //Replays the accesses of this thread's children up to phaseLimit. Returns false if its part of the trace is done
+        bool replayPhase(uint32_t thid);
+        inline bool nextAccess(AccessRecord& acc);
+
+        //Decodes the trace and hands each replay thread its records, until every thread has one at or past phaseLimit
+        void fillQueues();
         inline void executeAccess(AccessRecord acc);
 };
 
@@ -97,7 +132,7 @@ class TraceDriverProxyCache : public BaseCache {
 
         uint64_t access(MemReq& req) {panic("Should never be called");}
         uint64_t invalidate(const InvReq& req) {
-            return drv->invalidate(id, req.lineAddr, req.type, req.writeback, req.cycle, req.srcId);
+            return drv->invalidate(id, req.lineAddr, req.type, req.writeback, req.cycle, req.srcId, req.inexact);
         }
 };
 
@@ -24,35 +24,35 @@
  */
 
 #include "utility_monitor.h"
+#include <string.h>
 #include "hash.h"
 
 #define DEBUG_UMON 0
 //#define DEBUG_UMON 1
 
-UMon::UMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets) {
+UMon::UMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets, uint32_t _levels) {
     umonLines = _umonLines;
     buckets = _buckets;
+    levels = _levels;
     samplingFactor = _bankLines/umonLines;
     sets = umonLines/buckets;
+    assert(levels >= 1);
+    if (levels > 1 && (buckets % 2)) panic("UMon with multiple levels needs an even number of buckets (%d)", buckets);
 
-    heads = gm_calloc<Node*>(sets);
-    array = gm_calloc<Node*>(sets);
-    for (uint32_t i = 0; i < sets; i++) {
-        array[i] = gm_calloc<Node>(buckets);
-        heads[i] = &array[i][0];
-        for (uint32_t j = 0; j < buckets-1; j++) {
-            array[i][j].next = &array[i][j+1];
-        }
-    }
+    tags = gm_calloc<Address>(levels*sets*buckets);
+    matchImpl = bestTagMatchImpl(MIN(64u, buckets));
 
-    curWayHits = gm_calloc<uint64_t>(buckets);
-    curMisses = 0;
+    curWayHits = gm_calloc<uint64_t>(levels*buckets);
+    curMisses = gm_calloc<uint64_t>(levels);
+    pastWayHits = gm_calloc<uint64_t>(levels*buckets);
+    pastMisses = gm_calloc<uint64_t>(levels);
 
     hf = new H3HashFamily(2, 32, 0xF000BAAD);
 
     samplingFactorBits = 0;
     uint32_t tmp = samplingFactor;
     while (tmp >>= 1) samplingFactorBits++;
+    if (samplingFactorBits + levels - 1 > 32) panic("UMon: too many levels (%d) for sampling factor %d", levels, samplingFactor);
 
     setsBits = 0;
     tmp = sets;
@@ -60,19 +60,44 @@ UMon::UMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets) {
 }
 
 void UMon::initStats(AggregateStat* parentStat) {
-    profWayHits.init("hits", "Sampled hits per bucket", buckets); parentStat->append(&profWayHits);
-    profMisses.init("misses", "Sampled misses"); parentStat->append(&profMisses);
+    auto accLambda = [this]() -> uint64_t {
+        uint64_t total = curMisses[0] + pastMisses[0];
+        for (uint32_t b = 0; b < buckets; b++) total += curWayHits[b] + pastWayHits[b];
+        return total;
+    };
+    auto accStat = makeLambdaStat(accLambda);
+    accStat->init("accs", "Sampled accesses");
+    parentStat->append(accStat);
+
+    //NOTE: Both curves are evaluated at dump time, from the counts of past and current intervals
+    auto mrcLambda = [this](uint32_t idx) -> uint64_t {
+        return curvePoint(curWayHits, curMisses, idx) + curvePoint(pastWayHits, pastMisses, idx);
+    };
+    auto mrcStat = makeLambdaVectorStat(mrcLambda, getCurvePoints());
+    mrcStat->init("misses", "Sampled misses by LRU cache size (see UMon::getCurvePoints())");
+    parentStat->append(mrcStat);
 }
 
+uint64_t UMon::curvePoint(const uint64_t* wayHits, const uint64_t* misses, uint32_t idx) const {
+    assert(idx < getCurvePoints());
+    uint32_t level = 0;
+    uint32_t b = idx;
+    if (idx > buckets) {
+        level = 1 + (idx - buckets - 1)/(buckets/2);
+        b = buckets/2 + 1 + (idx - buckets - 1) % (buckets/2);
+    }
+    //Misses of a b-bucket cache are the misses plus the hits beyond position b
+    uint64_t total = misses[level];
+    for (uint32_t i = b; i < buckets; i++) total += wayHits[level*buckets + i];
+    return total << level;
+}
 
 void UMon::access(Address lineAddr) {
     //1. Hash to decide if it should go in the cache
     uint64_t sampleMask = ~(((uint64_t)-1LL) << samplingFactorBits);
-    uint64_t sampleSel = (hf->hash(0, lineAddr)) & sampleMask;
-
-    //info("0x%lx 0x%lx", sampleMask, sampleSel);
+    uint64_t sampleHash = hf->hash(0, lineAddr);
 
-    if (sampleSel != 0) {
+    if ((sampleHash & sampleMask) != 0) {
         return;
     }
 
@@ -80,41 +105,27 @@ void UMon::access(Address lineAddr) {
     uint64_t setMask = ~(((uint64_t)-1LL) << setsBits);
     uint64_t set = (hf->hash(1, lineAddr)) & setMask;
 
-    // Check hit
-    Node* prev = nullptr;
-    Node* cur = heads[set];
-    bool hit = false;
-    for (uint32_t b = 0; b < buckets; b++) {
-        if (cur->addr == lineAddr) { //Hit at position b, profile
-            //profHits.inc();
-            //profWayHits.inc(b);
-            curWayHits[b]++;
-            hit = true;
-            break;
-        } else if (b < buckets-1) {
-            prev = cur;
-            cur = cur->next;
+    //Samples are nested: a line sampled at level l is sampled at every level below it
+    for (uint32_t l = 0; l < levels; l++, sampleMask = (sampleMask << 1) | 1) {
+        if ((sampleHash & sampleMask) != 0) break;
+
+        Address* setTags = &tags[(l*sets + set)*buckets];
+        int32_t pos = findTag(setTags, lineAddr);
+        if (pos >= 0) { //Hit at position pos, profile
+            curWayHits[l*buckets + pos]++;
+        } else { //Profile miss, kick LRU out
+            curMisses[l]++;
+            pos = buckets - 1;
         }
-    }
 
-    //Profile miss, kick cur out, put lineAddr in
-    if (!hit) {
-        curMisses++;
-        //profMisses.inc();
-        assert(cur->next == nullptr);
-        cur->addr = lineAddr;
-    }
-
-    //Move cur to MRU (happens regardless of whether this is a hit or a miss)
-    if (prev) {
-        prev->next = cur->next;
-        cur->next = heads[set];
-        heads[set] = cur;
+        //Move to MRU (happens regardless of whether this is a hit or a miss)
+        for (int32_t i = pos; i > 0; i--) setTags[i] = setTags[i-1];
+        setTags[0] = lineAddr;
     }
 }
 
 uint64_t UMon::getNumAccesses() const {
-    uint64_t total = curMisses;
+    uint64_t total = curMisses[0];
     for (uint32_t i = 0; i < buckets; i++) {
         total += curWayHits[buckets - i - 1];
     }
@@ -122,7 +133,7 @@ uint64_t UMon::getNumAccesses() const {
 }
 
 void UMon::getMisses(uint64_t* misses) {
-    uint64_t total = curMisses;
+    uint64_t total = curMisses[0];
     for (uint32_t i = 0; i < buckets; i++) {
         misses[buckets - i] = total;
         total += curWayHits[buckets - i - 1];
@@ -136,9 +147,12 @@ void UMon::getMisses(uint64_t* misses) {
 
 
 void UMon::startNextInterval() {
-curMisses = 0;
-                for (uint32_t b = 0; b < buckets; b++) {
-                    curWayHits[b] = 0;
-                }
+    for (uint32_t l = 0; l < levels; l++) {
+        pastMisses[l] += curMisses[l];
+        curMisses[l] = 0;
+    }
+    for (uint32_t b = 0; b < levels*buckets; b++) {
+        pastWayHits[b] += curWayHits[b];
+        curWayHits[b] = 0;
+    }
 }
-
@@ -26,9 +26,11 @@
 #ifndef UTILITY_MONITOR_H_
 #define UTILITY_MONITOR_H_
 
+#include "bithacks.h"
 #include "galloc.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
+#include "tag_match.h"
 
 //Print some information regarding utility monitors and partitioning
 #define UMON_INFO 0
@@ -36,36 +38,47 @@
 
 class HashFamily;
 
+/* Utility monitor (Qureshi and Patt, ISCA 2006): an LRU stack profiler over a hashed sample of the bank's
+ * lines, which gives the misses of an LRU cache of each size (in buckets) with a single pass.
+ * Each set keeps its tags in a flat array in recency order (MRU first), searched with the array tag-match
+ * kernels. With multiple levels, level l also profiles a 2^l times sparser (and nested) sample with the
+ * same geometry, extending the miss curve to caches up to 2^l times the bank's size.
+ */
 class UMon : public GlobAlloc {
     private:
         uint32_t umonLines;
         uint32_t samplingFactor; //Size of sampled cache (lines)/size of umon. Should be power of 2
         uint32_t buckets; //umon ways
         uint32_t sets; //umon sets. Should be power of 2.
+        uint32_t levels; //level l samples 1 of every samplingFactor*2^l lines
 
         //Used in masks for set indices and sampling factor descisions
         uint64_t samplingFactorBits;
         uint64_t setsBits;
 
-        uint64_t* curWayHits;
-        uint64_t curMisses;
-
-        Counter profHits;
-        Counter profMisses;
-        VectorCounter profWayHits;
+        //Per level, current interval and all past intervals (for stats)
+        uint64_t* curWayHits; //levels*buckets
+        uint64_t* curMisses; //levels
+        uint64_t* pastWayHits;
+        uint64_t* pastMisses;
 
-        //Even for high associativity/number of buckets, performance of this is not important because we downsample so much (so this is a LL)
-        struct Node {
-            Address addr;
-            struct Node* next;
-        };
-        Node** array;
-        Node** heads;
+        Address* tags; //levels*sets*buckets, set tags in recency order
+        TagMatchImpl matchImpl;
 
         HashFamily* hf;
 
+        inline int32_t findTag(const Address* setTags, Address lineAddr) const {
+            for (uint32_t i = 0; i < buckets; i += 64) { //tag-match kernels handle up to 64 ways
+                int32_t w = tagMatch(matchImpl, &setTags[i], MIN(64u, buckets - i), lineAddr);
+                if (w >= 0) return i + w;
+            }
+            return -1;
+        }
+
+        uint64_t curvePoint(const uint64_t* wayHits, const uint64_t* misses, uint32_t idx) const;
+
     public:
-        UMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets);
+        UMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets, uint32_t _levels = 1);
         void initStats(AggregateStat* parentStat);
 
         void access(Address lineAddr);
@@ -75,6 +88,11 @@ class UMon : public GlobAlloc {
         void startNextInterval();
 
         uint32_t getBuckets() const { return buckets; }
+
+        /* Points of the full miss curve: buckets+1 points for bank sizes b/buckets (as getMisses()), then, for
+         * each level l > 0, sizes 2^l*b/buckets for b in (buckets/2, buckets], scaled to level 0's sample.
+         */
+        uint32_t getCurvePoints() const { return buckets + 1 + (levels - 1)*(buckets/2); }
 };
 
 #endif  // UTILITY_MONITOR_H_
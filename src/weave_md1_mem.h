@@ -71,7 +71,7 @@ class WeaveMD1Memory : public MD1Memory {
             assert(realRespCycle >= respCycle);
             assert(req.type == PUTS || realLatency >= zeroLoadLatency);
 
-            if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+            if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId] && !req.is(MemReq::WARMUP)) {
                 WeaveMemAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) WeaveMemAccEvent(realLatency-zeroLoadLatency, domain, preDelay, postDelay);
                 memEv->setMinStartCycle(req.cycle);
                 TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
@@ -107,7 +107,7 @@ class WeaveSimpleMemory : public SimpleMemory {
             assert(realRespCycle >= respCycle);
             assert(req.type == PUTS || realLatency >= zeroLoadLatency);
 
-            if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+            if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId] && !req.is(MemReq::WARMUP)) {
                 WeaveMemAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) WeaveMemAccEvent(realLatency-zeroLoadLatency, domain, preDelay, postDelay);
                 memEv->setMinStartCycle(req.cycle);
                 TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
@@ -41,18 +41,21 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "access_tracing.h"
+#include "checkpoint.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
 #include "cpuenum.h"
 #include "cpuid.h"
 #include "debug_zsim.h"
+#include "decode_cache.h"
 #include "event_queue.h"
 #include "galloc.h"
 #include "init.h"
 #include "log.h"
 #include "pin.H"
 #include "pin_cmd.h"
+#include "process_stats.h"
 #include "process_tree.h"
 #include "profile_stats.h"
 #include "scheduler.h"
@@ -189,6 +192,81 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, ADDRINT addr,
     fPtrs[tid].predStorePtr(tid, addr, pred);
 }
 
+/* Batched memory op instrumentation (sim.batchMemOps)
+ *
+ * Instead of making an analysis call per load and store, each memory op
+ * writes its effective address to a fixed slot of a per-thread buffer. Slots
+ * are assigned at instrumentation time, so the recording routines are one or
+ * two stores that Pin inlines. The BBL analysis call then delivers the
+ * previous BBL's addresses to the core, in program order, through the usual
+ * load/store pointers. OOO cores consume addresses of a BBL on the next bbl()
+ * call anyway; other cores see each BBL's memory ops one BBL later than with
+ * per-access calls, but in the same order relative to their bbl() calls.
+ *
+ * BBLs with REP-prefixed ops (which Pin runs as implicit loops, so a slot
+ * would be overwritten) or more than MAX_BATCHED_MEMOPS memory ops are
+ * instrumented per access; their BBL call still flushes the previous BBL.
+ * Syscalls also flush, while the thread still holds its core, so the ops of
+ * a thread's last BBL (which ends in the exit syscall) are simulated too.
+ */
+
+#define MAX_BATCHED_MEMOPS 64
+
+enum BatchedMemOpType {MEMOP_LOAD, MEMOP_STORE, MEMOP_PRED_LOAD, MEMOP_PRED_STORE};
+
+struct BblMemOps {
+    uint32_t numOps;
+    uint8_t types[0]; //BatchedMemOpType of each slot
+};
+
+struct MemOpBuffer {
+    ADDRINT addrs[MAX_BATCHED_MEMOPS];
+    BOOL preds[MAX_BATCHED_MEMOPS];
+    const BblMemOps* pending; //ops of the BBL being recorded, delivered by the next BBL call
+    InstrFuncPtrs ptrs; //mode the pending ops were recorded in
+};
+
+MemOpBuffer memOpBufs[MAX_THREADS] ATTR_LINE_ALIGNED;
+
+// These must stay simple enough for Pin to inline them (no calls or control flow)
+VOID PIN_FAST_ANALYSIS_CALL RecordMemOp(THREADID tid, ADDRINT addr, UINT32 slot) {
+    memOpBufs[tid].addrs[slot] = addr;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL RecordPredMemOp(THREADID tid, ADDRINT addr, BOOL pred, UINT32 slot) {
+    memOpBufs[tid].addrs[slot] = addr;
+    memOpBufs[tid].preds[slot] = pred;
+}
+
+// Delivers the pending ops of the previous BBL, if any
+static inline void FlushMemOps(THREADID tid) {
+    MemOpBuffer& buf = memOpBufs[tid];
+    const BblMemOps* prev = buf.pending;
+    buf.pending = nullptr;
+    if (prev) {
+        // Replay in the mode the ops were recorded in. A join variant switches fPtrs on its first op, so follow fPtrs then
+        bool join = buf.ptrs.type == FPTR_JOIN;
+        for (uint32_t i = 0; i < prev->numOps; i++) {
+            const InstrFuncPtrs& ptrs = join? fPtrs[tid] : buf.ptrs;
+            switch (prev->types[i]) {
+                case MEMOP_LOAD: ptrs.loadPtr(tid, buf.addrs[i]); break;
+                case MEMOP_STORE: ptrs.storePtr(tid, buf.addrs[i]); break;
+                case MEMOP_PRED_LOAD: ptrs.predLoadPtr(tid, buf.addrs[i], buf.preds[i]); break;
+                case MEMOP_PRED_STORE: ptrs.predStorePtr(tid, buf.addrs[i], buf.preds[i]); break;
+            }
+        }
+    }
+}
+
+VOID PIN_FAST_ANALYSIS_CALL IndirectBatchedBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo, const BblMemOps* memOps) {
+    FlushMemOps(tid);
+    fPtrs[tid].bblPtr(tid, bblAddr, bblInfo);
+    // The BBL call may switch modes (e.g., entering fast-forward at a barrier); this BBL's ops run in the new one
+    MemOpBuffer& buf = memOpBufs[tid];
+    buf.pending = memOps;
+    buf.ptrs = fPtrs[tid];
+}
+
 
 //Non-simulation variants of analysis functions
 
@@ -250,6 +328,44 @@ VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     }
 }
 
+// Warming FF variants (processN.ffWarm): memory accesses update cache state through untimed
+// accesses (see MemReq::WARMUP). FF threads are not scheduled, so each one warms the caches of a
+// fixed core of its process mask, picked round-robin by thread id on its first access.
+static Core* warmCores[MAX_THREADS];
+
+static Core* GetWarmCore(THREADID tid) {
+    if (unlikely(!warmCores[tid])) {
+        const g_vector<bool>& mask = procTreeNode->getMask();
+        uint32_t maskCores = 0;
+        for (bool b : mask) maskCores += b? 1 : 0;
+        assert_msg(maskCores, "Process %d has an empty mask, cannot warm caches", procIdx);
+        uint32_t pick = tid % maskCores;
+        for (uint32_t cid = 0; cid < mask.size(); cid++) {
+            if (mask[cid] && pick-- == 0) {
+                warmCores[tid] = zinfo->cores[cid];
+                break;
+            }
+        }
+    }
+    return warmCores[tid];
+}
+
+VOID WarmLoadSingle(THREADID tid, ADDRINT addr) {
+    GetWarmCore(tid)->warmAccess(addr, true);
+}
+
+VOID WarmStoreSingle(THREADID tid, ADDRINT addr) {
+    GetWarmCore(tid)->warmAccess(addr, false);
+}
+
+VOID WarmPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) WarmLoadSingle(tid, addr);
+}
+
+VOID WarmPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    if (pred) WarmStoreSingle(tid, addr);
+}
+
 // FFI is instruction-based fast-forwarding
 /* FFI works as follows: when in fast-forward, we install a special FF BBL func
  * ptr that counts instructions and checks whether we have reached the switch
@@ -259,6 +375,11 @@ VOID FFBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
  * entry, we install a special handler that advances to the next FFI point and
  * installs the normal FFI handlers (pretty much like joins work).
  *
+ * Periodic sampling (processN.samplingPeriod) reuses FFI with a two-point
+ * schedule (FF, warmup + window) that wraps around instead of finishing. Each
+ * NFF interval queues an extra event that starts the measurement window after
+ * the warmup; entering FF ends it.
+ *
  * REQUIREMENTS: Single-threaded during FF (non-FF can be MT)
  */
 
@@ -270,6 +391,7 @@ static uint32_t ffiPoint;
 static uint64_t ffiInstrsDone;
 static uint64_t ffiInstrsLimit;
 static bool ffiNFF;
+static uint64_t ffiNFFInstrs; //non-FF instrs included in ffiInstrsDone
 
 //Track the non-FF instructions executed at the beginning of this and last interval.
 //Can only be updated at ends of phase, by the NFF tracking event.
@@ -289,8 +411,10 @@ VOID FFITrackNFFInterval() {
     uint64_t* _ffiFFStartInstrs = ffiFFStartInstrs;
     uint64_t* _ffiPrevFFStartInstrs = ffiPrevFFStartInstrs;
     auto ffiGet = [p, startInstrs]() { return zinfo->processStats->getProcessInstrs(p) - startInstrs; };
-    auto ffiFire = [p, _ffiFFStartInstrs, _ffiPrevFFStartInstrs]() {
+    SamplingStats* sstats = procTreeNode->getSamplingStats();
+    auto ffiFire = [p, _ffiFFStartInstrs, _ffiPrevFFStartInstrs, sstats]() {
         info("FFI: Entering fast-forward for process %d", p);
+        if (sstats) sstats->endWindow();
         /* Note this is sufficient due to the lack of reinstruments on FF, and this way we do not need to touch global state */
         futex_lock(&zinfo->ffLock);
         assert(!zinfo->procArray[p]->isInFastForward());
@@ -299,6 +423,12 @@ VOID FFITrackNFFInterval() {
         *_ffiPrevFFStartInstrs = *_ffiFFStartInstrs;
         *_ffiFFStartInstrs = zinfo->processStats->getProcessInstrs(p);
     };
+    if (sstats) {
+        //Inserted first, so it fires first if both reach their targets on the same phase
+        auto windowFire = [sstats]() { sstats->beginWindow(); };
+        uint64_t warmup = std::min(procTreeNode->getSamplingWarmup(), ffiInstrsLimit - ffiInstrsDone);
+        zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, windowFire, 0, warmup, MAX_IPC*zinfo->phaseLength));
+    }
     zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->phaseLength));
 
     ffiNFF = true;
@@ -312,6 +442,7 @@ VOID FFIInit() {
         ffiEnabled = true;
         ffiPoint = 0;
         ffiInstrsDone = 0;
+        ffiNFFInstrs = 0;
         ffiInstrsLimit = ffiPoints[0];
 
         ffiFFStartInstrs = gm_calloc<uint64_t>(1);
@@ -324,14 +455,22 @@ VOID FFIInit() {
     }
 }
 
-//Set the next ffiPoint, or finish
+//Publishes the fast-forwarded instrs of a sampled process (its simulated ones are in processStats)
+static void FFIUpdateSamplingStats() {
+    SamplingStats* sstats = procTreeNode->getSamplingStats();
+    if (ffiEnabled && sstats) sstats->setFFInstrs(ffiInstrsDone - ffiNFFInstrs);
+}
+
+//Set the next ffiPoint, or finish (periodic sampling wraps around instead)
 VOID FFIAdvance() {
     const g_vector<uint64_t>& ffiPoints = procTreeNode->getFFIPoints();
+    FFIUpdateSamplingStats();
     ffiPoint++;
-    if (ffiPoint >= ffiPoints.size()) {
+    if (ffiPoint >= ffiPoints.size() && !procTreeNode->getSamplingPeriod()) {
         info("Last ffiPoint reached, %ld instrs, limit %ld", ffiInstrsDone, ffiInstrsLimit);
         SimEnd();
     } else {
+        if (ffiPoint >= ffiPoints.size()) ffiPoint = 0;
         info("ffiPoint reached, %ld instrs, limit %ld", ffiInstrsDone, ffiInstrsLimit);
         ffiInstrsLimit += ffiPoints[ffiPoint];
     }
@@ -354,7 +493,9 @@ VOID FFIBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
 
 // One-off, called after we go from NFF to FF
 VOID FFIEntryBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
-    ffiInstrsDone += *ffiFFStartInstrs - *ffiPrevFFStartInstrs; //add all instructions executed in the NFF phase
+    uint64_t nffInstrs = *ffiFFStartInstrs - *ffiPrevFFStartInstrs;
+    ffiInstrsDone += nffInstrs; //add all instructions executed in the NFF phase
+    ffiNFFInstrs += nffInstrs;
     FFIAdvance();
     assert(ffiNFF);
     ffiNFF = false;
@@ -371,7 +512,12 @@ static const InstrFuncPtrs ffPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFB
 static const InstrFuncPtrs ffiPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 static const InstrFuncPtrs ffiEntryPtrs = {NOPLoadStoreSingle, NOPLoadStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, NOPPredLoadStoreSingle, NOPPredLoadStoreSingle, FPTR_NOP};
 
+static const InstrFuncPtrs warmFFPtrs = {WarmLoadSingle, WarmStoreSingle, FFBasicBlock, NOPRecordBranch, WarmPredLoadSingle, WarmPredStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs warmFFIPtrs = {WarmLoadSingle, WarmStoreSingle, FFIBasicBlock, NOPRecordBranch, WarmPredLoadSingle, WarmPredStoreSingle, FPTR_NOP};
+static const InstrFuncPtrs warmFFIEntryPtrs = {WarmLoadSingle, WarmStoreSingle, FFIEntryBasicBlock, NOPRecordBranch, WarmPredLoadSingle, WarmPredStoreSingle, FPTR_NOP};
+
 static const InstrFuncPtrs& GetFFPtrs() {
+    if (procTreeNode->getFFWarm()) return ffiEnabled? (ffiNFF? warmFFIEntryPtrs : warmFFIPtrs) : warmFFPtrs;
     return ffiEnabled? (ffiNFF? ffiEntryPtrs : ffiPtrs) : ffPtrs;
 }
 
@@ -490,6 +636,12 @@ VOID EndOfPhaseActions() {
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
+
+    //All threads are in the barrier and the weave phase is done, so the system is quiescent
+    if (zinfo->checkpointFile && (zinfo->checkpointPending || (zinfo->checkpointPhase && zinfo->numPhases == zinfo->checkpointPhase))) {
+        SaveCheckpoint(zinfo->checkpointFile);
+        zinfo->checkpointPending = false;
+    }
     zinfo->profSimTime->transition(PROF_BOUND);
 }
 
@@ -528,38 +680,74 @@ static void PrintIp(THREADID tid, ADDRINT ip) {
 }
 #endif
 
-VOID Instruction(INS ins) {
+// Records ins's memory ops in memOps' next slots (see batched memory op instrumentation above)
+static void InstrumentBatchedMemOps(INS ins, BblMemOps* memOps) {
+    auto record = [&](IARG_TYPE eaArg, BatchedMemOpType type, BatchedMemOpType predType) {
+        uint32_t slot = memOps->numOps++;
+        assert(slot < MAX_BATCHED_MEMOPS);
+        if (!INS_IsPredicated(ins)) {
+            memOps->types[slot] = type;
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RecordMemOp, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, eaArg, IARG_UINT32, slot, IARG_END);
+        } else {
+            memOps->types[slot] = predType;
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) RecordPredMemOp, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, eaArg, IARG_EXECUTING, IARG_UINT32, slot, IARG_END);
+        }
+    };
+
+    if (INS_IsMemoryRead(ins)) record(IARG_MEMORYREAD_EA, MEMOP_LOAD, MEMOP_PRED_LOAD);
+    if (INS_HasMemoryRead2(ins)) record(IARG_MEMORYREAD2_EA, MEMOP_LOAD, MEMOP_PRED_LOAD);
+    if (INS_IsMemoryWrite(ins)) record(IARG_MEMORYWRITE_EA, MEMOP_STORE, MEMOP_PRED_STORE);
+}
+
+// Returns the memory op slots of a BBL for batched instrumentation, or nullptr if it has no memory ops or must be instrumented per access
+static BblMemOps* AllocBblMemOps(BBL bbl) {
+    uint32_t ops = 0;
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+        if (INS_HasRealRep(ins)) return nullptr;
+        ops += (INS_IsMemoryRead(ins)? 1 : 0) + (INS_HasMemoryRead2(ins)? 1 : 0) + (INS_IsMemoryWrite(ins)? 1 : 0);
+    }
+    if (ops == 0 || ops > MAX_BATCHED_MEMOPS) return nullptr;
+    BblMemOps* memOps = static_cast<BblMemOps*>(gm_malloc(sizeof(BblMemOps) + ops*sizeof(uint8_t)));
+    memOps->numOps = 0; //filled in as the BBL's instructions are instrumented
+    return memOps;
+}
+
+VOID Instruction(INS ins, BblMemOps* memOps) {
     //Uncomment to print an instruction trace
     //INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)PrintIp, IARG_THREAD_ID, IARG_REG_VALUE, REG_INST_PTR, IARG_END);
 
     if (!procTreeNode->isInFastForward() || !zinfo->ffReinstrument) {
-        AFUNPTR LoadFuncPtr = (AFUNPTR) IndirectLoadSingle;
-        AFUNPTR StoreFuncPtr = (AFUNPTR) IndirectStoreSingle;
+        if (memOps) {
+            InstrumentBatchedMemOps(ins, memOps);
+        } else {
+            AFUNPTR LoadFuncPtr = (AFUNPTR) IndirectLoadSingle;
+            AFUNPTR StoreFuncPtr = (AFUNPTR) IndirectStoreSingle;
 
-        AFUNPTR PredLoadFuncPtr = (AFUNPTR) IndirectPredLoadSingle;
-        AFUNPTR PredStoreFuncPtr = (AFUNPTR) IndirectPredStoreSingle;
+            AFUNPTR PredLoadFuncPtr = (AFUNPTR) IndirectPredLoadSingle;
+            AFUNPTR PredStoreFuncPtr = (AFUNPTR) IndirectPredStoreSingle;
 
-        if (INS_IsMemoryRead(ins)) {
-            if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_END);
-            } else {
-                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_EXECUTING, IARG_END);
+            if (INS_IsMemoryRead(ins)) {
+                if (!INS_IsPredicated(ins)) {
+                    INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_END);
+                } else {
+                    INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD_EA, IARG_EXECUTING, IARG_END);
+                }
             }
-        }
 
-        if (INS_HasMemoryRead2(ins)) {
-            if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_END);
-            } else {
-                INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_EXECUTING, IARG_END);
+            if (INS_HasMemoryRead2(ins)) {
+                if (!INS_IsPredicated(ins)) {
+                    INS_InsertCall(ins, IPOINT_BEFORE, LoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_END);
+                } else {
+                    INS_InsertCall(ins, IPOINT_BEFORE, PredLoadFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYREAD2_EA, IARG_EXECUTING, IARG_END);
+                }
             }
-        }
 
-        if (INS_IsMemoryWrite(ins)) {
-            if (!INS_IsPredicated(ins)) {
-                INS_InsertCall(ins, IPOINT_BEFORE,  StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_END);
-            } else {
-                INS_InsertCall(ins, IPOINT_BEFORE,  PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_EXECUTING, IARG_END);
+            if (INS_IsMemoryWrite(ins)) {
+                if (!INS_IsPredicated(ins)) {
+                    INS_InsertCall(ins, IPOINT_BEFORE,  StoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_END);
+                } else {
+                    INS_InsertCall(ins, IPOINT_BEFORE,  PredStoreFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_MEMORYWRITE_EA, IARG_EXECUTING, IARG_END);
+                }
             }
         }
 
@@ -597,19 +785,24 @@ VOID Instruction(INS ins) {
 
 
 VOID Trace(TRACE trace, VOID *v) {
-    if (!procTreeNode->isInFastForward() || !zinfo->ffReinstrument) {
-        // Visit every basic block in the trace
-        for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    bool instrument = !procTreeNode->isInFastForward() || !zinfo->ffReinstrument;
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        BblMemOps* memOps = nullptr;
+        if (instrument) {
             BblInfo* bblInfo = Decoder::decodeBbl(bbl, zinfo->oooDecode);
-            BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/, (AFUNPTR)IndirectBasicBlock, IARG_FAST_ANALYSIS_CALL,
-                 IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_END);
+            if (zinfo->batchMemOps) {
+                memOps = AllocBblMemOps(bbl);
+                BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)IndirectBatchedBasicBlock, IARG_FAST_ANALYSIS_CALL,
+                     IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_PTR, memOps, IARG_END);
+            } else {
+                BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/, (AFUNPTR)IndirectBasicBlock, IARG_FAST_ANALYSIS_CALL,
+                     IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_END);
+            }
         }
-    }
 
-    //Instruction instrumentation now here to ensure proper ordering
-    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        //Instruction instrumentation now here to ensure proper ordering
         for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
-            Instruction(ins);
+            Instruction(ins, memOps);
         }
     }
 }
@@ -854,6 +1047,13 @@ VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v) {
         info("Unpaused");
     }
 
+    //FFI counts fast-forwarded instrs per process without synchronization
+    if (procTreeNode->getSamplingPeriod() && tid != 0) {
+        panic("Process %d uses periodic sampling, which requires single-threaded processes (thread %d started)", procIdx, tid);
+    }
+
+    memOpBufs[tid].pending = nullptr; //tids are reused, drop any ops of an exited thread
+
     if (procTreeNode->isInFastForward()) {
         info("FF thread %d starting", tid);
         fPtrs[tid] = GetFFPtrs();
@@ -875,6 +1075,7 @@ VOID SimThreadFini(THREADID tid) {
 
 VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
     //NOTE: Thread has no valid cid here!
+    memOpBufs[tid].pending = nullptr; //ops are flushed on syscall entry; drop any left by threads that end otherwise
     if (fPtrs[tid].type == FPTR_NOP) {
         info("Shadow/NOP thread %d finished", tid);
         return;
@@ -886,6 +1087,8 @@ VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
 
 //Need to remove ourselves from running threads in case the syscall is blocking
 VOID SyscallEnter(THREADID tid, CONTEXT *ctxt, SYSCALL_STANDARD std, VOID *v) {
+    FlushMemOps(tid); //deliver batched ops of the BBL that ends in this syscall before we leave our core
+
     bool isNopThread = fPtrs[tid].type == FPTR_NOP;
     bool isRetryThread = fPtrs[tid].type == FPTR_RETRY;
 
@@ -1092,6 +1295,7 @@ VOID SimEnd() {
     }
 
     //at this point, we're in charge of exiting our whole process, but we still need to race for the stats
+    FFIUpdateSamplingStats(); //instrs fast-forwarded since the last ffiPoint
 
     //per-process
 #ifdef BBL_PROFILING
@@ -1110,6 +1314,8 @@ VOID SimEnd() {
             info("All other processes done, terminating");
         }
 
+        if (zinfo->decodeCacheFile) zinfo->decodeCache->save(zinfo->decodeCacheFile);
+
         info("Dumping termination stats");
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
@@ -1133,6 +1339,7 @@ VOID SimEnd() {
 #define ZSIM_MAGIC_OP_ROI_END           (1026)
 #define ZSIM_MAGIC_OP_REGISTER_THREAD   (1027)
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
+#define ZSIM_MAGIC_OP_CHECKPOINT        (1034)
 
 VOID HandleMagicOp(THREADID tid, ADDRINT op) {
     switch (op) {
@@ -1190,6 +1397,14 @@ VOID HandleMagicOp(THREADID tid, ADDRINT op) {
         case ZSIM_MAGIC_OP_HEARTBEAT:
             procTreeNode->heartbeat(); //heartbeats are per process for now
             return;
+        case ZSIM_MAGIC_OP_CHECKPOINT:
+            if (!zinfo->checkpointFile) {
+                warn("Thread %d: Ignoring CHECKPOINT magic op, sim.checkpointFile not set", tid);
+            } else {
+                info("Thread %d: CHECKPOINT, will checkpoint at the end of the phase", tid);
+                zinfo->checkpointPending = true;
+            }
+            return;
 
         // HACK: Ubik magic ops
         case 1029:
@@ -48,6 +48,9 @@ class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class BaseCache;
+class MemObject;
+class DecodeCache;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -167,6 +170,8 @@ struct GlobSimInfo {
 
     struct LibInfo libzsimAddrs;
 
+    bool batchMemOps; //if true, memory op addresses are buffered per BBL and delivered by the BBL analysis call (see zsim.cpp)
+
     bool ffReinstrument; //true if we should reinstrument on ffwd, works fine with ST apps and it's faster since we run with basically no instrumentation, but it's not precise with MT apps
 
     //fftoggle stuff
@@ -181,6 +186,17 @@ struct GlobSimInfo {
     // Trace-driven simulation (no cores)
     bool traceDriven;
     TraceDriver* traceDriver;
+
+    // Checkpoints of warm state (see checkpoint.h)
+    g_vector<BaseCache*>* caches; //all cache banks, in config order
+    g_vector<MemObject*>* memControllers;
+    const char* checkpointFile; //nullptr if checkpoints are disabled
+    uint64_t checkpointPhase; //take a checkpoint at the end of this phase (0 to only take it on the magic op)
+    volatile bool checkpointPending; //set by the checkpoint magic op, served at the end of the phase
+
+    // Decoded BBLs shared across processes (see decode_cache.h)
+    DecodeCache* decodeCache; //nullptr if disabled or without OOO decoding
+    const char* decodeCacheFile; //nullptr if not persisted
 };
 
 